@@ -13,99 +13,109 @@ BQ32000RTC::BQ32000RTC()
 
 void BQ32000RTC::begin(uint8_t sda, uint8_t scl)
 {
+	sdaPin = sda;
+	sclPin = scl;
+	recoverBus();
 	Wire.begin(sda, scl);
-	Wire.setClock(100000);
+	Wire.setClock(BQ32000_I2C_CLOCK);
+	Wire.setClockStretchLimit(BQ32000_STRETCH_LIMIT_US);
+	shadowValid = false;
 }
 
 time_t BQ32000RTC::get()
 {
+	uint32_t start = micros();
 	tmElements_t tm;
-	if (read(tm) == false)
-		return 0;
-	return (makeTime(tm));
+	time_t t = 0;
+	if (read(tm))
+		t = makeTime(tm);
+	record(timing.get, start);
+	return t;
 }
 
 bool BQ32000RTC::set(time_t t)
 {
+	uint32_t start = micros();
 	tmElements_t tm;
 	breakTime(t, tm);
-	return write(tm);
+	bool ok = write(tm);
+	record(timing.set, start);
+	return ok;
 }
 
 bool BQ32000RTC::read(tmElements_t &tm)
 {
-	uint8_t sec;
-	Wire.beginTransmission(BQ32000_ADDRESS);
-	Wire.write((byte)0);
-	if (Wire.endTransmission() != 0) {
-		exists = false;
+	uint8_t regs[7];
+	if (!readRegisters(BQ32000_SECONDS, regs, sizeof(regs)))
 		return false;
+	tm.Second = bcd2bin(regs[0] & 0x7f);
+	tm.Minute = bcd2bin(regs[1] & 0x7f);
+	tm.Hour = bcd2bin(regs[2] & 0x3f);
+	tm.Wday = regs[3] & 0x07;
+	tm.Day = bcd2bin(regs[4] & 0x3f);
+	tm.Month = bcd2bin(regs[5] & 0x1f);
+	// The time is not valid if the oscillator is stopped, or has failed
+	// since the time was last written.
+	bool valid = !(regs[0] & 0x80) && !(regs[1] & 0x80);
+	// The chip counts years from 2000, and takes the ones divisible by
+	// four as leap years. write() marks the years it stores that way with
+	// the century enable bit; earlier firmware left it clear and counted
+	// from 1970. A clock set by such firmware is written back once in
+	// the chip's own count.
+	if (regs[2] & (1 << BQ32000__CENT_EN)) {
+		tm.Year = y2kYearToTm(bcd2bin(regs[6]));
+	} else {
+		tm.Year = bcd2bin(regs[6]);
+		if (valid && tm.Year >= y2kYearToTm(0))
+			write(tm);
 	}
-	exists = true;
-	delayMicroseconds(60);
-	Wire.requestFrom(BQ32000_ADDRESS, 7);
-	sec = Wire.read();
-	tm.Second = bcd2bin(sec & 0x7f);
-	tm.Minute = bcd2bin(Wire.read());
-	tm.Hour = bcd2bin(Wire.read());
-	Wire.read();
-	tm.Day = bcd2bin(Wire.read());
-	tm.Month = bcd2bin(Wire.read());
-	tm.Year = bcd2bin(Wire.read());
-	delayMicroseconds(60);
-	if (sec & 0x80)
-		return false;
-	return true;
+	return valid;
 }
 
 bool BQ32000RTC::write(tmElements_t &tm)
 {
-	Wire.beginTransmission(BQ32000_ADDRESS);
-	Wire.write((byte)0);
-	Wire.write(bin2bcd(tm.Second));
-	Wire.write(bin2bcd(tm.Minute));
-	Wire.write(bin2bcd(tm.Hour));
-	Wire.write(bin2bcd(0));
-	Wire.write(bin2bcd(tm.Day));
-	Wire.write(bin2bcd(tm.Month));
-	Wire.write(bin2bcd(tm.Year));
-	if (Wire.endTransmission() != 0) {
-		exists = false;
-		return false;
-	}
-	delayMicroseconds(60);
-	exists = true;
-	return true;
+	const uint8_t regs[7] = {
+		bin2bcd(tm.Second),
+		bin2bcd(tm.Minute),
+		(uint8_t)(bin2bcd(tm.Hour) | 1 << BQ32000__CENT_EN),
+		tm.Wday,
+		bin2bcd(tm.Day),
+		bin2bcd(tm.Month),
+		bin2bcd(tmYearToY2k(tm.Year)),
+	};
+	return writeRegisters(BQ32000_SECONDS, regs, sizeof(regs));
 }
 
 void BQ32000RTC::setIRQ(uint8_t state)
 {
 	/* Set IRQ square wave output state: 0=disabled, 1=1Hz, 2=512Hz. */
-	uint8_t value;
+	uint32_t start = micros();
+	if (!shadowValid)
+		loadShadow();
 	if (state) {
-		// Setting the frequency is a bit complicated on the BQ32000:
-		Wire.beginTransmission(BQ32000_ADDRESS);
-		Wire.write(BQ32000_SFKEY1);
-		Wire.write(BQ32000_SFKEY1_VAL);
-		Wire.write(BQ32000_SFKEY2_VAL);
-		Wire.write((state == 1) ? BQ32000_FTF_1HZ : BQ32000_FTF_512HZ);
-		Wire.endTransmission();
-		delayMicroseconds(60);
+		// Setting the frequency is a bit complicated on the BQ32000: the
+		// two key bytes and the frequency go in one burst.
+		int8_t sfr = (state == 1) ? BQ32000_FTF_1HZ : BQ32000_FTF_512HZ;
+		if (sfr != shadowSfr) {
+			const uint8_t keyed[3] = { BQ32000_SFKEY1_VAL, BQ32000_SFKEY2_VAL, (uint8_t)sfr };
+			if (writeRegisters(BQ32000_SFKEY1, keyed, sizeof(keyed)))
+				shadowSfr = sfr;
+		}
 	}
-	value = readRegister(BQ32000_CAL_CFG1);
-	value = (!state) ? value & ~(1 << BQ32000__FT) : value | (1 << BQ32000__FT);
+	uint8_t value = (!state) ? shadowCalCfg1 & ~(1 << BQ32000__FT) : shadowCalCfg1 | (1 << BQ32000__FT);
 	writeRegister(BQ32000_CAL_CFG1, value);
+	record(timing.setIRQ, start);
 }
 
 void BQ32000RTC::setIRQLevel(uint8_t level)
 {
 	/* Set IRQ output level when IRQ square wave output is disabled to LOW
 	 * or HIGH. */
-	uint8_t value;
 	// The IRQ active level bit is in the same register as the calibration
 	// settings, so we preserve its current state:
-	value = readRegister(BQ32000_CAL_CFG1);
-	value = (!level) ? value & ~(1 << BQ32000__OUT) : value | (1 << BQ32000__OUT);
+	if (!shadowValid)
+		loadShadow();
+	uint8_t value = (!level) ? shadowCalCfg1 & ~(1 << BQ32000__OUT) : shadowCalCfg1 | (1 << BQ32000__OUT);
 	writeRegister(BQ32000_CAL_CFG1, value);
 }
 
@@ -120,8 +130,10 @@ void BQ32000RTC::setCalibration(int8_t value)
 		value = 31;
 	if (value < -31)
 		value = -31;
+	if (!shadowValid)
+		loadShadow();
 	val = (uint8_t)(value < 0) ? -value | (1 << BQ32000__CAL_S) : value;
-	val |= readRegister(BQ32000_CAL_CFG1) & ~0x3f;
+	val |= shadowCalCfg1 & ~0x3f;
 	writeRegister(BQ32000_CAL_CFG1, val);
 }
 
@@ -136,43 +148,100 @@ void BQ32000RTC::setCharger(int state)
 	 * up to VCC (make sure the charge voltage does not exceed your super
 	 * cap's voltage rating!!).
 	 */
+	uint8_t tch2 = 0, cfg2 = 0;
+	if (state > 0 && state <= 2) {
+		cfg2 = BQ32000_CHARGE_ENABLE;
+		if (state == 2) {
+			// High voltage charge enable:
+			cfg2 |= (1 << BQ32000__TCFE);
+		}
+		tch2 = 1 << BQ32000__TCH2_BIT;
+	}
+	if (!shadowValid)
+		loadShadow();
+	if (shadowValid && shadowTch2 == tch2 && (!tch2 || shadowCfg2 == cfg2))
+		return;
 
 	// First disable charger regardless of state (prevents it from
 	// possible starting up in the high voltage mode when the low
 	// voltage mode is requested):
-	uint8_t value;
 	writeRegister(BQ32000_TCH2, 0);
-	if (state <= 0 || state > 2)
+	if (!tch2)
 		return;
-	value = BQ32000_CHARGE_ENABLE;
-	if (state == 2) {
-		// High voltage charge enable:
-		value |= (1 << BQ32000__TCFE);
-	}
-	writeRegister(BQ32000_CFG2, value);
+	writeRegister(BQ32000_CFG2, cfg2);
 	// Now enable charger:
-	writeRegister(BQ32000_TCH2, 1 << BQ32000__TCH2_BIT);
+	writeRegister(BQ32000_TCH2, tch2);
 }
 
 uint8_t BQ32000RTC::readRegister(uint8_t address)
 {
 	/* Read and return the value in the register at the given address. */
-	Wire.beginTransmission(BQ32000_ADDRESS);
-	Wire.write((byte)address);
-	Wire.endTransmission();
-	Wire.requestFrom(BQ32000_ADDRESS, 1);
-	// Get register state:
-	return Wire.read();
+	uint8_t value = 0;
+	readRegisters(address, &value, 1);
+	return value;
 }
 
 void BQ32000RTC::writeRegister(uint8_t address, uint8_t value)
 {
 	/* Write the given value to the register at the given address. */
-	Wire.beginTransmission(BQ32000_ADDRESS);
-	Wire.write(address);
-	Wire.write(value);
-	Wire.endTransmission();
-	delayMicroseconds(60);
+	writeRegisters(address, &value, 1);
+}
+
+bool BQ32000RTC::readRegisters(uint8_t address, uint8_t *values, uint8_t count)
+{
+	/* Set the register pointer and read the registers back after a
+	 * repeated start, without releasing the bus in between. */
+	for (uint8_t attempt = 0; attempt < 2; attempt++) {
+		Wire.beginTransmission(BQ32000_ADDRESS);
+		Wire.write(address);
+		if (Wire.endTransmission(false) == 0 && Wire.requestFrom(BQ32000_ADDRESS, count) == count) {
+			for (uint8_t i = 0; i < count; i++)
+				values[i] = Wire.read();
+			exists = true;
+			return true;
+		}
+		// A device may be holding the bus; free it and try once more.
+		if (!recoverBus())
+			break;
+		Wire.begin(sdaPin, sclPin);
+		Wire.setClock(BQ32000_I2C_CLOCK);
+	}
+	exists = false;
+	return false;
+}
+
+bool BQ32000RTC::writeRegisters(uint8_t address, const uint8_t *values, uint8_t count)
+{
+	for (uint8_t attempt = 0; attempt < 2; attempt++) {
+		Wire.beginTransmission(BQ32000_ADDRESS);
+		Wire.write(address);
+		for (uint8_t i = 0; i < count; i++)
+			Wire.write(values[i]);
+		if (Wire.endTransmission() == 0) {
+			exists = true;
+			// Keep the shadow registers in step with the chip.
+			for (uint8_t i = 0; i < count; i++) {
+				switch (address + i) {
+				case BQ32000_CAL_CFG1:
+					shadowCalCfg1 = values[i];
+					break;
+				case BQ32000_TCH2:
+					shadowTch2 = values[i];
+					break;
+				case BQ32000_CFG2:
+					shadowCfg2 = values[i];
+					break;
+				}
+			}
+			return true;
+		}
+		if (!recoverBus())
+			break;
+		Wire.begin(sdaPin, sclPin);
+		Wire.setClock(BQ32000_I2C_CLOCK);
+	}
+	exists = false;
+	return false;
 }
 
 unsigned char BQ32000RTC::isRunning()
@@ -180,6 +249,85 @@ unsigned char BQ32000RTC::isRunning()
 	return !(readRegister(0x0) >> 7);
 }
 
+bool BQ32000RTC::loadShadow()
+{
+	/* Read CAL_CFG1, TCH2 and CFG2 in one burst. The SFR register reads
+	 * back as zero, so its value is unknown until it is first written. */
+	uint8_t regs[3];
+	if (!readRegisters(BQ32000_CAL_CFG1, regs, sizeof(regs)))
+		return false;
+	shadowCalCfg1 = regs[0];
+	shadowTch2 = regs[1];
+	shadowCfg2 = regs[2];
+	shadowSfr = -1;
+	shadowValid = true;
+	return true;
+}
+
+bool BQ32000RTC::recoverBus()
+{
+	/* If a device was interrupted in the middle of a transfer it may hold
+	 * SDA low, waiting for more clocks. Clock SCL up to nine times until
+	 * it lets go, then issue a STOP. Returns false if the bus could not
+	 * be freed. */
+	pinMode(sdaPin, INPUT_PULLUP);
+	pinMode(sclPin, INPUT_PULLUP);
+	if (digitalRead(sdaPin) == HIGH && digitalRead(sclPin) == HIGH)
+		return true;
+
+	timing.busRecoveries++;
+	pinMode(sclPin, OUTPUT_OPEN_DRAIN);
+	for (uint8_t i = 0; i < 9 && digitalRead(sdaPin) == LOW; i++) {
+		digitalWrite(sclPin, LOW);
+		delayMicroseconds(5);
+		digitalWrite(sclPin, HIGH);
+		// Wait, for a bounded time, for a device stretching the clock.
+		uint32_t start = micros();
+		while (digitalRead(sclPin) == LOW) {
+			if (micros() - start > BQ32000_STRETCH_LIMIT_US) {
+				pinMode(sclPin, INPUT_PULLUP);
+				timing.busFailures++;
+				return false;
+			}
+		}
+		delayMicroseconds(5);
+	}
+
+	// STOP: SDA rises while SCL is high.
+	pinMode(sdaPin, OUTPUT_OPEN_DRAIN);
+	digitalWrite(sdaPin, LOW);
+	delayMicroseconds(5);
+	digitalWrite(sclPin, HIGH);
+	delayMicroseconds(5);
+	digitalWrite(sdaPin, HIGH);
+	delayMicroseconds(5);
+	pinMode(sdaPin, INPUT_PULLUP);
+	pinMode(sclPin, INPUT_PULLUP);
+
+	if (digitalRead(sdaPin) == LOW) {
+		timing.busFailures++;
+		return false;
+	}
+	return true;
+}
+
+void BQ32000RTC::record(BQ32000Timing &t, uint32_t start)
+{
+	uint32_t took = micros() - start;
+	t.calls++;
+	t.totalMicros += took;
+	if (took > t.maxMicros)
+		t.maxMicros = took;
+}
+
 bool BQ32000RTC::exists = false;
+uint8_t BQ32000RTC::sdaPin = D3;
+uint8_t BQ32000RTC::sclPin = D4;
+BQ32000Stats BQ32000RTC::timing;
+bool BQ32000RTC::shadowValid = false;
+uint8_t BQ32000RTC::shadowCalCfg1;
+uint8_t BQ32000RTC::shadowTch2;
+uint8_t BQ32000RTC::shadowCfg2;
+int8_t BQ32000RTC::shadowSfr = -1;
 
 BQ32000RTC RTC = BQ32000RTC();
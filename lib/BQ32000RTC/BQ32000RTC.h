@@ -9,7 +9,13 @@
 #include <TimeLib.h>
 
 #define BQ32000_ADDRESS 0x68
+// The BQ32000 supports I2C fast mode.
+#define BQ32000_I2C_CLOCK 400000
+// Longest time the RTC may stretch the clock, and longest time to wait for
+// SCL to be released during bus recovery, in microseconds.
+#define BQ32000_STRETCH_LIMIT_US 1000
 // BQ32000 register addresses:
+#define BQ32000_SECONDS 0x00
 #define BQ32000_CAL_CFG1 0x07
 #define BQ32000_TCH2 0x08
 #define BQ32000_CFG2 0x09
@@ -20,6 +26,7 @@
 #define BQ32000__OUT 0x07 // CAL_CFG1 - IRQ active state
 #define BQ32000__FT 0x06 // CAL_CFG1 - IRQ square wave enable
 #define BQ32000__CAL_S 0x05 // CAL_CFG1 - Calibration sign
+#define BQ32000__CENT_EN 0x07 // CENT_HOURS - Century enable, set by write()
 #define BQ32000__TCH2_BIT 0x05 // TCH2 - Trickle charger switch 2
 #define BQ32000__TCFE 0x06 // CFG2 - Trickle FET control
 // BQ32000 config values:
@@ -29,6 +36,23 @@
 #define BQ32000_FTF_1HZ 0x01
 #define BQ32000_FTF_512HZ 0x00
 
+// Time taken by the calls to a driver function, in microseconds.
+struct BQ32000Timing {
+	uint32_t calls;
+	uint32_t totalMicros;
+	uint32_t maxMicros;
+};
+
+struct BQ32000Stats {
+	BQ32000Timing get;
+	BQ32000Timing set;
+	BQ32000Timing setIRQ;
+	// Times a device held SDA low and the bus was recovered, and times
+	// that failed.
+	uint32_t busRecoveries;
+	uint32_t busFailures;
+};
+
 class BQ32000RTC {
     public:
 	BQ32000RTC();
@@ -65,12 +89,18 @@ class BQ32000RTC {
 	 * cap's voltage rating!!).
 	 */
 
+	static const BQ32000Stats &stats()
+	{
+		return timing;
+	}
+
 	// utility functions:
 	static uint8_t readRegister(uint8_t address);
 	static void writeRegister(uint8_t address, uint8_t value);
-
-    private:
-	static bool exists;
+	/* Read or write 'count' consecutive registers starting at 'address'
+	 * in a single bus transaction. */
+	static bool readRegisters(uint8_t address, uint8_t *values, uint8_t count);
+	static bool writeRegisters(uint8_t address, const uint8_t *values, uint8_t count);
 	static uint8_t bcd2bin(uint8_t val)
 	{
 		return val - 6 * (val >> 4);
@@ -79,6 +109,22 @@ class BQ32000RTC {
 	{
 		return val + 6 * (val / 10);
 	}
+
+    private:
+	static bool exists;
+	static uint8_t sdaPin, sclPin;
+	static BQ32000Stats timing;
+
+	/* Write-through copies of the configuration registers CAL_CFG1, TCH2
+	 * and CFG2, and of the square wave frequency in SFR, which cannot be
+	 * read back. They are loaded from the chip on first use. */
+	static bool shadowValid;
+	static uint8_t shadowCalCfg1, shadowTch2, shadowCfg2;
+	static int8_t shadowSfr;
+
+	static bool loadShadow();
+	static bool recoverBus();
+	static void record(BQ32000Timing &t, uint32_t start);
 };
 
 #ifdef RTC
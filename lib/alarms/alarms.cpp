@@ -0,0 +1,177 @@
+#include "alarms.h"
+
+using namespace ace_time;
+
+static const char *const DAY_NAMES[7] = { "mon", "tue", "wed", "thu", "fri", "sat", "sun" };
+static const char *const ACTION_NAMES[ALARM_ACTION_COUNT] = { "none", "antipoison", "ntp_sync" };
+
+bool AlarmScheduler::add(const AlarmRule &rule)
+{
+	if (count >= ALARM_MAX)
+		return false;
+	rules[count++] = rule;
+	return true;
+}
+
+bool AlarmScheduler::remove(uint8_t index)
+{
+	if (index >= count)
+		return false;
+	for (uint8_t i = index; i + 1 < count; i++)
+		rules[i] = rules[i + 1];
+	count--;
+	return true;
+}
+
+void AlarmScheduler::schedule(const TimeZone &tz, uint32_t now)
+{
+	zone = tz;
+	for (uint8_t i = 0; i < count; i++) {
+		next[i] = nextAfter(rules[i], tz, now);
+		heap[i] = i;
+	}
+	for (int8_t pos = count / 2 - 1; pos >= 0; pos--)
+		siftDown(pos);
+}
+
+int8_t AlarmScheduler::fire(uint32_t now)
+{
+	uint8_t i = heap[0];
+
+	// Reschedule from now rather than from the missed instant, so a jump
+	// of the clock fires each rule once rather than once per occurrence.
+	next[i] = nextAfter(rules[i], zone, now);
+	siftDown(0);
+	return i;
+}
+
+void AlarmScheduler::siftDown(uint8_t pos)
+{
+	for (;;) {
+		uint8_t smallest = pos, left = 2 * pos + 1, right = 2 * pos + 2;
+		if (left < count && next[heap[left]] < next[heap[smallest]])
+			smallest = left;
+		if (right < count && next[heap[right]] < next[heap[smallest]])
+			smallest = right;
+		if (smallest == pos)
+			return;
+		uint8_t tmp = heap[pos];
+		heap[pos] = heap[smallest];
+		heap[smallest] = tmp;
+		pos = smallest;
+	}
+}
+
+/*
+ * Resolve a local time on a local date to UTC. An ambiguous time resolves to
+ * its first occurrence. A time skipped by a gap resolves to the end of the
+ * gap, found by bisecting between its two possible interpretations.
+ */
+static int64_t resolveLocal(const LocalDate &date, uint8_t hour, uint8_t minute, const TimeZone &tz)
+{
+	ZonedDateTime zdt = ZonedDateTime::forComponents(date.year(), date.month(), date.day(), hour, minute, 0, tz, 0);
+	int64_t t = zdt.toUnixSeconds64();
+	if (zdt.hour() == hour && zdt.minute() == minute)
+		return t;
+
+	int64_t other = ZonedDateTime::forComponents(date.year(), date.month(), date.day(), hour, minute, 0, tz, 1).toUnixSeconds64();
+	int64_t lo = (other < t) ? other : t;
+	int64_t hi = (other < t) ? t : other;
+	int32_t before = ZonedDateTime::forUnixSeconds64(lo, tz).timeOffset().toSeconds();
+	while (hi - lo > 1) {
+		int64_t mid = lo + (hi - lo) / 2;
+		if (ZonedDateTime::forUnixSeconds64(mid, tz).timeOffset().toSeconds() == before)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return hi;
+}
+
+uint32_t AlarmScheduler::nextAfter(const AlarmRule &rule, const TimeZone &tz, uint32_t after)
+{
+	if ((rule.days & ALARM_DAILY) == 0)
+		return ALARM_NEVER;
+
+	ZonedDateTime local = ZonedDateTime::forUnixSeconds64(after, tz);
+	if (local.isError())
+		return ALARM_NEVER;
+	int32_t today = local.localDateTime().localDate().toEpochDays();
+	for (int32_t d = today; d <= today + 7; d++) {
+		LocalDate date = LocalDate::forEpochDays(d);
+		// dayOfWeek() is 1 for Monday to 7 for Sunday.
+		if ((rule.days & (ALARM_MONDAY << (date.dayOfWeek() - 1))) == 0)
+			continue;
+		int64_t t = resolveLocal(date, rule.hour, rule.minute, tz);
+		if (t > after)
+			return (t < ALARM_NEVER) ? t : ALARM_NEVER;
+	}
+	return ALARM_NEVER;
+}
+
+bool alarmParseDays(const char *s, uint8_t &days)
+{
+	if (strcmp(s, "daily") == 0) {
+		days = ALARM_DAILY;
+		return true;
+	} else if (strcmp(s, "weekdays") == 0) {
+		days = ALARM_WEEKDAYS;
+		return true;
+	} else if (strcmp(s, "weekends") == 0) {
+		days = ALARM_WEEKENDS;
+		return true;
+	}
+
+	days = 0;
+	while (*s) {
+		uint8_t d;
+		for (d = 0; d < 7; d++) {
+			if (strncmp(s, DAY_NAMES[d], 3) == 0)
+				break;
+		}
+		if (d == 7 || (s[3] != ',' && s[3] != '\0'))
+			return false;
+		days |= ALARM_MONDAY << d;
+		s += (s[3] == ',') ? 4 : 3;
+	}
+	return days != 0;
+}
+
+void alarmFormatDays(uint8_t days, char *buf, size_t size)
+{
+	size_t len = 0;
+
+	days &= ALARM_DAILY;
+	if (days == ALARM_DAILY) {
+		strlcpy(buf, "daily", size);
+		return;
+	} else if (days == ALARM_WEEKDAYS) {
+		strlcpy(buf, "weekdays", size);
+		return;
+	} else if (days == ALARM_WEEKENDS) {
+		strlcpy(buf, "weekends", size);
+		return;
+	}
+
+	buf[0] = '\0';
+	for (uint8_t d = 0; d < 7; d++) {
+		if (days & (ALARM_MONDAY << d))
+			len += snprintf(buf + len, size - len, "%s%s", len ? "," : "", DAY_NAMES[d]);
+		if (len >= size)
+			return;
+	}
+}
+
+const char *alarmActionName(uint8_t action)
+{
+	return (action < ALARM_ACTION_COUNT) ? ACTION_NAMES[action] : ACTION_NAMES[ALARM_ACTION_NONE];
+}
+
+uint8_t alarmParseAction(const char *s)
+{
+	for (uint8_t a = ALARM_ACTION_NONE + 1; a < ALARM_ACTION_COUNT; a++) {
+		if (strcmp(s, ACTION_NAMES[a]) == 0)
+			return a;
+	}
+	return ALARM_ACTION_NONE;
+}
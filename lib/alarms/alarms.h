@@ -0,0 +1,103 @@
+/*
+ * alarms.h - scheduler for recurring local-time events
+ *
+ * A rule fires at a local time of day on a set of weekdays, in the
+ * configured time zone. The next firing instant of every rule is kept in
+ * UTC in a min-heap, so checking whether anything is due is a single
+ * comparison, and only the rule that fired is rescheduled.
+ *
+ * DST transitions are handled as follows: a local time that is skipped by
+ * a gap fires once, at the end of the gap, and a local time that is
+ * repeated by an overlap fires once, at its first occurrence.
+ */
+
+#ifndef _ALARMS_h
+#define _ALARMS_h
+
+#include <Arduino.h>
+#include <AceTime.h>
+
+#define ALARM_MAX 8
+#define ALARM_NEVER UINT32_MAX
+
+// Weekday bits of AlarmRule::days, Monday first.
+#define ALARM_MONDAY 0b0000001
+#define ALARM_SUNDAY 0b1000000
+#define ALARM_WEEKDAYS 0b0011111
+#define ALARM_WEEKENDS 0b1100000
+#define ALARM_DAILY 0b1111111
+
+enum AlarmAction : uint8_t {
+	ALARM_ACTION_NONE,
+	ALARM_ACTION_ANTIPOISON,
+	ALARM_ACTION_NTP_SYNC,
+	ALARM_ACTION_COUNT,
+};
+
+struct AlarmRule {
+	uint8_t hour;
+	uint8_t minute;
+	uint8_t days; // ALARM_MONDAY << n for each day; 0 disables the rule
+	uint8_t action;
+};
+
+class AlarmScheduler {
+	AlarmRule rules[ALARM_MAX];
+	uint8_t count = 0;
+	// Next firing instant of each rule, in Unix seconds.
+	uint32_t next[ALARM_MAX];
+	// Rule indexes, ordered as a min-heap on next[].
+	uint8_t heap[ALARM_MAX];
+	ace_time::TimeZone zone;
+
+    public:
+	// Add or remove a rule. Call schedule() afterwards.
+	bool add(const AlarmRule &rule);
+	bool remove(uint8_t index);
+
+	uint8_t size() const
+	{
+		return count;
+	}
+	const AlarmRule &rule(uint8_t index) const
+	{
+		return rules[index];
+	}
+	uint32_t nextFiring(uint8_t index) const
+	{
+		return next[index];
+	}
+
+	// Compute the next firing of every rule after 'now'. Call whenever the
+	// rules, the time zone or the clock change.
+	void schedule(const ace_time::TimeZone &tz, uint32_t now);
+
+	// If a rule is due at 'now', reschedule it and return its index, or
+	// return -1. Rules due at the same time are returned by successive
+	// calls.
+	int8_t poll(uint32_t now)
+	{
+		if (count == 0 || next[heap[0]] > now)
+			return -1;
+		return fire(now);
+	}
+
+	// The first instant after 'after' at which 'rule' fires in 'tz'.
+	static uint32_t nextAfter(const AlarmRule &rule, const ace_time::TimeZone &tz, uint32_t after);
+
+    private:
+	int8_t fire(uint32_t now);
+	void siftDown(uint8_t pos);
+};
+
+// Parse "daily", "weekdays", "weekends" or a comma separated list of day
+// names such as "mon,wed,fri" into AlarmRule::days.
+bool alarmParseDays(const char *s, uint8_t &days);
+// Format AlarmRule::days the way alarmParseDays() accepts it.
+void alarmFormatDays(uint8_t days, char *buf, size_t size);
+
+const char *alarmActionName(uint8_t action);
+// Returns ALARM_ACTION_NONE for an unknown name.
+uint8_t alarmParseAction(const char *s);
+
+#endif // _ALARMS_h
@@ -0,0 +1,69 @@
+#include "alloccount.h"
+
+#ifdef ALLOC_TRACKING
+
+#include <stddef.h>
+
+AllocCount allocCount;
+static uint32_t allocsAtLoopStart;
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+	allocCount.allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	allocCount.allocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	if (size != 0)
+		allocCount.allocs++;
+	else if (ptr != NULL)
+		allocCount.frees++;
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+	if (ptr != NULL)
+		allocCount.frees++;
+	__real_free(ptr);
+}
+}
+
+void allocCountReset()
+{
+	allocCount.allocs = 0;
+	allocCount.frees = 0;
+	allocCount.loops = 0;
+	allocCount.loopsAllocating = 0;
+	allocCount.maxPerLoop = 0;
+	allocsAtLoopStart = 0;
+}
+
+void allocCountLoop()
+{
+	uint32_t allocs = allocCount.allocs;
+	uint32_t n = allocs - allocsAtLoopStart;
+
+	allocsAtLoopStart = allocs;
+	allocCount.loops++;
+	if (n != 0) {
+		allocCount.loopsAllocating++;
+		if (n > allocCount.maxPerLoop)
+			allocCount.maxPerLoop = n;
+	}
+}
+
+#endif // ALLOC_TRACKING
@@ -0,0 +1,41 @@
+/*
+ * alloccount.h - heap allocation counter
+ *
+ * When built with ALLOC_TRACKING defined and the linker flags
+ * "-Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free",
+ * every heap allocation made by the firmware and the Arduino core is
+ * counted, so that allocations in the steady-state main loop can be found.
+ * Without ALLOC_TRACKING the hooks compile to nothing.
+ */
+
+#ifndef _ALLOCCOUNT_h
+#define _ALLOCCOUNT_h
+
+#include <stdint.h>
+
+struct AllocCount {
+	volatile uint32_t allocs; // malloc(), calloc() and realloc() calls
+	volatile uint32_t frees; // free() calls with a non-NULL pointer
+	uint32_t loops; // loop() passes since allocCountReset()
+	uint32_t loopsAllocating; // loop() passes that allocated at least once
+	uint32_t maxPerLoop; // most allocations made by a single loop() pass
+};
+
+#ifdef ALLOC_TRACKING
+extern AllocCount allocCount;
+
+// Zero the counters, e.g. once the boot sequence has finished.
+void allocCountReset();
+
+// Call at the top of loop() to attribute allocations to loop() passes.
+void allocCountLoop();
+#else
+static inline void allocCountReset()
+{
+}
+static inline void allocCountLoop()
+{
+}
+#endif // ALLOC_TRACKING
+
+#endif // _ALLOCCOUNT_h
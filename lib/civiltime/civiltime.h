@@ -0,0 +1,184 @@
+/*
+ * civiltime.h - decomposition of local Unix time into display fields
+ *
+ * CivilClock converts a local time_t into the year, month, day, hour,
+ * minute and second in a single pass, with Howard Hinnant's days-from-civil
+ * algorithm, which needs no loops over years or months. The result is
+ * kept, and further calls within the same minute only update the seconds,
+ * so the display can ask for the fields it needs as often as it likes.
+ *
+ * formatIso8601() formats a time as an ISO 8601 line from a precomputed UTC
+ * offset, without allocating and without a time zone lookup.
+ */
+
+#ifndef _CIVILTIME_h
+#define _CIVILTIME_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+// Longest line written by formatIso8601(), excluding the zone name but
+// including the terminating NUL.
+#define ISO8601_MAX 60
+
+struct CivilTime {
+	int16_t year;
+	uint8_t month; // 1-12
+	uint8_t day; // 1-31
+	uint8_t weekday; // 1-7, Sunday first, as in TimeLib
+	uint8_t hour; // 0-23
+	uint8_t hour12; // 1-12
+	uint8_t minute;
+	uint8_t second;
+};
+
+/*
+ * Store the civil date of the day 'days' days after 1970-01-01 into 'ct'.
+ * Valid for any date in the proleptic Gregorian calendar that fits in
+ * CivilTime.
+ */
+static inline void civilFromDays(int32_t days, CivilTime &ct)
+{
+	// Count from 0000-03-01, so that the leap day ends each 400-year era.
+	int32_t z = days + 719468;
+	int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+	uint32_t doe = z - era * 146097; // [0, 146096]
+	uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // [0, 399]
+	uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100); // [0, 365]
+	uint32_t mp = (5 * doy + 2) / 153; // [0, 11], March first
+	ct.day = doy - (153 * mp + 2) / 5 + 1;
+	ct.month = mp < 10 ? mp + 3 : mp - 9;
+	ct.year = yoe + era * 400 + (ct.month <= 2);
+	// 1970-01-01 was a Thursday.
+	ct.weekday = (days % 7 + 11) % 7 + 1;
+}
+
+class CivilClock {
+	// Local time of the start of the minute held in 'ct'.
+	time_t minuteStart = 0;
+	bool valid = false;
+	CivilTime ct;
+
+    public:
+	// Decompose the local time 'local'.
+	const CivilTime &at(time_t local)
+	{
+		time_t into = local - minuteStart;
+		if (valid && into >= 0 && into < 60) {
+			ct.second = into;
+			return ct;
+		}
+
+		int64_t t = local;
+		int32_t days = t >= 0 ? t / 86400 : (t - 86399) / 86400;
+		uint32_t secs = t - (int64_t)days * 86400;
+		civilFromDays(days, ct);
+		ct.hour = secs / 3600;
+		ct.hour12 = ct.hour % 12 ? ct.hour % 12 : 12;
+		ct.minute = secs / 60 % 60;
+		ct.second = secs % 60;
+		minuteStart = local - ct.second;
+		valid = true;
+		return ct;
+	}
+};
+
+static inline char *civilPut2(char *p, uint8_t v)
+{
+	p[0] = '0' + v / 10;
+	p[1] = '0' + v % 10;
+	return p + 2;
+}
+
+// Append 'n' bytes of 's' to 'buf', which holds 'len' bytes, as far as they
+// fit before the terminating NUL.
+static inline void civilAppend(char *buf, size_t size, size_t &len, const char *s, size_t n)
+{
+	if (n > size - 1 - len)
+		n = size - 1 - len;
+	memcpy(buf + len, s, n);
+	len += n;
+}
+
+/*
+ * Write "YYYY-MM-DDThh:mm:ss.mmm+hh:mm[zone] @ unix.mmm" for the UTC time
+ * 'utc' and 'millis' milliseconds into 'buf', where 'offset' is the UTC
+ * offset in seconds and 'zone' the name of the time zone. The fractions are
+ * left out if 'millis' is negative. The result is truncated to fit 'size'
+ * and always terminated; its length is returned.
+ */
+static inline size_t formatIso8601(char *buf, size_t size, time_t utc, int16_t millis, int32_t offset, const char *zone)
+{
+	// Scratch space for the parts before and after the zone name.
+	char line[32];
+	char *p = line;
+	CivilTime ct;
+
+	if (size == 0)
+		return 0;
+
+	int64_t t = (int64_t)utc + offset;
+	int32_t days = t >= 0 ? t / 86400 : (t - 86399) / 86400;
+	uint32_t secs = t - (int64_t)days * 86400;
+	civilFromDays(days, ct);
+
+	uint16_t y = ct.year < 0 ? 0 : ct.year > 9999 ? 9999 : ct.year;
+	p = civilPut2(p, y / 100);
+	p = civilPut2(p, y % 100);
+	*p++ = '-';
+	p = civilPut2(p, ct.month);
+	*p++ = '-';
+	p = civilPut2(p, ct.day);
+	*p++ = 'T';
+	p = civilPut2(p, secs / 3600);
+	*p++ = ':';
+	p = civilPut2(p, secs / 60 % 60);
+	*p++ = ':';
+	p = civilPut2(p, secs % 60);
+	if (millis >= 0) {
+		*p++ = '.';
+		*p++ = '0' + millis / 100;
+		p = civilPut2(p, millis % 100);
+	}
+	uint32_t off = offset < 0 ? -offset : offset;
+	*p++ = offset < 0 ? '-' : '+';
+	p = civilPut2(p, off / 3600);
+	*p++ = ':';
+	p = civilPut2(p, off / 60 % 60);
+
+	size_t len = 0;
+	civilAppend(buf, size, len, line, p - line);
+	civilAppend(buf, size, len, "[", 1);
+	civilAppend(buf, size, len, zone, strlen(zone));
+
+	// Unix seconds, written backwards into a scratch buffer.
+	char digits[20];
+	uint8_t n = 0;
+	uint64_t u = utc < 0 ? -(int64_t)utc : utc;
+	do {
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u);
+
+	p = line;
+	*p++ = ']';
+	*p++ = ' ';
+	*p++ = '@';
+	*p++ = ' ';
+	if (utc < 0)
+		*p++ = '-';
+	while (n > 0)
+		*p++ = digits[--n];
+	if (millis >= 0) {
+		*p++ = '.';
+		*p++ = '0' + millis / 100;
+		p = civilPut2(p, millis % 100);
+	}
+	civilAppend(buf, size, len, line, p - line);
+	buf[len] = '\0';
+	return len;
+}
+
+#endif // _CIVILTIME_h
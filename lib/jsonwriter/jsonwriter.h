@@ -0,0 +1,187 @@
+/*
+ * jsonwriter.h - JSON serialiser into a fixed buffer
+ *
+ * Writes a JSON document front to back into a caller-supplied buffer in a
+ * single pass, taking care of separators and string escaping. Nothing is
+ * allocated; if the document does not fit, the writer stops and reports the
+ * overflow instead of emitting truncated JSON.
+ */
+
+#ifndef _JSONWRITER_h
+#define _JSONWRITER_h
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define JSON_MAX_DEPTH 8
+
+class JsonWriter {
+	char *buf;
+	size_t size;
+	size_t len = 0;
+	bool overflow = false;
+	// Whether the next value in the object or array at each depth needs a
+	// comma in front of it.
+	bool more[JSON_MAX_DEPTH] = {};
+	uint8_t depth = 0;
+
+    public:
+	JsonWriter(char *buf, size_t size)
+		: buf(buf)
+		, size(size)
+	{
+		buf[0] = '\0';
+	}
+
+	void beginObject(const char *key = nullptr)
+	{
+		open(key, '{');
+	}
+	void endObject()
+	{
+		close('}');
+	}
+	void beginArray(const char *key = nullptr)
+	{
+		open(key, '[');
+	}
+	void endArray()
+	{
+		close(']');
+	}
+
+	void add(const char *key, const char *s)
+	{
+		name(key);
+		string(s);
+	}
+	void add(const char *key, bool b)
+	{
+		name(key);
+		putString(b ? "true" : "false");
+	}
+	void add(const char *key, int32_t n)
+	{
+		name(key);
+		print("%ld", (long)n);
+	}
+	void add(const char *key, uint32_t n)
+	{
+		name(key);
+		print("%lu", (unsigned long)n);
+	}
+	void add(const char *key, int64_t n)
+	{
+		name(key);
+		print("%lld", (long long)n);
+	}
+	void add(const char *key, uint64_t n)
+	{
+		name(key);
+		print("%llu", (unsigned long long)n);
+	}
+	void addNull(const char *key)
+	{
+		name(key);
+		putString("null");
+	}
+
+	// The document so far, always NUL-terminated.
+	const char *c_str() const
+	{
+		return buf;
+	}
+	size_t length() const
+	{
+		return len;
+	}
+	// Whether everything written so far fit in the buffer.
+	bool ok() const
+	{
+		return !overflow;
+	}
+
+    private:
+	void open(const char *key, char c)
+	{
+		name(key);
+		putChar(c);
+		if (depth < JSON_MAX_DEPTH - 1)
+			more[++depth] = false;
+		else
+			overflow = true;
+	}
+
+	void close(char c)
+	{
+		if (depth > 0)
+			depth--;
+		putChar(c);
+	}
+
+	// Start a value, writing the comma before it and its key, if it is
+	// a member of an object.
+	void name(const char *key)
+	{
+		if (more[depth])
+			putChar(',');
+		more[depth] = true;
+		if (key) {
+			string(key);
+			putChar(':');
+		}
+	}
+
+	void string(const char *s)
+	{
+		putChar('"');
+		for (; *s; s++) {
+			unsigned char c = *s;
+			if (c == '"' || c == '\\') {
+				putChar('\\');
+				putChar(c);
+			} else if (c < 0x20) {
+				print("\\u%04x", c);
+			} else {
+				putChar(c);
+			}
+		}
+		putChar('"');
+	}
+
+	void putChar(char c)
+	{
+		if (overflow || len + 1 >= size) {
+			overflow = true;
+			return;
+		}
+		buf[len++] = c;
+		buf[len] = '\0';
+	}
+
+	void putString(const char *s)
+	{
+		while (*s)
+			putChar(*s++);
+	}
+
+	void print(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+	{
+		va_list ap;
+		if (overflow)
+			return;
+		va_start(ap, fmt);
+		int n = vsnprintf(buf + len, size - len, fmt, ap);
+		va_end(ap);
+		if (n < 0 || (size_t)n >= size - len) {
+			buf[len] = '\0';
+			overflow = true;
+			return;
+		}
+		len += n;
+	}
+};
+
+#endif // _JSONWRITER_h
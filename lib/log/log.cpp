@@ -0,0 +1,134 @@
+#include "log.h"
+
+static_assert((LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1)) == 0, "LOG_BUFFER_SIZE must be a power of two");
+
+void Logger::printf_P(PGM_P fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vprintf_P(fmt, ap);
+	va_end(ap);
+}
+
+void Logger::vprintf_P(PGM_P fmt, va_list ap)
+{
+	char line[LOG_LINE_MAX];
+	int len;
+
+	// Leave room for the line ending. Overlong messages are truncated.
+	len = vsnprintf_P(line, sizeof(line) - 2, fmt, ap);
+	if (len < 0)
+		return;
+	if ((size_t)len > sizeof(line) - 3)
+		len = sizeof(line) - 3;
+	line[len++] = '\r';
+	line[len++] = '\n';
+
+	if ((size_t)len > space()) {
+		droppedCount++;
+		return;
+	}
+	append(line, len);
+}
+
+void Logger::append(const char *s, size_t len)
+{
+	size_t off = head & (LOG_BUFFER_SIZE - 1);
+	size_t n = LOG_BUFFER_SIZE - off;
+
+	if (n > len)
+		n = len;
+	memcpy(buf + off, s, n);
+	memcpy(buf, s + n, len - n);
+	head += len;
+	if (filled < LOG_BUFFER_SIZE)
+		filled = (filled + len < LOG_BUFFER_SIZE) ? filled + len : LOG_BUFFER_SIZE;
+}
+
+void Logger::drain()
+{
+	send();
+}
+
+void Logger::send()
+{
+	// Report dropped messages once the backlog that caused them has cleared.
+	if (head == tail && droppedReported != droppedCount) {
+		char line[48];
+		int len = snprintf_P(line, sizeof(line), PSTR("[Log] %u messages dropped.\r\n"), (unsigned)(droppedCount - droppedReported));
+		droppedReported = droppedCount;
+		append(line, len);
+	}
+
+	while (head != tail) {
+		size_t avail = Serial.availableForWrite();
+		if (avail == 0)
+			break;
+
+		size_t off = tail & (LOG_BUFFER_SIZE - 1);
+		size_t n = head - tail;
+		if (n > LOG_BUFFER_SIZE - off)
+			n = LOG_BUFFER_SIZE - off;
+		if (n > avail)
+			n = avail;
+		if (held) {
+			// Finish the line being sent, and stop at its end.
+			if (!midLine)
+				break;
+			const char *end = (const char *)memchr(buf + off, '\n', n);
+			if (end)
+				n = end - (buf + off) + 1;
+		}
+		Serial.write((const uint8_t *)buf + off, n);
+		tail += n;
+		midLine = buf[off + n - 1] != '\n';
+	}
+}
+
+void Logger::flush()
+{
+	bool wasHeld = held;
+
+	held = false;
+	while (head != tail) {
+		send();
+		yield();
+	}
+	held = wasHeld;
+	Serial.flush();
+}
+
+void Logger::printHistory(unsigned int lines)
+{
+	uint32_t n = 0;
+
+	flush();
+	if (lines == 0)
+		return;
+
+	// Walk backwards from the newest byte counting line endings. The byte
+	// at head - 1 is always the end of the newest message.
+	while (n < filled) {
+		if (n != 0 && buf[(head - n - 1) & (LOG_BUFFER_SIZE - 1)] == '\n' && --lines == 0)
+			break;
+		n++;
+	}
+	// If the oldest retained message was partially overwritten, skip it.
+	if (n == LOG_BUFFER_SIZE) {
+		while (n > 0 && buf[(head - n) & (LOG_BUFFER_SIZE - 1)] != '\n')
+			n--;
+		if (n > 0)
+			n--;
+	}
+
+	for (uint32_t start = head - n; start != head;) {
+		size_t off = start & (LOG_BUFFER_SIZE - 1);
+		size_t len = head - start;
+		if (len > LOG_BUFFER_SIZE - off)
+			len = LOG_BUFFER_SIZE - off;
+		Serial.write((const uint8_t *)buf + off, len);
+		start += len;
+	}
+}
+
+Logger Log;
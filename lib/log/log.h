@@ -0,0 +1,162 @@
+/*
+ * log.h - ring-buffered asynchronous logger
+ *
+ * Messages are formatted into a fixed RAM ring buffer and copied to the
+ * UART by drain() only as space in the UART transmit FIFO frees up, so
+ * logging never blocks the main loop. Each subsystem has its own
+ * compile-time log level, and messages below that level compile to
+ * nothing.
+ */
+
+#ifndef _LOG_h
+#define _LOG_h
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Per-subsystem log levels. These can be overridden with build flags, e.g.
+// "-D LOG_LEVEL_DISPLAY=LOG_LEVEL_DEBUG".
+#ifndef LOG_LEVEL_ALARM
+#define LOG_LEVEL_ALARM LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_CONSOLE
+#define LOG_LEVEL_CONSOLE LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_DISPLAY
+#define LOG_LEVEL_DISPLAY LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_EEPROM
+#define LOG_LEVEL_EEPROM LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_ESP
+#define LOG_LEVEL_ESP LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_NTP
+#define LOG_LEVEL_NTP LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_OTA
+#define LOG_LEVEL_OTA LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_SYSTEM
+#define LOG_LEVEL_SYSTEM LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_TIME
+#define LOG_LEVEL_TIME LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_WIFI
+#define LOG_LEVEL_WIFI LOG_LEVEL_INFO
+#endif
+
+// Size of the ring buffer in bytes. Must be a power of two.
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 2048
+#endif
+
+// Longest single message, including the trailing "\r\n".
+#define LOG_LINE_MAX 256
+
+#define LOG_ENABLED(level, subsys) (LOG_LEVEL_##subsys >= LOG_LEVEL_##level)
+
+// The format string is placed in flash. When the level is disabled for the
+// subsystem the branch is constant-false, so neither the call nor the format
+// string make it into the image.
+#define LOG(level, subsys, fmt, ...)                                   \
+	do {                                                           \
+		if (LOG_ENABLED(level, subsys))                        \
+			Log.printf_P(PSTR(fmt), ##__VA_ARGS__);        \
+	} while (0)
+
+#define LOG_ERROR(subsys, fmt, ...) LOG(ERROR, subsys, fmt, ##__VA_ARGS__)
+#define LOG_WARN(subsys, fmt, ...) LOG(WARN, subsys, fmt, ##__VA_ARGS__)
+#define LOG_INFO(subsys, fmt, ...) LOG(INFO, subsys, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(subsys, fmt, ...) LOG(DEBUG, subsys, fmt, ##__VA_ARGS__)
+
+class Logger {
+	char buf[LOG_BUFFER_SIZE];
+	// Free-running byte counters. head is the total number of bytes ever
+	// written into the ring, tail the total number ever sent to the UART.
+	uint32_t head = 0;
+	uint32_t tail = 0;
+	// Number of bytes of history retained in the ring, up to its size.
+	uint32_t filled = 0;
+	uint32_t droppedCount = 0;
+	uint32_t droppedReported = 0;
+	bool held = false;
+	// Whether the last byte sent was not the end of a line.
+	bool midLine = false;
+
+    public:
+	// Format a message and append it to the ring buffer, followed by a
+	// line ending. The message is dropped if the buffer is full.
+	void printf_P(PGM_P fmt, ...) __attribute__((format(printf, 2, 3)));
+	void vprintf_P(PGM_P fmt, va_list ap);
+
+	// Copy as much pending output to the UART as fits in its transmit
+	// FIFO without blocking. Call once per loop() pass.
+	void drain();
+
+	// Block until all pending output has been written to the UART. This
+	// ignores hold().
+	void flush();
+
+	// While held, drain() only finishes the line it was sending and then
+	// sends nothing, so that the UART is left idle for time-critical
+	// output without cutting a message in two. Messages are still
+	// buffered.
+	void hold(bool on)
+	{
+		held = on;
+	}
+
+	// Write the last 'lines' messages retained in the ring buffer to the
+	// UART. This blocks, and is meant for the interactive 'log' command.
+	void printHistory(unsigned int lines);
+
+	// Total number of messages dropped because the ring buffer was full.
+	uint32_t dropped() const
+	{
+		return droppedCount;
+	}
+
+    private:
+	void send();
+	void append(const char *s, size_t len);
+	size_t space() const
+	{
+		return LOG_BUFFER_SIZE - (head - tail);
+	}
+};
+
+/*
+ * A Print sink that writes into a fixed-size buffer. This allows objects that
+ * only know how to printTo() a Print to be formatted into a log message
+ * without allocating.
+ */
+template <size_t N> class PrintBuffer : public Print {
+	char buf[N];
+	size_t len = 0;
+
+    public:
+	size_t write(uint8_t c) override
+	{
+		if (len + 1 >= N)
+			return 0;
+		buf[len++] = c;
+		return 1;
+	}
+	const char *c_str()
+	{
+		buf[len] = '\0';
+		return buf;
+	}
+};
+
+extern Logger Log;
+
+#endif // _LOG_h
@@ -0,0 +1,98 @@
+/*
+ * latency.h - fixed-size latency histogram
+ *
+ * Records durations in microseconds into log-linear buckets: four buckets
+ * per power of two, so any percentile is found to within 25% using a few
+ * hundred bytes and no allocation, however many samples are recorded.
+ */
+
+#ifndef _LATENCY_h
+#define _LATENCY_h
+
+#include <stdint.h>
+#include <string.h>
+
+// Sub-buckets per power of two, as a power of two.
+#define LATENCY_SUB_BITS 2
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+// Durations up to 2^LATENCY_MAX_BITS us are told apart; longer ones share
+// the last bucket.
+#define LATENCY_MAX_BITS 24
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+class LatencyHistogram {
+	uint32_t buckets[LATENCY_BUCKETS];
+	uint32_t samples;
+	uint32_t longest;
+
+	static uint8_t bucketOf(uint32_t us)
+	{
+		if (us < LATENCY_SUB_BUCKETS)
+			return us;
+		uint8_t bits = 31 - __builtin_clz(us);
+		if (bits >= LATENCY_MAX_BITS)
+			return LATENCY_BUCKETS - 1;
+		return (bits - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + ((us >> (bits - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+	}
+
+	// The longest duration that falls into bucket 'b'.
+	static uint32_t bucketLimit(uint8_t b)
+	{
+		if (b < LATENCY_SUB_BUCKETS)
+			return b;
+		uint8_t bits = b / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+		uint32_t sub = b % LATENCY_SUB_BUCKETS;
+		return ((LATENCY_SUB_BUCKETS + sub + 1) << (bits - LATENCY_SUB_BITS)) - 1;
+	}
+
+    public:
+	LatencyHistogram()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		memset(buckets, 0, sizeof(buckets));
+		samples = 0;
+		longest = 0;
+	}
+
+	void record(uint32_t us)
+	{
+		buckets[bucketOf(us)]++;
+		samples++;
+		if (us > longest)
+			longest = us;
+	}
+
+	uint32_t count() const
+	{
+		return samples;
+	}
+
+	uint32_t max() const
+	{
+		return longest;
+	}
+
+	// The duration that 'percent' percent of the samples did not exceed,
+	// rounded up to the end of its bucket.
+	uint32_t percentile(uint8_t percent) const
+	{
+		if (samples == 0)
+			return 0;
+		uint32_t rank = ((uint64_t)samples * percent + 99) / 100;
+		uint32_t seen = 0;
+		for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+			seen += buckets[b];
+			if (seen >= rank && seen != 0) {
+				uint32_t limit = bucketLimit(b);
+				return limit < longest ? limit : longest;
+			}
+		}
+		return longest;
+	}
+};
+
+#endif // _LATENCY_h
@@ -0,0 +1,97 @@
+#include "metrics.h"
+#include "log.h"
+
+bool MetricsClient::begin(const char *address)
+{
+	char ip[16];
+	unsigned int p;
+	IPAddress addr;
+
+	end();
+	if (sscanf(address, "%15[0-9.]:%u", ip, &p) != 2 || p == 0 || p > 65535 || !addr.fromString(ip)) {
+		LOG_ERROR(SYSTEM, "[Metrics] Invalid collector address: %s", address);
+		return false;
+	}
+	pcb = udp_new();
+	if (!pcb) {
+		LOG_ERROR(SYSTEM, "[Metrics] Unable to allocate a UDP control block.");
+		return false;
+	}
+	ip_addr_set_ip4_u32(&host, (uint32_t)addr);
+	port = p;
+	LOG_INFO(SYSTEM, "[Metrics] Sending metrics to %s:%u.", ip, port);
+	return true;
+}
+
+void MetricsClient::end()
+{
+	if (!pcb)
+		return;
+	udp_remove(pcb);
+	pcb = nullptr;
+}
+
+void MetricsClient::append(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (overflow)
+		return;
+	va_start(ap, fmt);
+	n = vsnprintf(buf + len, sizeof(buf) - len, fmt, ap);
+	va_end(ap);
+	if (n < 0 || (size_t)n >= sizeof(buf) - len) {
+		overflow = true;
+		return;
+	}
+	len += n;
+}
+
+void MetricsClient::start(const char *measurement, const char *tags)
+{
+	len = 0;
+	overflow = false;
+	separator = ' ';
+	append("%s,%s", measurement, tags);
+}
+
+void MetricsClient::field(const char *name, int64_t value)
+{
+	append("%c%s=%lldi", separator, name, (long long)value);
+	separator = ',';
+}
+
+bool MetricsClient::send(uint64_t timestamp)
+{
+	// A line needs at least one field.
+	if (!pcb || separator == ' ') {
+		failedCount++;
+		return false;
+	}
+	if (timestamp)
+		append(" %llu", (unsigned long long)timestamp);
+	append("\n");
+	if (overflow) {
+		LOG_WARN(SYSTEM, "[Metrics] Report does not fit in %u bytes.", METRICS_PACKET_MAX);
+		failedCount++;
+		return false;
+	}
+
+	// lwIP needs the datagram in a pbuf of its own, with room for the
+	// headers in front of it.
+	struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+	if (!p) {
+		failedCount++;
+		return false;
+	}
+	pbuf_take(p, buf, len);
+	err_t err = udp_sendto(pcb, p, &host, port);
+	pbuf_free(p);
+	if (err != ERR_OK) {
+		failedCount++;
+		return false;
+	}
+	sentCount++;
+	return true;
+}
@@ -0,0 +1,61 @@
+/*
+ * metrics.h - metrics push in InfluxDB line protocol over UDP
+ *
+ * A report is one line of InfluxDB line protocol, formatted field by field
+ * into a buffer that is allocated once, and sent to the collector as a
+ * single UDP datagram. Sending only queues the datagram with lwIP, so it
+ * never waits on the network.
+ */
+
+#ifndef _METRICS_h
+#define _METRICS_h
+
+#include <Arduino.h>
+#include <lwip/pbuf.h>
+#include <lwip/udp.h>
+
+// Largest report, which must fit in a single unfragmented datagram.
+#define METRICS_PACKET_MAX 512
+
+class MetricsClient {
+	struct udp_pcb *pcb = nullptr;
+	ip_addr_t host;
+	uint16_t port = 0;
+	char buf[METRICS_PACKET_MAX];
+	size_t len = 0;
+	bool overflow = false;
+	char separator = ' ';
+	uint32_t sentCount = 0;
+	uint32_t failedCount = 0;
+
+    public:
+	// Send reports to 'address', an IPv4 address and port such as
+	// "192.168.1.10:8094". Return false if it cannot be parsed.
+	bool begin(const char *address);
+	void end();
+	bool running() const
+	{
+		return pcb != nullptr;
+	}
+
+	// Start a report of 'measurement', tagged with 'tags', e.g.
+	// "host=nixietap-1a2b3c". The names must already be escaped.
+	void start(const char *measurement, const char *tags);
+	void field(const char *name, int64_t value);
+	// Send the report, with a timestamp in nanoseconds, or none if zero.
+	bool send(uint64_t timestamp = 0);
+
+	uint32_t sent() const
+	{
+		return sentCount;
+	}
+	uint32_t failed() const
+	{
+		return failedCount;
+	}
+
+    private:
+	void append(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+#endif // _METRICS_h
@@ -0,0 +1,37 @@
+/*
+ * crossfade.h - duty-cycle schedule for crossfading between two frames
+ *
+ * Nixie tubes cannot be dimmed through the shift registers, so a crossfade
+ * is done by time-multiplexing the old and the new frame. Every PWM period
+ * of 'period' ticks starts with the new frame and switches to the old one
+ * part way through; the new frame's share of the period rises linearly from
+ * nothing to the whole period over the 'length' ticks of the fade.
+ */
+
+#ifndef _CROSSFADE_h
+#define _CROSSFADE_h
+
+#include <stdint.h>
+
+// Refresh period of the timer driven display.
+#define DISPLAY_TICK_US 200
+// The timer driver's crossfade: length of one PWM period in ticks, and the
+// length of the whole fade.
+#define CROSSFADE_PERIOD_TICKS 20
+#define CROSSFADE_MS 400
+#define CROSSFADE_TICKS (CROSSFADE_MS * 1000 / DISPLAY_TICK_US)
+
+/*
+ * Return whether tick 'tick' of a crossfade lasting 'length' ticks shows the
+ * new frame. Ticks at or past the end of the fade always do. This is called
+ * from the display timer interrupt, so it must stay inline.
+ */
+static inline __attribute__((always_inline)) bool crossfadeShowsNew(uint16_t tick, uint16_t length, uint8_t period)
+{
+	if (tick >= length)
+		return true;
+	uint8_t duty = (uint32_t)tick * period / length;
+	return tick % period < duty;
+}
+
+#endif // _CROSSFADE_h
@@ -0,0 +1,50 @@
+/*
+ * frame.h - encoding of the tubes' digits into the drivers' frame
+ *
+ * The ten cathodes of each of the four tubes are driven by a chain of shift
+ * registers, 40 bits sent as five bytes starting with the leftmost tube,
+ * followed by a byte for the dots. A cathode is lit by a 0 bit.
+ */
+
+#ifndef _FRAME_h
+#define _FRAME_h
+
+#include <stdint.h>
+
+#define NIXIE_TUBES 4
+// Bytes shifted out to the tube drivers for one frame.
+#define NIXIE_FRAME_BYTES 6
+
+// The cathode bit of each digit within a tube's ten bits, and no bit for an
+// unlit tube.
+static const uint16_t NIXIE_PINMAP[11] = {
+	0b0000010000, // 0
+	0b0000100000, // 1
+	0b0001000000, // 2
+	0b0010000000, // 3
+	0b0100000000, // 4
+	0b1000000000, // 5
+	0b0000000001, // 6
+	0b0000000010, // 7
+	0b0000000100, // 8
+	0b0000001000, // 9
+	0b0000000000 // digit off
+};
+
+/*
+ * Encode the digits of the four tubes, 0-9 or 10 for off, and the dots into
+ * the frame shifted out to the drivers.
+ */
+static inline void nixieEncodeFrame(const uint8_t digits[NIXIE_TUBES], uint8_t dots, uint8_t frame[NIXIE_FRAME_BYTES])
+{
+	// Display has 4 x 10 positions total, and SPI transfers 8 bits at the time.
+	// We need to send it as 5 x 8 positions
+	frame[0] = ~(NIXIE_PINMAP[digits[0]] >> 2);
+	frame[1] = ~(((NIXIE_PINMAP[digits[0]] & 0b0000000011) << 6) | (NIXIE_PINMAP[digits[1]] >> 4));
+	frame[2] = ~(((NIXIE_PINMAP[digits[1]] & 0b0000001111) << 4) | (NIXIE_PINMAP[digits[2]] >> 6));
+	frame[3] = ~(((NIXIE_PINMAP[digits[2]] & 0b0000111111) << 2) | (NIXIE_PINMAP[digits[3]] >> 8));
+	frame[4] = ~(((NIXIE_PINMAP[digits[3]] & 0b0011111111)));
+	frame[5] = dots;
+}
+
+#endif // _FRAME_h
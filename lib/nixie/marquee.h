@@ -0,0 +1,155 @@
+/*
+ * marquee.h - scrolling text for the Nixie tubes
+ *
+ * Text is shown as a row of cells, one per tube. A cell is a digit or a
+ * blank tube, optionally with the tube's dot lit; the dot sits to the left
+ * of the digit. Text is turned into cells as follows:
+ *
+ *  - '0' to '9' show that digit, and a space shows a blank tube.
+ *  - '.' and ':' light the dot of the next cell, so "192.168.1.10" shows
+ *    the dots in front of 1, 1 and 1, and "-4.25" in front of the 2.
+ *  - '-' is shown as a blank tube with its dot lit, in a cell of its own.
+ *  - Anything else shows a blank tube.
+ *
+ * Text that fits on the tubes is shown as is. Longer text scrolls in from
+ * the right and out to the left, a cell per step, and then starts again.
+ * The window onto the text is a ring buffer of cells, and each step turns
+ * at most one more cell of the text into a cell of the window, so a step
+ * takes constant time however long the text is. The text is not copied;
+ * it is read as it scrolls in and must stay valid while it is shown.
+ */
+
+#ifndef _MARQUEE_h
+#define _MARQUEE_h
+
+#include <stdint.h>
+
+#define MARQUEE_TUBES 4
+#define MARQUEE_BLANK 10
+// A cell is a digit, or MARQUEE_BLANK, with this bit set if its dot is lit.
+#define MARQUEE_DOT 0x80
+
+class Marquee {
+	const char *text = "";
+	const char *cursor = "";
+	uint8_t window[MARQUEE_TUBES];
+	// The ring buffer position of the leftmost tube.
+	uint8_t head = 0;
+	// Blank cells still to scroll in after the end of the text.
+	uint8_t trailing = 0;
+	bool scrolls = false;
+
+	static uint8_t cellOf(char c)
+	{
+		return (c >= '0' && c <= '9') ? c - '0' : MARQUEE_BLANK;
+	}
+
+	// Turn the next cell of the text at 'p' into a cell, advancing 'p'
+	// past it. Returns false at the end of the text.
+	static bool nextCell(const char *&p, uint8_t &cell)
+	{
+		if (*p == '\0')
+			return false;
+		if (*p == '-') {
+			p++;
+			cell = MARQUEE_BLANK | MARQUEE_DOT;
+			return true;
+		}
+		if (*p == '.' || *p == ':') {
+			p++;
+			// A separator at the end or in front of another separator or
+			// a minus sign gets a blank cell of its own.
+			if (*p == '\0' || *p == '.' || *p == ':' || *p == '-') {
+				cell = MARQUEE_BLANK | MARQUEE_DOT;
+				return true;
+			}
+			cell = cellOf(*p++) | MARQUEE_DOT;
+			return true;
+		}
+		cell = cellOf(*p++);
+		return true;
+	}
+
+	void clear()
+	{
+		for (uint8_t t = 0; t < MARQUEE_TUBES; t++)
+			window[t] = MARQUEE_BLANK;
+		head = 0;
+		cursor = text;
+		trailing = MARQUEE_TUBES - 1;
+	}
+
+    public:
+	Marquee()
+	{
+		clear();
+	}
+
+	// Show 'text', starting from the beginning.
+	void begin(const char *s)
+	{
+		uint8_t cell, n = 0;
+		const char *p = s;
+
+		text = s;
+		clear();
+		// Text that fits is shown at once, starting on the leftmost tube.
+		// Looking at one cell more than fits is enough to tell.
+		while (n <= MARQUEE_TUBES && nextCell(p, cell)) {
+			if (n < MARQUEE_TUBES)
+				window[n] = cell;
+			n++;
+		}
+		scrolls = n > MARQUEE_TUBES;
+		if (scrolls)
+			clear();
+	}
+
+	// Whether the text is too long for the tubes and scrolls.
+	bool scrolling() const
+	{
+		return scrolls;
+	}
+
+	// Scroll the text along by one cell. After the last cell has scrolled
+	// in, and blank cells after it until it reaches the leftmost tube, the
+	// tubes are cleared and the text starts again.
+	void step()
+	{
+		uint8_t cell;
+
+		if (!scrolls)
+			return;
+		if (!nextCell(cursor, cell)) {
+			if (trailing == 0) {
+				clear();
+				return;
+			}
+			trailing--;
+			cell = MARQUEE_BLANK;
+		}
+		window[head] = cell;
+		head = (head + 1) % MARQUEE_TUBES;
+	}
+
+	// The cell shown by tube 't', counting from the left.
+	uint8_t cell(uint8_t t) const
+	{
+		return window[(head + t) % MARQUEE_TUBES];
+	}
+
+	// The digits shown by the tubes and their dots, encoded for
+	// Nixie::write(): tube 't' has dot bit 1 << (t + 1).
+	void frame(uint8_t digits[MARQUEE_TUBES], uint8_t &dots) const
+	{
+		dots = 0;
+		for (uint8_t t = 0; t < MARQUEE_TUBES; t++) {
+			uint8_t c = cell(t);
+			digits[t] = c & ~MARQUEE_DOT;
+			if (c & MARQUEE_DOT)
+				dots |= 1 << (t + 1);
+		}
+	}
+};
+
+#endif // _MARQUEE_h
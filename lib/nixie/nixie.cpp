@@ -1,5 +1,96 @@
 #include "nixie.h"
 
+static_assert(MARQUEE_TUBES == NIXIE_TUBES, "The marquee must span all the tubes");
+
+/*
+ * State shared with the display timer interrupt. loop() publishes a frame by
+ * filling the buffer the interrupt is not reading and then flipping
+ * timerPublished, so the interrupt always sees a complete frame. A buffer
+ * also carries the frame to fade from; a crossfade starts whenever the
+ * interrupt sees a new fadeId.
+ */
+struct DisplayBuffer {
+	uint8_t frame[NIXIE_FRAME_BYTES];
+	uint8_t from[NIXIE_FRAME_BYTES];
+	uint32_t fadeId;
+};
+static DisplayBuffer timerBuffers[2];
+static volatile uint8_t timerPublished = 0;
+
+// Private to the interrupt, apart from the statistics.
+static uint8_t isrLatched[NIXIE_FRAME_BYTES];
+static uint32_t isrFadeId = 0;
+static uint16_t isrFadeTick = CROSSFADE_TICKS;
+static DisplayTimerStats isrStats;
+
+/*
+ * Shift a frame out to the tube drivers by driving the SPI peripheral
+ * directly, all 48 bits in one transfer. SPI.transfer() lives in flash and
+ * cannot be called from an interrupt.
+ */
+static inline __attribute__((always_inline)) void latchFrame(const uint8_t *frame)
+{
+	while (SPI1CMD & SPIBUSY) {
+	}
+	SPI1U1 = (SPI1U1 & ~((SPIMMOSI << SPILMOSI) | (SPIMMISO << SPILMISO))) |
+		 ((NIXIE_FRAME_BYTES * 8 - 1) << SPILMOSI) | ((NIXIE_FRAME_BYTES * 8 - 1) << SPILMISO);
+	SPI1W0 = frame[0] | frame[1] << 8 | frame[2] << 16 | (uint32_t)frame[3] << 24;
+	SPI1W1 = frame[4] | frame[5] << 8;
+	digitalWrite(SPI_CS, LOW);
+	SPI1CMD |= SPIBUSY;
+	while (SPI1CMD & SPIBUSY) {
+	}
+	digitalWrite(SPI_CS, HIGH);
+}
+
+/*
+ * Display timer interrupt, every DISPLAY_TICK_US. Picks the old or the new
+ * frame according to the crossfade schedule and latches it if it differs
+ * from what the tubes show, so the work per tick is bounded by one 48-bit
+ * SPI transfer.
+ */
+static void IRAM_ATTR displayTimerISR()
+{
+	uint32_t start = ESP.getCycleCount();
+	const DisplayBuffer *b = &timerBuffers[timerPublished];
+	const uint8_t *frame = b->frame;
+	bool changed = false;
+
+	if (b->fadeId != isrFadeId) {
+		isrFadeId = b->fadeId;
+		isrFadeTick = 0;
+	}
+	if (isrFadeTick < CROSSFADE_TICKS) {
+		if (!crossfadeShowsNew(isrFadeTick, CROSSFADE_TICKS, CROSSFADE_PERIOD_TICKS))
+			frame = b->from;
+		isrFadeTick++;
+	}
+
+	for (uint8_t i = 0; i < NIXIE_FRAME_BYTES; i++) {
+		if (isrLatched[i] != frame[i]) {
+			isrLatched[i] = frame[i];
+			changed = true;
+		}
+	}
+	if (changed) {
+		latchFrame(frame);
+		isrStats.latches++;
+	}
+
+	uint32_t cycles = ESP.getCycleCount() - start;
+	isrStats.ticks++;
+	isrStats.totalCycles += cycles;
+	if (cycles > isrStats.maxCycles)
+		isrStats.maxCycles = cycles;
+}
+
+// Run the display timer interrupt every DISPLAY_TICK_US.
+static void armDisplayTimer()
+{
+	timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP);
+	timer1_write(DISPLAY_TICK_US * (APB_CLK_FREQ / 16 / 1000000));
+}
+
 Nixie::Nixie()
 {
 	begin();
@@ -7,10 +98,6 @@ Nixie::Nixie()
 
 void Nixie::begin()
 {
-// Fire up the serial if DEBUG is defined.
-#ifdef DEBUG
-	Serial.begin(115200);
-#endif // DEBUG
 	// Turn off the Nixie tubes. If this is not called nixies might show some random stuff on startup.
 	write(11, 11, 11, 11, 0);
 	// Set SPI chip select as output
@@ -62,27 +149,173 @@ uint8_t Nixie::checkDate(uint16_t y, uint8_t m, uint8_t d, uint8_t h, uint8_t mm
  *                                                                          */
 void Nixie::writeLowLevel(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots)
 {
-	uint8_t part1, part2, part3, part4, part5, part6;
-	// Display has 4 x 10 positions total, and SPI transfers 8 bits at the time.
-	// We need to send it as 5 x 8 positions
-	part1 = ~(pinmap[digit1] >> 2);
-	part2 = ~(((pinmap[digit1] & 0b0000000011) << 6) | (pinmap[digit2] >> 4));
-	part3 = ~(((pinmap[digit2] & 0b0000001111) << 4) | (pinmap[digit3] >> 6));
-	part4 = ~(((pinmap[digit3] & 0b0000111111) << 2) | (pinmap[digit4] >> 8));
-	part5 = ~(((pinmap[digit4] & 0b0011111111)));
-	part6 = dots;
-	// Transmit over SPI
-	SPI.begin();
-	SPI.beginTransaction(SPISettings(1000000, MSBFIRST, SPI_MODE0));
-	digitalWrite(SPI_CS, LOW);
-	SPI.transfer(part1);
-	SPI.transfer(part2);
-	SPI.transfer(part3);
-	SPI.transfer(part4);
-	SPI.transfer(part5);
-	SPI.transfer(part6);
-	digitalWrite(SPI_CS, HIGH);
-	SPI.endTransaction();
+	uint8_t frame[NIXIE_FRAME_BYTES];
+	// Nothing is sent to the drivers while the display is blanked.
+	if (blanked)
+		return;
+	// Charge the time the previous frame was lit to its cathodes.
+	accountWear();
+	litDigits[0] = digit1;
+	litDigits[1] = digit2;
+	litDigits[2] = digit3;
+	litDigits[3] = digit4;
+	encodeFrame(litDigits, dots, frame);
+	if (timerDriver) {
+		// The timer interrupt refreshes the tubes; only hand it new frames.
+		if (memcmp(frame, shownFrame, sizeof(frame)) != 0 || fadeNext)
+			publishFrame(frame, fadeNext);
+	} else {
+		// Transmit over SPI
+		SPI.begin();
+		SPI.beginTransaction(SPISettings(1000000, MSBFIRST, SPI_MODE0));
+		digitalWrite(SPI_CS, LOW);
+		for (uint8_t i = 0; i < NIXIE_FRAME_BYTES; i++)
+			SPI.transfer(frame[i]);
+		digitalWrite(SPI_CS, HIGH);
+		SPI.endTransaction();
+		loopFrames++;
+	}
+	fadeNext = false;
+	memcpy(shownFrame, frame, sizeof(frame));
+}
+
+// The encoding lives in frame.h, so that it can be tested on a host.
+void Nixie::encodeFrame(const uint8_t digits[NIXIE_TUBES], uint8_t dots, uint8_t frame[NIXIE_FRAME_BYTES]) const
+{
+	nixieEncodeFrame(digits, dots, frame);
+}
+
+/*
+ * Hand a frame to the display timer interrupt. With 'fade' set the tubes
+ * crossfade to it from the frame shown until now; otherwise any crossfade
+ * in progress carries on towards the new frame.
+ */
+void Nixie::publishFrame(const uint8_t frame[NIXIE_FRAME_BYTES], bool fade)
+{
+	uint8_t next = !timerPublished;
+	const DisplayBuffer &cur = timerBuffers[timerPublished];
+	DisplayBuffer &b = timerBuffers[next];
+
+	memcpy(b.frame, frame, sizeof(b.frame));
+	if (fade) {
+		memcpy(b.from, shownFrame, sizeof(b.from));
+		b.fadeId = cur.fadeId + 1;
+	} else {
+		memcpy(b.from, cur.from, sizeof(b.from));
+		b.fadeId = cur.fadeId;
+	}
+	// The buffer must be complete before the interrupt can see it.
+	__asm__ __volatile__("" ::: "memory");
+	timerPublished = next;
+}
+
+/*
+ * Switch between refreshing the tubes from loop() and from a Timer1
+ * interrupt every DISPLAY_TICK_US. Only the timer driver crossfades.
+ */
+void Nixie::setTimerDriver(bool enable)
+{
+	if (enable == timerDriver)
+		return;
+	if (enable) {
+		// The interrupt reuses the SPI clock and bit order set up here.
+		SPI.begin();
+		SPI.beginTransaction(SPISettings(1000000, MSBFIRST, SPI_MODE0));
+		SPI.endTransaction();
+		memcpy(isrLatched, shownFrame, sizeof(isrLatched));
+		timerDriver = true;
+		publishFrame(shownFrame, false);
+		timer1_attachInterrupt(displayTimerISR);
+		// Blanked tubes need no refreshing; setBlank() arms the
+		// timer when they are lit again.
+		if (!blanked)
+			armDisplayTimer();
+		LOG_INFO(DISPLAY, "[Display] Refreshing from the timer interrupt every %u us.", DISPLAY_TICK_US);
+	} else {
+		timer1_disable();
+		timer1_detachInterrupt();
+		timerDriver = false;
+		LOG_INFO(DISPLAY, "[Display] Refreshing from the main loop.");
+	}
+}
+
+/*
+ * Turn all the cathodes off, or back on. While the display is blanked writes
+ * are ignored and the display timer is stopped, so there is no SPI traffic
+ * at all; the next write after unblanking shows the current digits again.
+ */
+void Nixie::setBlank(bool blank)
+{
+	if (blank == blanked)
+		return;
+
+	unsigned long now = millis();
+	if (blanked)
+		blankTotalMs += now - blankChanged;
+	else
+		litTotalMs += now - blankChanged;
+	blankChanged = now;
+
+	if (blank) {
+		writeLowLevel(10, 10, 10, 10, 0);
+		blanked = true;
+		if (timerDriver) {
+			// Latch the blank frame at once, cutting short any
+			// crossfade, and leave the drivers alone until the tubes
+			// are lit again.
+			timer1_disable();
+			isrFadeId = timerBuffers[timerPublished].fadeId;
+			isrFadeTick = CROSSFADE_TICKS;
+			if (memcmp(isrLatched, shownFrame, sizeof(isrLatched)) != 0) {
+				memcpy(isrLatched, shownFrame, sizeof(isrLatched));
+				latchFrame(shownFrame);
+				isrStats.latches++;
+			}
+		}
+		LOG_INFO(DISPLAY, "[Display] Blanking the tubes.");
+	} else {
+		blanked = false;
+		if (timerDriver)
+			armDisplayTimer();
+		LOG_INFO(DISPLAY, "[Display] Lighting the tubes.");
+	}
+}
+
+bool Nixie::getBlank()
+{
+	return blanked;
+}
+
+void Nixie::getBlankStats(uint32_t &litSeconds, uint32_t &blankSeconds)
+{
+	unsigned long elapsed = millis() - blankChanged;
+
+	litSeconds = (litTotalMs + (blanked ? 0 : elapsed)) / 1000;
+	blankSeconds = (blankTotalMs + (blanked ? elapsed : 0)) / 1000;
+}
+
+bool Nixie::getTimerDriver()
+{
+	return timerDriver;
+}
+
+void Nixie::getTimerStats(DisplayTimerStats &stats)
+{
+	noInterrupts();
+	stats = isrStats;
+	interrupts();
+}
+
+/*
+ * Number of frames shifted out to the tube drivers since boot, by either
+ * driver.
+ */
+uint32_t Nixie::getFrameCount()
+{
+	noInterrupts();
+	uint32_t latches = isrStats.latches;
+	interrupts();
+	return loopFrames + latches;
 }
 
 /*                                                         *
@@ -90,13 +323,32 @@ void Nixie::writeLowLevel(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_
  *                                                         */
 void Nixie::writeTime(time_t local, bool dot_state, bool timeFormat)
 {
+	const CivilTime &ct = civil.at(local);
+	uint8_t h = timeFormat ? ct.hour : ct.hour12;
+	uint8_t m = ct.minute;
+
 	antiPoison(local, timeFormat);
-	if (timeFormat) {
-		write(hour(local) / 10, hour(local) % 10, minute(local) / 10, minute(local) % 10, dot_state * 0b1000);
-	} else {
-		write(hourFormat12(local) / 10, hourFormat12(local) % 10, minute(local) / 10, minute(local) % 10, dot_state * 0b1000);
-	}
-	k = 0; // Reset the number position in the writeNumber function.
+	// Crossfade into a new minute when the timer driver can do so.
+	if (timerDriver && !animate && exerciseLeft == 0 &&
+	    (litDigits[0] != h / 10 || litDigits[1] != h % 10 || litDigits[2] != m / 10 || litDigits[3] != m % 10))
+		fadeNext = true;
+	write(h / 10, h % 10, m / 10, m % 10, dot_state * 0b1000);
+	marqueeText = NULL; // Restart writeNumber() from the beginning.
+}
+
+/*
+ * Show the time in another time zone, marked by 'dots'. Unlike writeTime()
+ * this never runs the anti-poisoning routine or crossfades, so switching
+ * between zones shows the new time straight away.
+ */
+void Nixie::writeZoneTime(time_t local, uint8_t dots, bool timeFormat)
+{
+	const CivilTime &ct = civil.at(local);
+	uint8_t h = timeFormat ? ct.hour : ct.hour12;
+	uint8_t m = ct.minute;
+
+	write(h / 10, h % 10, m / 10, m % 10, dots);
+	marqueeText = NULL; // Restart writeNumber() from the beginning.
 }
 
 /*                                                         *
@@ -104,341 +356,332 @@ void Nixie::writeTime(time_t local, bool dot_state, bool timeFormat)
  *                                                         */
 void Nixie::writeDate(time_t local, bool dot_state)
 {
-	write(month(local) / 10,
-	      month(local) % 10,
-	      day(local) / 10,
-	      day(local) % 10,
+	const CivilTime &ct = civil.at(local);
+
+	write(ct.month / 10,
+	      ct.month % 10,
+	      ct.day / 10,
+	      ct.day % 10,
 	      dot_state * 0b1000);
-	k = 0; // Reset the number position in the writeNumber function.
-}
-
-/*                                                                                                                                   *
- * With this function you can display random numbers(int or float, negative or positive) longer or shorter then four digits          *
- * and also set their scrolling speed(if the speed is zero number is stationed).                                                     *
- * Function accepts number in string form and then transfers it in to the int array with memorised position of a dot(if it exists).  *
- * Max size number, including integer and decimal part, is 100 digits. If you need to display longer number,                         *
- * you can easily modify number Array size in Nixie.h file.                                                                          *
- *                                                                                                                                   */
-void Nixie::writeNumber(String newNumber, unsigned int movingSpeed)
-{
-	if (newNumber != oldNumber) {
-		k = 0; // Reset the number position.
-		oldNumber = newNumber;
-		String number = newNumber;
-#ifdef DEBUG
-		Serial.println("---------------------------------------------------------------------------------------------");
-		Serial.println("Number to display is: " + number);
-#endif // DEBUG
-		number.trim(); // Get a version of the string with any leading and trailing whitespace removed.
-		if (number.startsWith("-")) {
-			numIsNeg = 1;
-			number.remove(0, 1); // Remove minus from string.
-#ifdef DEBUG
-			Serial.println("Number is negative!");
-#endif // DEBUG
-		} else
-			numIsNeg = 0;
-		numberSize = number.length() + 8; // For a simplicity of showing numbers on Nixies, we add four NULL(number 10 in this case) numbers before and after the real number.
-		dotPos = number.indexOf('.');
-		if (dotPos != -1) { // If the number is float type, we will replace the dot with the following number. So the whole size of the number will be reduced by one. Example: 1.23 -> 123
-			numberSize = numberSize - 1;
-			dotPos = dotPos + 4; // But we will remember the exact position where the point was.
-		}
-#ifdef DEBUG
-		Serial.println("Number after trimming: " + number);
-		Serial.printf("Size of a number(including dot(if exists) and 8 added numbers) is: %d", numberSize);
-		Serial.printf("\nDot position is(-1 = dot does not exists): %d\n", dotPos);
-#endif // DEBUG
-		for (int i = 0; i < numberSize; i++) {
-			if (i >= 0 && i < 4) {
-				numberArray[i] = 10;
-			} else if (i >= 4 && i < numberSize - 4) {
-				if ((int(number.charAt(i - 4)) >= 48 && int(number.charAt(i - 4)) <= 57) || int(number.charAt(i - 4)) == 46) {
-					if ((i < dotPos) || dotPos == -1) {
-						numberArray[i] = int(number.charAt(i - 4)) - 48;
-					} else if (i >= dotPos) {
-						numberArray[i] = int(number.charAt(i - 3)) - 48; // this way we skip the dot place and replace it with the next number.
-					}
-				} else {
-#ifdef DEBUG
-					Serial.println("Error in the function writeNumber! Reason: Given string is not a number.");
-#endif // DEBUG
-					break;
-				}
-			} else {
-				numberArray[i] = 10;
-			}
-		}
-#ifdef DEBUG
-		Serial.println("An array of numbers is created from a string:");
-		for (int i = 0; i < numberSize; i++) {
-			Serial.printf("%d: %d\t", i + 1, numberArray[i]);
-		}
-		Serial.println();
-#endif // DEBUG
+	marqueeText = NULL; // Restart writeNumber() from the beginning.
+}
+
+/*
+ * Show 'number', or any other text made up of digits, spaces, '.', ':' and
+ * '-' as described in marquee.h. Text that does not fit on the tubes
+ * scrolls by one tube every 'movingSpeed' milliseconds; with a speed of 0
+ * only its first four cells are shown. Call this on every pass of the main
+ * loop while the text is to be shown.
+ *
+ * The text is read as it scrolls rather than copied, so it must stay valid
+ * while it is shown. Passing a different pointer, or showing anything else
+ * in between, starts it again from the beginning.
+ */
+void Nixie::writeNumber(const char *number, unsigned int movingSpeed)
+{
+	uint8_t digits[NIXIE_TUBES], dots;
+
+	// Text that does not scroll is looked at afresh every time, so that
+	// changes to it show at once.
+	if (number != marqueeText || movingSpeed == 0 || !marquee.scrolling()) {
+		if (number != marqueeText)
+			LOG_DEBUG(DISPLAY, "[Display] Number to display is: %s", number);
+		marquee.begin(number);
+		marqueeText = number;
+		previousMillis = millis();
+		// Without scrolling, long text shows its first cells.
+		if (movingSpeed == 0)
+			for (uint8_t t = 0; t < NIXIE_TUBES; t++)
+				marquee.step();
+	} else if (millis() - previousMillis < movingSpeed) {
+		return;
+	} else {
+		previousMillis = millis();
+		marquee.step();
 	}
-	if (k < (numberSize - 4)) { // Since we, in the function write(), display four digits at the same time, we have to make up for it by reducing nuber k.
-		if (movingSpeed > 0) {
-			if (millis() - previousMillis >= movingSpeed) { // Determining how fast the number will scroll.
-				previousMillis = millis();
-#ifdef DEBUG
-				// Serial.printf("\nNow writting this digits on Nixies: \n1. -> %d, 2. -> %d, 3. -> %d, 4. -> %d \n", numberArray[k], numberArray[k + 1], numberArray[k + 2], numberArray[k + 3]);
-#endif // DEBUG
-				if ((dotPos - k >= 0) && (dotPos - k <= 3)) { //If the number is decimal, the decimal point will be displayed when these factors are met.
-					write(numberArray[k], numberArray[k + 1], numberArray[k + 2], numberArray[k + 3],
-					      (0b1 << (dotPos - k + 1)) | (((0b1 & numIsNeg) * ((k + 4 > 4) && (k + 4 < 9))) << (5 - k)));
-				} else {
-					write(numberArray[k], numberArray[k + 1], numberArray[k + 2], numberArray[k + 3], 0 | (((0b1 & numIsNeg) * ((k + 4 > 4) && (k + 4 < 9))) << (5 - k)));
-				}
-				k++;
-			}
-		} else if (movingSpeed == 0) {
-			if (numberSize > 12) {
-#ifdef DEBUG
-				Serial.println("Number is longer than 4 digits! It can not be completely displayed on the nixie screen.");
-#endif // DEBUG
-			} else
-				write(numberArray[4], numberArray[5], numberArray[6], numberArray[7], (0b1 << (dotPos - 3)) | (0b10 * numIsNeg));
-		} else {
-#ifdef DEBUG
-			Serial.println("Wrong value of movingSpeed. Speed of movement is not recognized.");
-#endif // DEBUG
+	marquee.frame(digits, dots);
+	write(digits[0], digits[1], digits[2], digits[3], dots);
+}
+
+/*
+ * Add the time since the previous frame was latched to the on-time of each
+ * cathode that frame lit.
+ */
+void Nixie::accountWear()
+{
+	unsigned long now = millis();
+	unsigned long elapsed = now - litSince;
+
+	litSince = now;
+	for (uint8_t tube = 0; tube < NIXIE_TUBES; tube++) {
+		uint8_t digit = litDigits[tube];
+		if (digit >= NIXIE_DIGITS)
+			continue;
+		uint32_t ms = wearMillis[tube][digit] + elapsed;
+		if (ms >= 1000) {
+			wearSeconds[tube][digit] += ms / 1000;
+			ms %= 1000;
 		}
+		wearMillis[tube][digit] = ms;
 	}
-	if (k >= (numberSize - 4))
-		k = 0;
 }
 
+uint32_t Nixie::getWear(uint8_t tube, uint8_t digit)
+{
+	return wearSeconds[tube][digit];
+}
+
+void Nixie::setWear(uint8_t tube, uint8_t digit, uint32_t seconds)
+{
+	wearSeconds[tube][digit] = seconds;
+	wearMillis[tube][digit] = 0;
+}
+
+/*
+ * Return how many milliseconds a cathode is owed: the amount by which its
+ * on-time falls short of WEAR_TARGET_PERMILLE of its tube's total on-time.
+ */
+uint32_t Nixie::getWearDeficit(uint8_t tube, uint8_t digit)
+{
+	uint64_t total = 0;
+	for (uint8_t d = 0; d < NIXIE_DIGITS; d++)
+		total += wearSeconds[tube][d] * 1000ULL + wearMillis[tube][d];
+	uint64_t target = total * WEAR_TARGET_PERMILLE / 1000;
+	uint64_t actual = wearSeconds[tube][digit] * 1000ULL + wearMillis[tube][digit];
+	if (actual >= target)
+		return 0;
+	return (target - actual > UINT32_MAX) ? UINT32_MAX : target - actual;
+}
+
+/*
+ * Run the anti-poisoning routine once per minute. Only the cathodes that
+ * have been lit for less than their share of their tube's on-time are
+ * exercised, so healthy tubes are left alone.
+ */
 void Nixie::antiPoison(time_t local, bool timeFormat)
 {
-	uint8_t stopH1 = 0, stopH0 = 0, stopM1 = 0, stopM0 = 0;
-	uint8_t H1 = 0, H0 = 0, M1 = 0, M0 = 0;
-	bool foundH1 = false, foundH0 = false, foundM1 = false, foundM0 = false;
-	uint8_t indexH1 = 0, indexH0 = 0, indexM1 = 0, indexM0 = 0;
-	stopM1 = minute(local) / 10;
-	stopM0 = minute(local) % 10;
+	const CivilTime &ct = civil.at(local);
+	uint8_t h = timeFormat ? ct.hour : ct.hour12;
+	uint8_t stop[NIXIE_TUBES];
 
-	if (timeFormat) {
-		stopH1 = hour(local) / 10;
-		stopH0 = hour(local) % 10;
-	} else {
-		stopH1 = hourFormat12(local) / 10;
-		stopH0 = hourFormat12(local) % 10;
+	stop[0] = h / 10;
+	stop[1] = h % 10;
+	stop[2] = ct.minute / 10;
+	stop[3] = ct.minute % 10;
+
+	if (stop[3] != autoPoisonDoneOnMinute) {
+		autoPoisonDoneOnMinute = stop[3];
+		exerciseCathodes(stop);
 	}
+}
 
-	for (uint8_t i = 0; i < 10; i++)
-		if (orderedDigits[i] == stopM1)
-			indexM1 = i;
-	for (uint8_t i = 0; i < 10; i++)
-		if (orderedDigits[i] == stopM0)
-			indexM0 = i;
-	for (uint8_t i = 0; i < 10; i++)
-		if (orderedDigits[i] == stopH1)
-			indexH1 = i;
-	for (uint8_t i = 0; i < 10; i++)
-		if (orderedDigits[i] == stopH0)
-			indexH0 = i;
-
-	if (stopM0 != autoPoisonDoneOnMinute) {
-		autoPoisonDoneOnMinute = stopM0;
-
-		//		for(uint8_t slotCount=0; slotCount<4; slotCount++) {
-		//
-		//			for(uint8_t j=0; j<10; j++) {
-		//
-		//				if (!foundM0) {
-		//					if((j+indexM0) > 9) M0 = orderedDigits[j+indexM0-10];
-		//					else M0 = orderedDigits[j+indexM0];
-		//				}
-		//				if (!foundM1) {
-		//					if((j+indexM1) > 9) M1 = orderedDigits[j+indexM1-10];
-		//					else M1 = orderedDigits[j+indexM1];
-		//				}
-		//				if (!foundH0) {
-		//					if((j+indexH0) > 9) H0 = orderedDigits[j+indexH0-10];
-		//					else H0 = orderedDigits[j+indexH0];
-		//				}
-		//				if (!foundH1) {
-		//					if((j+indexH1) > 9) H1 = orderedDigits[j+indexH1-10];
-		//					else H1 = orderedDigits[j+indexH1];
-		//				}
-		//
-		//				write(H1,H0,M1,M0,0b11110);
-		//				delay(25);
-		//			}
-		//
-		//			for(uint8_t j=10; j>0; j--) {
-		//				if (!foundM0) M0 = orderedDigits[j-1];
-		//				if((slotCount==0) && (M0 == stopM0)) foundM0 = true;
-		//
-		//				if (!foundM1) M1 = orderedDigits[j-1];
-		//				if((slotCount==1) && (M1 == stopM1)) foundM1 = true;
-		//
-		//				if (!foundH0) H0 = orderedDigits[j-1];
-		//				if((slotCount==2) && (H0 == stopH0)) foundH0 = true;
-		//
-		//				if (!foundH1) H1 = orderedDigits[j-1];
-		//				if((slotCount==3) && (H1 == stopH1)) foundH1 = true;
-		//
-		//				write(H1,H0,M1,M0,0b11110);
-		//				delay(25);
-		//			}
-
-		//		}
-
-		for (uint8_t slotCount = 0; slotCount < 4; slotCount++) {
-			for (uint8_t j = 0; j < 10; j++) {
-				if (!foundM0) {
-					if ((j + indexM0) > 9)
-						M0 = orderedDigits[j + indexM0 - 10];
-					else
-						M0 = orderedDigits[j + indexM0];
-				}
-				if (!foundM1) {
-					if ((j + indexM1) > 9)
-						M1 = orderedDigits[j + indexM1 - 10];
-					else
-						M1 = orderedDigits[j + indexM1];
-				}
-				if (!foundH0) {
-					if ((j + indexH0) > 9)
-						H0 = orderedDigits[j + indexH0 - 10];
-					else
-						H0 = orderedDigits[j + indexH0];
-				}
-				if (!foundH1) {
-					if ((j + indexH1) > 9)
-						H1 = orderedDigits[j + indexH1 - 10];
-					else
-						H1 = orderedDigits[j + indexH1];
-				}
-
-				delay(25);
-
-				if (slotCount == 0)
-					write(stopH1, stopH0, stopM1, M0, 0b10000);
-				if (slotCount == 1)
-					write(stopH1, stopH0, M1, stopM0, 0b01000);
-				if (slotCount == 2)
-					write(stopH1, H0, stopM1, stopM0, 0b00100);
-				if (slotCount == 3)
-					write(H1, stopH0, stopM1, stopM0, 0b00010);
-			}
+/*
+ * Run the anti-poisoning routine straight away, returning to the digits
+ * currently shown.
+ */
+void Nixie::antiPoisonNow()
+{
+	uint8_t stop[NIXIE_TUBES];
+
+	memcpy(stop, litDigits, sizeof(stop));
+	exerciseCathodes(stop);
+}
+
+/*
+ * Start lighting each tube's under-used cathodes, most under-used first, for
+ * as long as their deficit requires, up to WEAR_MAX_EXERCISE_MS per run.
+ * Each tube then returns to its 'stop' digit. The run shows its first frame
+ * straight away, and exerciseStep() shows the others; until it is over,
+ * write() leaves the tubes alone. The time spent is credited to the
+ * cathodes by the normal frame accounting, which shrinks their deficits.
+ */
+void Nixie::exerciseCathodes(const uint8_t stop[NIXIE_TUBES])
+{
+	uint32_t longest = 0, most = 0;
 
-			for (uint8_t j = 10; j > 0; j--) {
-				if (!foundM0)
-					M0 = orderedDigits[j - 1];
-				if ((slotCount == 0) && (M0 == stopM0))
-					foundM0 = true;
-
-				if (!foundM1)
-					M1 = orderedDigits[j - 1];
-				if ((slotCount == 1) && (M1 == stopM1))
-					foundM1 = true;
-
-				if (!foundH0)
-					H0 = orderedDigits[j - 1];
-				if ((slotCount == 2) && (H0 == stopH0))
-					foundH0 = true;
-
-				if (!foundH1)
-					H1 = orderedDigits[j - 1];
-				if ((slotCount == 3) && (H1 == stopH1))
-					foundH1 = true;
-
-				if (slotCount == 0)
-					write(stopH1, stopH0, stopM1, M0, 0b10000);
-				if (slotCount == 1)
-					write(stopH1, stopH0, M1, stopM0, 0b01000);
-				if (slotCount == 2)
-					write(stopH1, H0, stopM1, stopM0, 0b00100);
-				if (slotCount == 3)
-					write(H1, stopH0, stopM1, stopM0, 0b00010);
-				delay(25);
+	// Exercising needs the cathodes lit, and one run at a time, and does
+	// not break into a slot-machine spin.
+	if (blanked || exerciseLeft > 0 || spinFrame > 0)
+		return;
+
+	for (uint8_t tube = 0; tube < NIXIE_TUBES; tube++) {
+		uint8_t *order = exerciseOrder[tube];
+		uint32_t *owed = exerciseOwed[tube];
+		uint8_t &count = exerciseCount[tube];
+		uint32_t total = 0;
+
+		// Insertion sort the owed cathodes by decreasing deficit.
+		count = 0;
+		for (uint8_t digit = 0; digit < NIXIE_DIGITS; digit++) {
+			uint32_t deficit = getWearDeficit(tube, digit);
+			if (deficit == 0)
+				continue;
+			uint8_t i = count++;
+			while (i > 0 && owed[i - 1] < deficit) {
+				order[i] = order[i - 1];
+				owed[i] = owed[i - 1];
+				i--;
 			}
+			order[i] = digit;
+			owed[i] = deficit;
+			total += deficit;
+		}
+
+		if (total > most)
+			most = total;
+
+		// Share out the run time in proportion to each deficit.
+		if (total > WEAR_MAX_EXERCISE_MS) {
+			for (uint8_t i = 0; i < count; i++)
+				owed[i] = (uint64_t)owed[i] * WEAR_MAX_EXERCISE_MS / total;
+			total = WEAR_MAX_EXERCISE_MS;
 		}
+		if (total > longest)
+			longest = total;
 	}
+
+	if (most < WEAR_MIN_DEFICIT_MS)
+		return;
+
+	LOG_DEBUG(DISPLAY, "[Display] Exercising cathodes for %u ms.", (unsigned)longest);
+	memcpy(exerciseStop, stop, sizeof(exerciseStop));
+	memset(exerciseNext, 0, sizeof(exerciseNext));
+	exerciseLeft = longest;
+	writeExerciseFrame();
+}
+
+/*
+ * Show the next frame of the anti-poisoning run, and take its time off what
+ * the cathodes in it are owed.
+ */
+void Nixie::writeExerciseFrame()
+{
+	uint8_t frame[NIXIE_TUBES];
+
+	for (uint8_t tube = 0; tube < NIXIE_TUBES; tube++) {
+		uint8_t &next = exerciseNext[tube];
+		uint32_t *owed = exerciseOwed[tube];
+
+		// Move on once the current cathode has had its time.
+		while (next < exerciseCount[tube] && owed[next] < WEAR_FRAME_MS / 2)
+			next++;
+		if (next < exerciseCount[tube]) {
+			frame[tube] = exerciseOrder[tube][next];
+			owed[next] -= (owed[next] < WEAR_FRAME_MS) ? owed[next] : WEAR_FRAME_MS;
+		} else {
+			frame[tube] = exerciseStop[tube];
+		}
+	}
+	writeLowLevel(frame[0], frame[1], frame[2], frame[3], 0);
+	exerciseFrameAt = millis();
+}
+
+/*
+ * Whether an anti-poisoning run is showing its frames on the tubes.
+ */
+bool Nixie::exercising()
+{
+	return exerciseLeft > 0;
+}
+
+/*
+ * Advance the anti-poisoning run in progress by a frame once WEAR_FRAME_MS
+ * have passed since the last one. Returns the number of milliseconds until
+ * the next frame is due, or 0 once the run is over and the tubes are free
+ * to show something else.
+ */
+uint32_t Nixie::exerciseStep()
+{
+	unsigned long elapsed = millis() - exerciseFrameAt;
+
+	if (exerciseLeft == 0)
+		return 0;
+	if (blanked) {
+		exerciseLeft = 0;
+		return 0;
+	}
+	if (elapsed < WEAR_FRAME_MS)
+		return WEAR_FRAME_MS - elapsed;
+	exerciseLeft -= (exerciseLeft < WEAR_FRAME_MS) ? exerciseLeft : WEAR_FRAME_MS;
+	if (exerciseLeft == 0)
+		return 0;
+	writeExerciseFrame();
+	return WEAR_FRAME_MS;
 }
 
 void Nixie::setAnimation(bool animate)
 {
-	animate = animate;
+	this->animate = animate;
 }
 
+/*
+ * Show four digits. If an animation was requested with setAnimation(), the
+ * tubes first spin slot-machine style from the digits currently shown to
+ * the new ones: the first frame of the spin is shown straight away, and
+ * spinStep() shows the others. Until the spin is over, write() leaves the
+ * tubes alone, and the caller then writes the new digits again.
+ */
 void Nixie::write(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots)
 {
-	uint8_t H1 = 0, H0 = 0, M1 = 0, M0 = 0;
-	bool foundH1 = false, foundH0 = false, foundM1 = false, foundM0 = false;
-	uint8_t indexH1 = 0, indexH0 = 0, indexM1 = 0, indexM0 = 0;
-
+	// An anti-poisoning run or a spin has the tubes until it is over.
+	if (exerciseLeft > 0 || spinFrame > 0)
+		return;
 	if (animate) {
 		animate = false;
-		Serial.println("animiramo");
-		for (uint8_t i = 0; i < 10; i++)
-			if (orderedDigits[i] == oldDigit4)
-				indexM1 = i;
-		for (uint8_t i = 0; i < 10; i++)
-			if (orderedDigits[i] == oldDigit3)
-				indexM0 = i;
-		for (uint8_t i = 0; i < 10; i++)
-			if (orderedDigits[i] == oldDigit2)
-				indexH1 = i;
-		for (uint8_t i = 0; i < 10; i++)
-			if (orderedDigits[i] == oldDigit1)
-				indexH0 = i;
-
-		for (uint8_t j = 0; j < 10; j++) {
-			if (!foundM0) {
-				if ((j + indexM0) > 9)
-					M0 = orderedDigits[j + indexM0 - 10];
-				else
-					M0 = orderedDigits[j + indexM0];
-				if (M0 == digit4) {
-					foundM0 = true;
-					continue;
-				}
-			}
-			if (!foundM1) {
-				if ((j + indexM1) > 9)
-					M1 = orderedDigits[j + indexM1 - 10];
-				else
-					M1 = orderedDigits[j + indexM1];
-				if (M1 == digit3) {
-					foundM1 = true;
-					continue;
-				}
-			}
-			if (!foundH0) {
-				if ((j + indexH0) > 9)
-					H0 = orderedDigits[j + indexH0 - 10];
-				else
-					H0 = orderedDigits[j + indexH0];
-				if (H0 == digit2) {
-					foundH0 = true;
-					continue;
-				}
-			}
-			if (!foundH1) {
-				if ((j + indexH1) > 9)
-					H1 = orderedDigits[j + indexH1 - 10];
-				else
-					H1 = orderedDigits[j + indexH1];
-				if (H1 == digit1) {
-					foundH1 = true;
-					continue;
-				}
-			}
-
-			write(H1, H0, M1, M0, 0b11110);
-			delay(25);
+		const uint8_t to[NIXIE_TUBES] = { digit1, digit2, digit3, digit4 };
+		spin = SlotSpin(SLOT_DEFAULT_REEL, NIXIE_TUBES, litDigits, to);
+		LOG_DEBUG(DISPLAY, "[Display] Animating %u frames.", spin.frames());
+		// The last frame of the spin is the new digits themselves.
+		if (spin.frames() > 1 && !blanked) {
+			spinFrame = 1;
+			writeSpinFrame();
+			return;
 		}
+	}
+	writeLowLevel(digit1, digit2, digit3, digit4, dots);
+}
 
-		oldDigit1 = digit1;
-		oldDigit2 = digit2;
-		oldDigit3 = digit3;
-		oldDigit4 = digit4;
-	} else
-		writeLowLevel(digit1, digit2, digit3, digit4, dots);
+void Nixie::writeSpinFrame()
+{
+	uint8_t frame[NIXIE_TUBES];
+
+	spin.frame(spinFrame, frame);
+	writeLowLevel(frame[0], frame[1], frame[2], frame[3], 0b11110);
+	spinFrameAt = millis();
+}
+
+/*
+ * Whether a slot-machine spin is showing its frames on the tubes.
+ */
+bool Nixie::spinning()
+{
+	return spinFrame > 0;
+}
+
+/*
+ * Advance the spin in progress by a frame once SLOT_FRAME_MS have passed
+ * since the last one. Returns the number of milliseconds until the next
+ * frame is due, or 0 once the spin is over and the new digits are to be
+ * written.
+ */
+uint32_t Nixie::spinStep()
+{
+	unsigned long elapsed = millis() - spinFrameAt;
+
+	if (spinFrame == 0)
+		return 0;
+	if (blanked) {
+		spinFrame = 0;
+		return 0;
+	}
+	if (elapsed < SLOT_FRAME_MS)
+		return SLOT_FRAME_MS - elapsed;
+	if (++spinFrame >= spin.frames()) {
+		spinFrame = 0;
+		return 0;
+	}
+	writeSpinFrame();
+	return SLOT_FRAME_MS;
 }
 
 Nixie nixieTap = Nixie();
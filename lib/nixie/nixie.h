@@ -5,6 +5,12 @@
 #include <TimeLib.h>
 #include <SPI.h>
 #include <BQ32000RTC.h>
+#include <log.h>
+#include <civiltime.h>
+#include "crossfade.h"
+#include "frame.h"
+#include "marquee.h"
+#include "slotmachine.h"
 
 #define RTC_SDA_PIN D3
 #define RTC_SCL_PIN D4
@@ -13,47 +19,109 @@
 #define TOUCH_BUTTON D2
 #define CONFIG_BUTTON D0
 
-#ifndef DEBUG
-#define DEBUG
-#endif // DEBUG
+#define NIXIE_DIGITS 10
+
+// Each cathode should be lit for at least this share, in thousandths, of the
+// total time its tube has been lit. Cathodes below it are exercised by the
+// anti-poisoning routine.
+#define WEAR_TARGET_PERMILLE 1
+// Anti-poisoning only runs once some tube is owed at least this much.
+#define WEAR_MIN_DEFICIT_MS 2000
+// Upper bound on the length of a single anti-poisoning run.
+#define WEAR_MAX_EXERCISE_MS 1000
+// Length of one anti-poisoning frame.
+#define WEAR_FRAME_MS 25
+// Length of one slot-machine animation frame.
+#define SLOT_FRAME_MS 25
+
+// Estimated power drawn by the four lit tubes, used to report the energy
+// saved by blanking them.
+#define NIXIE_LIT_MILLIWATTS 1500
+
+struct DisplayTimerStats {
+	uint32_t ticks;
+	uint32_t latches;
+	uint32_t maxCycles;
+	uint64_t totalCycles;
+};
 
 class Nixie {
-	// Initialize the display. This function configures pinModes based on .h file.
-	const uint16_t pinmap[11] = {
-		0b0000010000, // 0
-		0b0000100000, // 1
-		0b0001000000, // 2
-		0b0010000000, // 3
-		0b0100000000, // 4
-		0b1000000000, // 5
-		0b0000000001, // 6
-		0b0000000010, // 7
-		0b0000000100, // 8
-		0b0000001000, // 9
-		0b0000000000 // digit off
-	};
-	String oldNumber = "";
-	uint8_t numberArray[100], numIsNeg;
-	int dotPos, numberSize, k = 0;
+	// The text shown by writeNumber(), or NULL if something else has been
+	// shown since.
+	Marquee marquee;
+	const char *marqueeText = NULL;
 	unsigned long previousMillis = 0;
-	uint8_t orderedDigits[10] = { 1, 6, 2, 7, 5, 0, 4, 9, 8, 3 };
+	// Fields of the local time most recently shown.
+	CivilClock civil;
 	uint8_t autoPoisonDoneOnMinute = 0;
-	uint8_t oldDigit1, oldDigit2, oldDigit3, oldDigit4;
-	bool animate = false;
+	volatile bool animate = false;
+	// Accumulated on-time of each cathode, split into whole seconds and a
+	// millisecond remainder.
+	uint32_t wearSeconds[NIXIE_TUBES][NIXIE_DIGITS] = {};
+	uint16_t wearMillis[NIXIE_TUBES][NIXIE_DIGITS] = {};
+	uint8_t litDigits[NIXIE_TUBES] = { 10, 10, 10, 10 };
+	// The anti-poisoning run in progress: each tube's owed cathodes, most
+	// owed first, the time still owed to each, and the digit to show once
+	// they have had it. exerciseLeft is the time left of the run.
+	uint8_t exerciseOrder[NIXIE_TUBES][NIXIE_DIGITS];
+	uint8_t exerciseCount[NIXIE_TUBES] = {};
+	uint8_t exerciseNext[NIXIE_TUBES] = {};
+	uint32_t exerciseOwed[NIXIE_TUBES][NIXIE_DIGITS];
+	uint8_t exerciseStop[NIXIE_TUBES];
+	uint32_t exerciseLeft = 0;
+	unsigned long exerciseFrameAt = 0;
+	// The slot-machine spin in progress, and the frame of it shown, or 0
+	// if there is none.
+	SlotSpin spin = SlotSpin(SLOT_DEFAULT_REEL, 0, NULL, NULL);
+	uint8_t spinFrame = 0;
+	unsigned long spinFrameAt = 0;
+	unsigned long litSince = 0;
+	// The frame most recently written, as shifted out to the drivers.
+	uint8_t shownFrame[NIXIE_FRAME_BYTES] = {};
+	bool timerDriver = false;
+	bool fadeNext = false;
+	bool blanked = false;
+	// Time spent lit and blanked, up to blankChanged.
+	uint64_t litTotalMs = 0, blankTotalMs = 0;
+	unsigned long blankChanged = 0;
+	// Frames shifted out by the main loop driver.
+	uint32_t loopFrames = 0;
 
     public:
 	Nixie();
 	void begin();
 	void write(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots);
-	void writeNumber(String newNumber, unsigned int movingSpeed);
+	void writeNumber(const char *newNumber, unsigned int movingSpeed);
 	void writeTime(time_t local, bool dot_state, bool timeFormat);
+	void writeZoneTime(time_t local, uint8_t dots, bool timeFormat);
 	void writeDate(time_t local, bool dot_state);
 	uint8_t checkDate(uint16_t y, uint8_t m, uint8_t d, uint8_t h, uint8_t mm);
 	void antiPoison(time_t local, bool timeFormat);
+	void antiPoisonNow();
+	bool exercising();
+	uint32_t exerciseStep();
+	bool spinning();
+	uint32_t spinStep();
 	void setAnimation(bool animate);
+	uint32_t getWear(uint8_t tube, uint8_t digit);
+	void setWear(uint8_t tube, uint8_t digit, uint32_t seconds);
+	uint32_t getWearDeficit(uint8_t tube, uint8_t digit);
+	void setBlank(bool blank);
+	bool getBlank();
+	void getBlankStats(uint32_t &litSeconds, uint32_t &blankSeconds);
+	void setTimerDriver(bool enable);
+	bool getTimerDriver();
+	void getTimerStats(DisplayTimerStats &stats);
+	uint32_t getFrameCount();
+	void encodeFrame(const uint8_t digits[NIXIE_TUBES], uint8_t dots, uint8_t frame[NIXIE_FRAME_BYTES]) const;
 
     private:
 	void writeLowLevel(uint8_t digit1, uint8_t digit2, uint8_t digit3, uint8_t digit4, uint8_t dots);
+	void accountWear();
+	void publishFrame(const uint8_t frame[NIXIE_FRAME_BYTES], bool fade);
+	void exerciseCathodes(const uint8_t stop[NIXIE_TUBES]);
+	void writeExerciseFrame();
+	void writeSpinFrame();
 };
 extern Nixie nixieTap;
 #endif // _NIXIE_h
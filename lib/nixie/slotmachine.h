@@ -0,0 +1,133 @@
+/*
+ * slotmachine.h - slot-machine animation sequence generator
+ *
+ * Each tube is treated as a reel carrying the ten digits in a fixed order.
+ * An animation spins every reel from the digit it currently shows to its
+ * target digit, one reel position per frame, and each reel stops as soon as
+ * it reaches its target. The digits shown by every tube in any frame are a
+ * closed-form function of the frame number, so a frame costs a couple of
+ * table lookups per tube and frames can be produced from a timer.
+ */
+
+#ifndef _SLOTMACHINE_h
+#define _SLOTMACHINE_h
+
+#include <stdint.h>
+
+#define SLOT_MAX_TUBES 4
+#define SLOT_POSITIONS 10
+
+/*
+ * The order of the digits on a reel, together with its inverse, so that both
+ * the digit at a reel position and the reel position of a digit are found
+ * with a single lookup.
+ */
+class SlotReel {
+	uint8_t order[SLOT_POSITIONS];
+	uint8_t index[SLOT_POSITIONS];
+
+    public:
+	constexpr SlotReel(const uint8_t (&digits)[SLOT_POSITIONS])
+		: order()
+		, index()
+	{
+		for (uint8_t i = 0; i < SLOT_POSITIONS; i++) {
+			order[i] = digits[i];
+			index[digits[i]] = i;
+		}
+	}
+
+	constexpr uint8_t digitAt(uint8_t position) const
+	{
+		return order[position];
+	}
+
+	constexpr uint8_t positionOf(uint8_t digit) const
+	{
+		return index[digit];
+	}
+};
+
+// The reel order used by the original Nixie Tap firmware.
+constexpr uint8_t SLOT_DEFAULT_ORDER[SLOT_POSITIONS] = { 1, 6, 2, 7, 5, 0, 4, 9, 8, 3 };
+constexpr SlotReel SLOT_DEFAULT_REEL(SLOT_DEFAULT_ORDER);
+
+static_assert(SLOT_DEFAULT_REEL.positionOf(SLOT_DEFAULT_REEL.digitAt(7)) == 7, "SlotReel index is not the inverse of its order");
+
+/*
+ * A planned spin of up to SLOT_MAX_TUBES reels. Frame 0 shows the starting
+ * digits and frame frames() shows the target digits; every frame in
+ * between is generated by frame().
+ */
+class SlotSpin {
+	const SlotReel *reel;
+	uint8_t tubes;
+	int8_t direction;
+	uint8_t start[SLOT_MAX_TUBES];
+	uint8_t distance[SLOT_MAX_TUBES];
+	uint8_t target[SLOT_MAX_TUBES];
+	uint8_t length;
+
+    public:
+	/*
+	 * Plan a spin of 'tubes' reels from the digits in 'from' to the digits
+	 * in 'to'. 'direction' is +1 to step forwards through the reel order
+	 * and -1 to step backwards. Tubes that are blank (digit 10 or above)
+	 * at either end do not spin and simply show their target.
+	 */
+	SlotSpin(const SlotReel &reel, uint8_t tubes, const uint8_t *from, const uint8_t *to, int8_t direction = 1)
+		: reel(&reel)
+		, tubes(tubes)
+		, direction(direction)
+		, length(0)
+	{
+		for (uint8_t t = 0; t < tubes; t++) {
+			target[t] = to[t];
+			if (from[t] >= SLOT_POSITIONS || to[t] >= SLOT_POSITIONS) {
+				start[t] = 0;
+				distance[t] = 0;
+				continue;
+			}
+			start[t] = reel.positionOf(from[t]);
+			int8_t steps = (int8_t)reel.positionOf(to[t]) - (int8_t)start[t];
+			if (direction < 0)
+				steps = -steps;
+			distance[t] = (steps + SLOT_POSITIONS) % SLOT_POSITIONS;
+			if (distance[t] > length)
+				length = distance[t];
+		}
+	}
+
+	// Number of the last frame of the spin. Zero means nothing moves.
+	uint8_t frames() const
+	{
+		return length;
+	}
+
+	// Store the digit each tube shows in frame 'f' into 'digits'.
+	void frame(uint8_t f, uint8_t *digits) const
+	{
+		for (uint8_t t = 0; t < tubes; t++) {
+			uint8_t steps = (f < distance[t]) ? f : distance[t];
+			if (distance[t] == 0) {
+				digits[t] = target[t];
+				continue;
+			}
+			int8_t position = (int8_t)start[t] + direction * (int8_t)steps;
+			digits[t] = reel->digitAt((position + SLOT_POSITIONS) % SLOT_POSITIONS);
+		}
+	}
+
+	// Store the whole sequence of digits shown by tube 't', frames 0 to
+	// frames(), into 'digits', which must hold frames() + 1 entries.
+	void sequence(uint8_t t, uint8_t *digits) const
+	{
+		for (uint8_t f = 0; f <= length; f++) {
+			uint8_t steps = (f < distance[t]) ? f : distance[t];
+			int8_t position = (int8_t)start[t] + direction * (int8_t)steps;
+			digits[f] = distance[t] ? reel->digitAt((position + SLOT_POSITIONS) % SLOT_POSITIONS) : target[t];
+		}
+	}
+};
+
+#endif // _SLOTMACHINE_h
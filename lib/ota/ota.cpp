@@ -0,0 +1,241 @@
+#include "ota.h"
+#include "log.h"
+#include <Updater.h>
+
+// Log progress every this many bytes.
+#define OTA_REPORT_BYTES (64 * 1024UL)
+
+static bool parseSha256(const char *hex, uint8_t *out)
+{
+	for (uint8_t i = 0; i < OTA_SHA256_SIZE; i++) {
+		unsigned int byte;
+		if (!isxdigit(hex[2 * i]) || !isxdigit(hex[2 * i + 1]) || sscanf(hex + 2 * i, "%2x", &byte) != 1)
+			return false;
+		out[i] = byte;
+	}
+	return hex[2 * OTA_SHA256_SIZE] == '\0';
+}
+
+bool OtaUpdater::begin(const char *url, const char *sha256)
+{
+	char host[64];
+	unsigned int port = 80;
+	const char *path;
+	int n = 0;
+
+	if (active()) {
+		LOG_WARN(OTA, "[OTA] An update is already in progress.");
+		return false;
+	}
+	if (!parseSha256(sha256, expected)) {
+		LOG_WARN(OTA, "[OTA] The SHA-256 must be 64 hexadecimal digits.");
+		return false;
+	}
+	if (sscanf(url, "http://%63[^:/]%n", host, &n) != 1) {
+		LOG_WARN(OTA, "[OTA] Unsupported URL: %s", url);
+		return false;
+	}
+	path = url + n;
+	if (*path == ':') {
+		port = strtoul(path + 1, (char **)&path, 10);
+	}
+	if (*path == '\0') {
+		path = "/";
+	} else if (*path != '/' || port == 0 || port > 65535) {
+		LOG_WARN(OTA, "[OTA] Unsupported URL: %s", url);
+		return false;
+	}
+
+	startedAt = micros();
+	LOG_INFO(OTA, "[OTA] Downloading %s", url);
+	if (!client.connect(host, port)) {
+		fail("unable to connect");
+		return false;
+	}
+	client.setNoDelay(true);
+	client.printf("GET %s HTTP/1.0\r\nHost: %s\r\nUser-Agent: NixieTap\r\nConnection: close\r\n\r\n", path, host);
+
+	br_sha256_init(&sha);
+	state = HEADERS;
+	lineLen = 0;
+	status = 0;
+	size = 0;
+	received = 0;
+	reported = 0;
+	elapsedFlash = 0;
+	lastDataAt = millis();
+	return true;
+}
+
+void OtaUpdater::abort()
+{
+	if (!active())
+		return;
+	fail("aborted");
+}
+
+void OtaUpdater::fail(const char *reason)
+{
+	LOG_ERROR(OTA, "[OTA] Update failed: %s.", reason);
+	client.stop();
+	// Without every byte written the Updater refuses to complete, and
+	// this discards the partial image.
+	if (state == BODY)
+		Update.end();
+	state = FAILED;
+}
+
+/*
+ * Handle a complete header line in 'line'. Returns false once the blank line
+ * ending the headers has been seen.
+ */
+bool OtaUpdater::parseHeader()
+{
+	if (lineLen == 0)
+		return false;
+	if (status == 0) {
+		if (sscanf(line, "HTTP/%*u.%*u %d", &status) != 1)
+			status = -1;
+	} else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+		size = strtoul(line + 15, NULL, 10);
+	}
+	return true;
+}
+
+bool OtaUpdater::poll()
+{
+	static uint8_t buf[OTA_CHUNK_SIZE];
+
+	if (!active())
+		return false;
+
+	if (millis() - lastDataAt > OTA_TIMEOUT_MS) {
+		fail("timed out");
+		return false;
+	}
+
+	while (state == HEADERS && client.available() > 0) {
+		lastDataAt = millis();
+		int c = client.read();
+		if (c == '\n') {
+			line[lineLen] = '\0';
+			if (parseHeader()) {
+				lineLen = 0;
+				continue;
+			}
+			if (status != 200) {
+				LOG_ERROR(OTA, "[OTA] The server replied with status %d.", status);
+				fail("bad response");
+				return false;
+			}
+			if (size == 0) {
+				fail("no Content-Length");
+				return false;
+			}
+			if (!Update.begin(size)) {
+				LOG_ERROR(OTA, "[OTA] Unable to start the update, error %u.", Update.getError());
+				fail("image does not fit");
+				return false;
+			}
+			LOG_INFO(OTA, "[OTA] Receiving %u bytes.", size);
+			bodyAt = micros();
+			state = BODY;
+		} else if (c != '\r' && lineLen < sizeof(line) - 1) {
+			line[lineLen++] = c;
+		}
+	}
+
+	if (state != BODY)
+		return false;
+
+	int avail = client.available();
+	if (avail <= 0) {
+		if (!client.connected())
+			fail("connection closed early");
+		return false;
+	}
+	size_t n = min((size_t)avail, sizeof(buf));
+	n = min(n, (size_t)(size - received));
+	n = client.read(buf, n);
+	if (n == 0)
+		return false;
+	lastDataAt = millis();
+	br_sha256_update(&sha, buf, n);
+	received += n;
+
+	// Hold the last chunk back until the image has been verified.
+	if (received == size)
+		return finish(buf, n);
+
+	uint32_t start = micros();
+	if (Update.write(buf, n) != n) {
+		LOG_ERROR(OTA, "[OTA] Flash write failed, error %u.", Update.getError());
+		fail("flash write failed");
+		return false;
+	}
+	elapsedFlash += micros() - start;
+
+	if (received - reported >= OTA_REPORT_BYTES) {
+		reported = received;
+		printProgress();
+	}
+	return false;
+}
+
+bool OtaUpdater::finish(const uint8_t *last, size_t len)
+{
+	uint8_t digest[OTA_SHA256_SIZE];
+
+	elapsedBody = micros() - bodyAt;
+	client.stop();
+	br_sha256_out(&sha, digest);
+	if (memcmp(digest, expected, sizeof(digest)) != 0) {
+		fail("SHA-256 mismatch");
+		return false;
+	}
+
+	uint32_t start = micros();
+	if (Update.write((uint8_t *)last, len) != len || !Update.end()) {
+		LOG_ERROR(OTA, "[OTA] Unable to complete the update, error %u.", Update.getError());
+		state = FAILED;
+		return false;
+	}
+	elapsedFlash += micros() - start;
+	elapsedTotal = micros() - startedAt;
+	state = DONE;
+	LOG_INFO(OTA, "[OTA] Image verified and written.");
+	printStats();
+	return true;
+}
+
+void OtaUpdater::printProgress()
+{
+	switch (state) {
+	case IDLE:
+		LOG_INFO(OTA, "[OTA] No update has been started.");
+		break;
+	case HEADERS:
+		LOG_INFO(OTA, "[OTA] Waiting for the server.");
+		break;
+	case BODY:
+		LOG_INFO(OTA, "[OTA] Received %u of %u bytes (%u%%).", received, size,
+			 (uint32_t)((uint64_t)received * 100 / size));
+		break;
+	case DONE:
+		printStats();
+		break;
+	case FAILED:
+		LOG_INFO(OTA, "[OTA] The last update failed.");
+		break;
+	}
+}
+
+void OtaUpdater::printStats()
+{
+	uint32_t ms = elapsedBody / 1000;
+	LOG_INFO(OTA, "[OTA] Received %u bytes in %u ms, %u KB/s.", size, ms,
+		 ms ? (uint32_t)((uint64_t)size * 1000 / 1024 / ms) : 0);
+	LOG_INFO(OTA, "[OTA] Writing to flash took %u ms of that, %u KB/s.", elapsedFlash / 1000,
+		 elapsedFlash ? (uint32_t)((uint64_t)size * 1000000 / 1024 / elapsedFlash) : 0);
+	LOG_INFO(OTA, "[OTA] Update took %u ms in total.", elapsedTotal / 1000);
+}
@@ -0,0 +1,86 @@
+/*
+ * ota.h - streaming over-the-air firmware update over HTTP
+ *
+ * Downloads a firmware image from an HTTP URL and streams it into the
+ * inactive flash region with the core's Updater, a chunk per call to
+ * poll(), so the main loop, and with it the display, keeps running for the
+ * whole download. The image may be gzip-compressed, in which case the
+ * bootloader inflates it when it copies it into place.
+ *
+ * The image is hashed with SHA-256 as it arrives, and the last chunk is
+ * held back until the hash has been checked against the expected one.
+ * Without it the Updater cannot complete, so an image that does not match
+ * is never booted.
+ */
+
+#ifndef _OTA_h
+#define _OTA_h
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <bearssl/bearssl_hash.h>
+
+// Bytes read from the network and written to flash per call to poll().
+#define OTA_CHUNK_SIZE 1024
+// Give up if no data arrives for this long.
+#define OTA_TIMEOUT_MS 15000
+#define OTA_SHA256_SIZE 32
+
+class OtaUpdater {
+    public:
+	enum State : uint8_t {
+		IDLE,
+		HEADERS,
+		BODY,
+		DONE,
+		FAILED,
+	};
+
+    private:
+	WiFiClient client;
+	State state = IDLE;
+	uint8_t expected[OTA_SHA256_SIZE];
+	br_sha256_context sha;
+	char line[128];
+	size_t lineLen = 0;
+	int status = 0;
+	uint32_t size = 0;
+	uint32_t received = 0;
+	uint32_t reported = 0;
+	// Timings, in microseconds, of the whole update, the transfer of the
+	// image and the flash writes within it.
+	uint32_t startedAt = 0;
+	uint32_t bodyAt = 0;
+	uint32_t lastDataAt = 0;
+	uint32_t elapsedTotal = 0;
+	uint32_t elapsedBody = 0;
+	uint32_t elapsedFlash = 0;
+
+    public:
+	// Start downloading the image at 'url', which must be a plain
+	// "http://host[:port]/path" URL, expecting its SHA-256 to be 'sha256',
+	// given as 64 hexadecimal digits.
+	bool begin(const char *url, const char *sha256);
+	// Make progress with the download. Call once per loop() pass. Returns
+	// true once the image has been verified and the update is complete.
+	bool poll();
+	void abort();
+
+	State getState() const
+	{
+		return state;
+	}
+	bool active() const
+	{
+		return state == HEADERS || state == BODY;
+	}
+	void printProgress();
+
+    private:
+	bool parseHeader();
+	bool finish(const uint8_t *last, size_t len);
+	void fail(const char *reason);
+	void printStats();
+};
+
+#endif // _OTA_h
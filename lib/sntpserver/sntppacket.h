@@ -0,0 +1,92 @@
+/*
+ * sntppacket.h - SNTP server response encoding
+ *
+ * Turns an NTP client request (mode 3) into the server response (mode 4)
+ * in place, as described in RFC 4330. Times are Unix time in microseconds
+ * and are converted to the 64-bit NTP timestamp format, whose fraction
+ * carries the sub-second part.
+ */
+
+#ifndef _SNTPPACKET_h
+#define _SNTPPACKET_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SNTP_PACKET_SIZE 48
+#define SNTP_MODE_CLIENT 3
+#define SNTP_MODE_SERVER 4
+#define SNTP_LEAP_NONE 0
+#define SNTP_LEAP_ALARM 3
+#define SNTP_STRATUM_UNSYNCED 16
+// log2 of the resolution of the clock the timestamps are read from, 1 us.
+#define SNTP_PRECISION -20
+// Seconds from the NTP epoch, 1900, to the Unix epoch.
+#define SNTP_UNIX_OFFSET 2208988800UL
+
+// What the server reports about its own synchronisation.
+struct SntpStatus {
+	uint8_t leap = SNTP_LEAP_ALARM;
+	uint8_t stratum = SNTP_STRATUM_UNSYNCED;
+	uint32_t refId = 0;
+	// Unix time in microseconds at which the clock was last set.
+	uint64_t refTimeMicros = 0;
+	// Round-trip delay and maximum error relative to the primary reference.
+	uint32_t rootDelayMicros = 0;
+	uint32_t rootDispersionMicros = 0;
+};
+
+static inline void sntpPut32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+// Store Unix time 'micros' as a 64-bit NTP timestamp.
+static inline void sntpPutTimestamp(uint8_t *p, uint64_t micros)
+{
+	sntpPut32(p, micros / 1000000 + SNTP_UNIX_OFFSET);
+	sntpPut32(p + 4, ((micros % 1000000) << 32) / 1000000);
+}
+
+// Store a duration in microseconds in the NTP short (16.16) format.
+static inline void sntpPutShort(uint8_t *p, uint32_t micros)
+{
+	sntpPut32(p, ((uint64_t)micros << 16) / 1000000);
+}
+
+/*
+ * Rewrite the client request in 'pkt', 'len' bytes long, into the response,
+ * given the time the request was received and the time the response is
+ * sent. Return false, leaving 'pkt' alone, if it is not a client request.
+ */
+static inline bool sntpBuildResponse(uint8_t *pkt, size_t len, const SntpStatus &status, uint64_t rxMicros, uint64_t txMicros)
+{
+	if (len < SNTP_PACKET_SIZE || (pkt[0] & 0x07) != SNTP_MODE_CLIENT)
+		return false;
+	uint8_t version = (pkt[0] >> 3) & 0x07;
+	if (version < 1 || version > 4)
+		return false;
+
+	// The client's transmit timestamp becomes the origin timestamp. The
+	// poll interval is echoed back unchanged.
+	memcpy(pkt + 24, pkt + 40, 8);
+	pkt[0] = status.leap << 6 | version << 3 | SNTP_MODE_SERVER;
+	pkt[1] = status.stratum;
+	pkt[3] = (uint8_t)SNTP_PRECISION;
+	sntpPutShort(pkt + 4, status.rootDelayMicros);
+	sntpPutShort(pkt + 8, status.rootDispersionMicros);
+	sntpPut32(pkt + 12, status.refId);
+	if (status.refTimeMicros)
+		sntpPutTimestamp(pkt + 16, status.refTimeMicros);
+	else
+		memset(pkt + 16, 0, 8);
+	sntpPutTimestamp(pkt + 32, rxMicros);
+	sntpPutTimestamp(pkt + 40, txMicros);
+	return true;
+}
+
+#endif // _SNTPPACKET_h
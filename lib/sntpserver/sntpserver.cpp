@@ -0,0 +1,81 @@
+#include "sntpserver.h"
+#include "log.h"
+#include "wallclock.h"
+
+bool SntpServer::begin(uint16_t port)
+{
+	if (pcb)
+		return true;
+	pcb = udp_new();
+	if (!pcb) {
+		LOG_ERROR(NTP, "[SNTP] Unable to allocate a UDP control block.");
+		return false;
+	}
+	if (udp_bind(pcb, IP_ADDR_ANY, port) != ERR_OK) {
+		LOG_ERROR(NTP, "[SNTP] Unable to bind to port %u.", port);
+		udp_remove(pcb);
+		pcb = nullptr;
+		return false;
+	}
+	udp_recv(pcb, onReceive, this);
+	stats = {};
+	startedAt = millis();
+	LOG_INFO(NTP, "[SNTP] Serving time on port %u.", port);
+	return true;
+}
+
+void SntpServer::end()
+{
+	if (!pcb)
+		return;
+	udp_remove(pcb);
+	pcb = nullptr;
+	LOG_INFO(NTP, "[SNTP] Stopped.");
+}
+
+void SntpServer::onReceive(void *arg, struct udp_pcb *, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+	static_cast<SntpServer *>(arg)->handle(p, addr, port);
+	pbuf_free(p);
+}
+
+void SntpServer::handle(struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+	// Timestamp the request before anything else.
+	uint64_t rx = Clock.nowMicros();
+	uint32_t start = micros();
+
+	stats.requests++;
+	uint32_t second = millis() / 1000;
+	if (second != rateSecond) {
+		rateSecond = second;
+		rateCount = 0;
+	}
+	if (++rateCount > stats.peakRate)
+		stats.peakRate = rateCount;
+
+	// Requests are answered in their own pbuf, which must hold the whole
+	// packet in its first segment. A clock that has never been set has
+	// nothing to serve.
+	if (!Clock.isSet() || p->len < SNTP_PACKET_SIZE || !sntpBuildResponse((uint8_t *)p->payload, p->len, status, rx, Clock.nowMicros())) {
+		stats.rejected++;
+		return;
+	}
+	// Anything after the NTP header, such as extension fields or a MAC, is
+	// not understood and is not echoed.
+	pbuf_realloc(p, SNTP_PACKET_SIZE);
+
+	// 'addr' points into lwIP's state for the packet being received, so
+	// take a copy before sending.
+	ip_addr_t dest = *addr;
+	if (udp_sendto(pcb, p, &dest, port) != ERR_OK) {
+		stats.rejected++;
+		return;
+	}
+
+	uint32_t latency = micros() - start;
+	stats.responses++;
+	stats.totalLatencyMicros += latency;
+	if (latency > stats.maxLatencyMicros)
+		stats.maxLatencyMicros = latency;
+}
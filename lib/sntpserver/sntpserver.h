@@ -0,0 +1,70 @@
+/*
+ * sntpserver.h - SNTP server for the local network
+ *
+ * Answers NTP client requests from the WallClock. Each response is built in
+ * the lwIP receive callback by rewriting the request in its own pbuf and
+ * sending that back, so serving a request takes no heap allocation and
+ * involves the main loop only for updating the reported status.
+ */
+
+#ifndef _SNTPSERVER_h
+#define _SNTPSERVER_h
+
+#include <Arduino.h>
+#include <lwip/pbuf.h>
+#include <lwip/udp.h>
+
+#include "sntppacket.h"
+
+#define SNTP_PORT 123
+
+struct SntpStats {
+	uint32_t requests;
+	uint32_t responses;
+	uint32_t rejected;
+	// Most requests received within one second.
+	uint32_t peakRate;
+	// Time from receiving a request to handing the response to lwIP.
+	uint32_t maxLatencyMicros;
+	uint64_t totalLatencyMicros;
+};
+
+class SntpServer {
+	struct udp_pcb *pcb = nullptr;
+	SntpStatus status;
+	SntpStats stats = {};
+	uint32_t startedAt = 0;
+	uint32_t rateSecond = 0;
+	uint32_t rateCount = 0;
+
+    public:
+	bool begin(uint16_t port = SNTP_PORT);
+	void end();
+	bool running() const
+	{
+		return pcb != nullptr;
+	}
+
+	// Set what responses report about the clock's synchronisation.
+	void setStatus(const SntpStatus &s)
+	{
+		status = s;
+	}
+
+	const SntpStats &getStats() const
+	{
+		return stats;
+	}
+
+	// Seconds since begin().
+	uint32_t uptime() const
+	{
+		return (millis() - startedAt) / 1000;
+	}
+
+    private:
+	static void onReceive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port);
+	void handle(struct pbuf *p, const ip_addr_t *addr, u16_t port);
+};
+
+#endif // _SNTPSERVER_h
@@ -0,0 +1,139 @@
+#include "stall.h"
+
+#define STALL_MAGIC 0x4c415453
+
+// Data RAM, where the stage names are.
+#define STALL_DRAM_START 0x3ffe8000
+#define STALL_DRAM_END 0x40000000
+
+static_assert(sizeof(StallRecord) % 4 == 0, "StallRecord must be a whole number of RTC memory blocks");
+static_assert(STALL_RTC_BLOCK + sizeof(StallRecord) / 4 <= STALL_RTC_STAGE_BLOCK,
+	      "The stage address overlaps the StallRecord");
+
+/*
+ * Copy the stage whose address enter() left in RTC user memory into 'name'.
+ * The address is only trusted if it points into data RAM at a printable
+ * string, as it does when the firmware that wrote it is still running.
+ */
+static void readStageAddress(char *name)
+{
+	uint32_t address;
+	uint8_t i;
+
+	name[0] = '\0';
+	if (!ESP.rtcUserMemoryRead(STALL_RTC_STAGE_BLOCK, &address, sizeof(address)) || address < STALL_DRAM_START ||
+	    address > STALL_DRAM_END - STALL_STAGE_MAX)
+		return;
+	const char *stage = (const char *)(uintptr_t)address;
+	for (i = 0; i < STALL_STAGE_MAX - 1 && stage[i] != '\0'; i++) {
+		if (!isprint(stage[i])) {
+			name[0] = '\0';
+			return;
+		}
+		name[i] = stage[i];
+	}
+	name[i] = '\0';
+}
+
+void StallMonitor::begin(uint32_t thresholdMillis)
+{
+	threshold = thresholdMillis * 1000;
+	if (!ESP.rtcUserMemoryRead(STALL_RTC_BLOCK, (uint32_t *)&record, sizeof(record)) || record.magic != STALL_MAGIC) {
+		memset(&record, 0, sizeof(record));
+		record.magic = STALL_MAGIC;
+	}
+	record.stage[STALL_STAGE_MAX - 1] = '\0';
+	record.resetStage[STALL_STAGE_MAX - 1] = '\0';
+
+	// The reset stage belongs to this boot only if the watchdog or an
+	// exception caused it; otherwise it is left over from an older one.
+	bootResetStage[0] = '\0';
+	switch (ESP.getResetInfoPtr()->reason) {
+	case REASON_WDT_RST:
+		// The hardware watchdog leaves no time for saveReset(), so
+		// only the stage is known, not how far into its pass.
+		if (record.resetStage[0] == '\0') {
+			readStageAddress(bootResetStage);
+			bootResetPassMicros = 0;
+			break;
+		}
+		// fall through
+	case REASON_EXCEPTION_RST:
+	case REASON_SOFT_WDT_RST:
+		strcpy(bootResetStage, record.resetStage);
+		bootResetPassMicros = record.resetPassMicros;
+		break;
+	}
+	record.resetStage[0] = '\0';
+	record.resetPassMicros = 0;
+	save();
+}
+
+void StallMonitor::beginPass()
+{
+	inPass = true;
+	passStart = stageStart = micros();
+	longest = current;
+	longestMicros = 0;
+}
+
+bool StallMonitor::endPass()
+{
+	uint32_t now = micros();
+	uint32_t took = now - passStart;
+
+	inPass = false;
+	if (now - stageStart > longestMicros) {
+		longest = current;
+		longestMicros = now - stageStart;
+	}
+	current = "loop";
+	saveStage();
+	if (took <= threshold)
+		return false;
+
+	stallCount++;
+	record.passMicros = took;
+	record.stageMicros = longestMicros;
+	record.uptime = micros64() / 1000000;
+	strncpy(record.stage, longest, STALL_STAGE_MAX - 1);
+	record.stage[STALL_STAGE_MAX - 1] = '\0';
+	save();
+	return true;
+}
+
+void StallMonitor::enter(const char *stage)
+{
+	uint32_t now = micros();
+
+	if (inPass && now - stageStart > longestMicros) {
+		longest = current;
+		longestMicros = now - stageStart;
+	}
+	current = stage;
+	stageStart = now;
+	saveStage();
+}
+
+void StallMonitor::saveReset()
+{
+	strncpy(record.resetStage, current, STALL_STAGE_MAX - 1);
+	record.resetStage[STALL_STAGE_MAX - 1] = '\0';
+	record.resetPassMicros = inPass ? micros() - passStart : 0;
+	save();
+}
+
+void StallMonitor::save()
+{
+	ESP.rtcUserMemoryWrite(STALL_RTC_BLOCK, (uint32_t *)&record, sizeof(record));
+}
+
+// A single word, so that naming a stage costs a few microseconds.
+void StallMonitor::saveStage()
+{
+	uint32_t address = (uintptr_t)current;
+
+	ESP.rtcUserMemoryWrite(STALL_RTC_STAGE_BLOCK, &address, sizeof(address));
+}
+
+StallMonitor Stall;
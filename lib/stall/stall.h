@@ -0,0 +1,127 @@
+/*
+ * stall.h - main loop stall monitor
+ *
+ * The main loop names the stage it is executing with enter(), or with a
+ * StallStage for the duration of a block. A pass of the loop that takes
+ * longer than the threshold is recorded together with the stage that took
+ * the longest in it. The last such record is kept in RTC user memory, which
+ * survives a reset, and so is the stage that was executing when the
+ * watchdog or an exception reset the chip, so that both can be reported
+ * after the reboot. The hardware watchdog resets the chip without warning,
+ * so enter() also leaves the address of each stage in RTC user memory.
+ */
+
+#ifndef _STALL_h
+#define _STALL_h
+
+#include <Arduino.h>
+
+// Longest stage name kept, including the terminating null.
+#define STALL_STAGE_MAX 16
+
+// First block of RTC user memory used. Blocks 0 to 31 are used by the
+// bootloader for OTA updates.
+#define STALL_RTC_BLOCK 32
+// Block of RTC user memory holding the address of the current stage, just
+// after the StallRecord.
+#define STALL_RTC_STAGE_BLOCK 45
+
+struct StallRecord {
+	uint32_t magic;
+	// Duration of the last stalled pass, and of its longest stage.
+	uint32_t passMicros;
+	uint32_t stageMicros;
+	// Seconds since boot at the stall.
+	uint32_t uptime;
+	char stage[STALL_STAGE_MAX];
+	// Stage executing, and how long its pass had been running, at the
+	// last reset by the watchdog or an exception. Empty if none.
+	char resetStage[STALL_STAGE_MAX];
+	uint32_t resetPassMicros;
+};
+
+class StallMonitor {
+	uint32_t threshold = 0;
+	const char *current = "boot";
+	bool inPass = false;
+	uint32_t passStart = 0;
+	uint32_t stageStart = 0;
+	// Longest stage of the current pass.
+	const char *longest = NULL;
+	uint32_t longestMicros = 0;
+	uint32_t stallCount = 0;
+	StallRecord record;
+	// Stage executing at the reset that started this boot, if it was
+	// caused by the watchdog or an exception.
+	char bootResetStage[STALL_STAGE_MAX];
+	uint32_t bootResetPassMicros = 0;
+
+    public:
+	// Load the record saved before the reset. 'thresholdMillis' is the
+	// longest pass not recorded as a stall.
+	void begin(uint32_t thresholdMillis);
+
+	// Mark the start and the end of a pass of the main loop. endPass()
+	// returns true if the pass stalled.
+	void beginPass();
+	bool endPass();
+
+	// Name the stage now executing. 'stage' must outlive the pass.
+	void enter(const char *stage);
+	const char *stage() const
+	{
+		return current;
+	}
+
+	// Save the current stage to RTC user memory. Called as the chip
+	// resets after a watchdog timeout or an exception.
+	void saveReset();
+
+	// Number of stalls since boot.
+	uint32_t stalls() const
+	{
+		return stallCount;
+	}
+	// The last stall recorded, in this boot or before the reset. Its
+	// passMicros is zero if there has been none.
+	const StallRecord &lastStall() const
+	{
+		return record;
+	}
+	// The stage at the reset that started this boot, or an empty string.
+	const char *resetStage() const
+	{
+		return bootResetStage;
+	}
+	uint32_t resetPassMicros() const
+	{
+		return bootResetPassMicros;
+	}
+
+    private:
+	void save();
+	void saveStage();
+};
+
+extern StallMonitor Stall;
+
+/*
+ * Names a stage of the main loop for the lifetime of the object, and
+ * restores the enclosing stage afterwards.
+ */
+class StallStage {
+	const char *outer;
+
+    public:
+	StallStage(const char *stage)
+		: outer(Stall.stage())
+	{
+		Stall.enter(stage);
+	}
+	~StallStage()
+	{
+		Stall.enter(outer);
+	}
+};
+
+#endif // _STALL_h
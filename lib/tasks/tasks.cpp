@@ -0,0 +1,71 @@
+#include "tasks.h"
+
+bool TaskScheduler::add(Task &task)
+{
+	if (count >= TASKS_MAX)
+		return false;
+	task.dueAt = micros();
+	tasks[count++] = &task;
+	if (count == 1)
+		statsSince = micros64();
+	return true;
+}
+
+uint32_t TaskScheduler::runNext()
+{
+	uint32_t now = micros();
+	uint32_t idle = UINT32_MAX;
+
+	for (uint8_t i = 0; i < count; i++) {
+		Task &task = *tasks[i];
+		int32_t wait = task.dueAt - now;
+
+		if (task.woken) {
+			// Count lateness from the wake-up if it came first.
+			if ((int32_t)(task.wokenAt - task.dueAt) < 0)
+				task.dueAt = task.wokenAt;
+			wait = task.dueAt - now;
+			if (wait > 0)
+				wait = 0;
+		}
+		if (wait > 0) {
+			if ((uint32_t)wait < idle)
+				idle = wait;
+			continue;
+		}
+
+		uint32_t late = -wait;
+		task.woken = false;
+		uint32_t start = micros();
+		uint32_t sleep = task.func();
+		uint32_t end = micros();
+		uint32_t took = end - start;
+
+		task.runs++;
+		task.busyMicros += took;
+		if (took > task.maxRunMicros)
+			task.maxRunMicros = took;
+		if (late > task.maxLateMicros)
+			task.maxLateMicros = late;
+		if (late > task.deadline)
+			task.misses++;
+		task.dueAt = end + sleep * 1000;
+		return 0;
+	}
+
+	// Round up, so that the loop does not wake just before the task is due.
+	return idle == UINT32_MAX ? 0 : (idle + 999) / 1000;
+}
+
+void TaskScheduler::resetStats()
+{
+	for (uint8_t i = 0; i < count; i++) {
+		Task &task = *tasks[i];
+		task.runs = 0;
+		task.misses = 0;
+		task.maxRunMicros = 0;
+		task.maxLateMicros = 0;
+		task.busyMicros = 0;
+	}
+	statsSince = micros64();
+}
@@ -0,0 +1,119 @@
+/*
+ * tasks.h - cooperative priority task scheduler
+ *
+ * The main loop is split into tasks, each of which runs to completion and
+ * then says how long it can sleep before it next needs to run. Every pass
+ * of the main loop runs just the highest-priority task that is due, so a
+ * long-running low-priority task delays a higher-priority one by at most
+ * its own run time, and never by the time of the other tasks queued behind
+ * it. When nothing is due the loop can idle until the next task wakes.
+ *
+ * A task can also be woken early from an interrupt handler with wake().
+ */
+
+#ifndef _TASKS_h
+#define _TASKS_h
+
+#include <Arduino.h>
+
+#define TASKS_MAX 8
+
+class Task {
+	friend class TaskScheduler;
+
+	const char *taskName;
+	// Run the task, and return the number of milliseconds until it next
+	// needs to run. Zero runs it again as soon as no higher-priority task
+	// is due.
+	uint32_t (*func)();
+	// How late, in microseconds, a run may start before it counts as a
+	// deadline miss.
+	uint32_t deadline;
+
+	// micros() at which the task is next due.
+	uint32_t dueAt = 0;
+	// Set, together with wokenAt, by wake().
+	volatile bool woken = false;
+	volatile uint32_t wokenAt = 0;
+
+	uint32_t runs = 0;
+	uint32_t misses = 0;
+	uint32_t maxRunMicros = 0;
+	uint32_t maxLateMicros = 0;
+	uint64_t busyMicros = 0;
+
+    public:
+	Task(const char *name, uint32_t (*func)(), uint32_t deadlineMillis)
+		: taskName(name)
+		, func(func)
+		, deadline(deadlineMillis * 1000)
+	{
+	}
+
+	// Make the task due now. This may be called from an interrupt handler.
+	void IRAM_ATTR wake()
+	{
+		wokenAt = micros();
+		woken = true;
+	}
+
+	const char *name() const
+	{
+		return taskName;
+	}
+	uint32_t runCount() const
+	{
+		return runs;
+	}
+	uint32_t deadlineMisses() const
+	{
+		return misses;
+	}
+	uint32_t longestRun() const
+	{
+		return maxRunMicros;
+	}
+	uint32_t latestStart() const
+	{
+		return maxLateMicros;
+	}
+	uint64_t busyTime() const
+	{
+		return busyMicros;
+	}
+};
+
+class TaskScheduler {
+	Task *tasks[TASKS_MAX];
+	uint8_t count = 0;
+	// micros64() when the statistics were last reset.
+	uint64_t statsSince = 0;
+
+    public:
+	// Add a task, due at once. Tasks must be added in order of priority,
+	// highest first.
+	bool add(Task &task);
+
+	// Run the highest-priority task that is due, if any. Return the number
+	// of milliseconds until the next task is due, which is zero if a task
+	// was run.
+	uint32_t runNext();
+
+	uint8_t size() const
+	{
+		return count;
+	}
+	const Task &task(uint8_t index) const
+	{
+		return *tasks[index];
+	}
+
+	// Microseconds over which the statistics have been collected.
+	uint64_t statsPeriod() const
+	{
+		return micros64() - statsSince;
+	}
+	void resetStats();
+};
+
+#endif // _TASKS_h
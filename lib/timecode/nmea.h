@@ -0,0 +1,76 @@
+/*
+ * nmea.h - NMEA 0183 time sentences
+ *
+ * Formats the $GPZDA and $GPRMC sentences a GPS receiver sends for the start
+ * of each UTC second, so that tools such as gpsd can take the time from
+ * them. The RMC sentence carries no position.
+ */
+
+#ifndef _NMEA_h
+#define _NMEA_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "civiltime.h"
+
+// Longest sentence, including the trailing "\r\n" and NUL.
+#define NMEA_SENTENCE_MAX 48
+
+enum NmeaSentence : uint8_t {
+	NMEA_ZDA,
+	NMEA_RMC,
+};
+
+/*
+ * Write the sentence 'type' for the UTC time 'utc' into 'buf', which must
+ * hold NMEA_SENTENCE_MAX bytes, and return its length.
+ */
+static inline size_t nmeaFormat(char *buf, uint8_t type, time_t utc)
+{
+	static const char HEX_DIGITS[] = "0123456789ABCDEF";
+	int64_t t = utc;
+	int32_t days = t >= 0 ? t / 86400 : (t - 86399) / 86400;
+	uint32_t secs = t - (int64_t)days * 86400;
+	CivilTime ct;
+	char *p = buf;
+
+	civilFromDays(days, ct);
+
+	p = (char *)memcpy(p, type == NMEA_ZDA ? "$GPZDA," : "$GPRMC,", 7) + 7;
+	p = civilPut2(p, secs / 3600);
+	p = civilPut2(p, secs / 60 % 60);
+	p = civilPut2(p, secs % 60);
+	p = (char *)memcpy(p, ".00,", 4) + 4;
+	if (type == NMEA_ZDA) {
+		// Day, month, year and a local zone of 00:00.
+		p = civilPut2(p, ct.day);
+		*p++ = ',';
+		p = civilPut2(p, ct.month);
+		*p++ = ',';
+		p = civilPut2(p, ct.year / 100);
+		p = civilPut2(p, ct.year % 100);
+		p = (char *)memcpy(p, ",00,00", 6) + 6;
+	} else {
+		// Valid, with no position, speed, course or variation.
+		p = (char *)memcpy(p, "A,,,,,,,", 8) + 8;
+		p = civilPut2(p, ct.day);
+		p = civilPut2(p, ct.month);
+		p = civilPut2(p, ct.year % 100);
+		p = (char *)memcpy(p, ",,", 2) + 2;
+	}
+
+	// The checksum is the XOR of everything between '$' and '*'.
+	uint8_t sum = 0;
+	for (const char *c = buf + 1; c < p; c++)
+		sum ^= *c;
+	*p++ = '*';
+	*p++ = HEX_DIGITS[sum >> 4];
+	*p++ = HEX_DIGITS[sum & 0xf];
+	*p++ = '\r';
+	*p++ = '\n';
+	*p = '\0';
+	return p - buf;
+}
+
+#endif // _NMEA_h
@@ -0,0 +1,63 @@
+#include "timecode.h"
+#include "log.h"
+#include "wallclock.h"
+
+// How often to check whether the clock has been set while it has not.
+#define TIMECODE_IDLE_MS 1000
+
+void TimeCodeOutput::setFormat(uint8_t format)
+{
+	cancel();
+	this->format = format < TIMECODE_FORMAT_COUNT ? format : TIMECODE_OFF;
+}
+
+uint32_t TimeCodeOutput::poll()
+{
+	if (format == TIMECODE_OFF || !Clock.isSet()) {
+		cancel();
+		return TIMECODE_IDLE_MS;
+	}
+
+	uint64_t now = Clock.nowMicros();
+	if (edge == 0) {
+		uint64_t next = (now / 1000000 + 1) * 1000000;
+		uint32_t until = next - now;
+		if (until > TIMECODE_PREPARE_US)
+			return (until - TIMECODE_PREPARE_US) / 1000;
+
+		// Format the sentence and let the FIFO drain before the edge.
+		edge = next;
+		length = nmeaFormat(sentence, format == TIMECODE_ZDA ? NMEA_ZDA : NMEA_RMC, edge / 1000000);
+		Log.hold(true);
+	}
+	if (now < edge && edge - now > TIMECODE_SPIN_US)
+		return (edge - now - TIMECODE_SPIN_US) / 1000;
+
+	// Something else is still being sent, or this call came too late.
+	// Skip this edge and wait for the next.
+	if (Serial.availableForWrite() < TIMECODE_UART_FIFO || now > edge + TIMECODE_MAX_LATE_US) {
+		uint32_t wait = now < edge ? (edge - now) / 1000 + 1 : 0;
+		stats.skipped++;
+		cancel();
+		return wait;
+	}
+
+	while ((now = Clock.nowMicros()) < edge)
+		;
+	Serial.write((const uint8_t *)sentence, length);
+	uint32_t late = now - edge;
+
+	stats.sent++;
+	stats.totalLateMicros += late;
+	if (late > stats.maxLateMicros)
+		stats.maxLateMicros = late;
+	cancel();
+	return (1000000 - TIMECODE_PREPARE_US) / 1000 - 1;
+}
+
+void TimeCodeOutput::cancel()
+{
+	if (edge != 0)
+		Log.hold(false);
+	edge = 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * timecode.h - NMEA time code output at the UTC second edge
+ *
+ * Sends an NMEA time sentence on the serial port so that its first byte
+ * leaves at the start of each UTC second, as a GPS receiver does. The
+ * sentence for the next second is formatted TIMECODE_PREPARE_US ahead of
+ * the edge, when the logger is also held off so that the UART transmit FIFO
+ * is empty at the edge. From TIMECODE_SPIN_US ahead of the edge poll()
+ * busy-waits, and at the edge it hands the whole sentence to the FIFO.
+ */
+
+#ifndef _TIMECODE_h
+#define _TIMECODE_h
+
+#include <Arduino.h>
+#include "nmea.h"
+
+#define TIMECODE_PREPARE_US 25000
+#define TIMECODE_SPIN_US 3000
+// A sentence that cannot be started within this long of its edge is
+// skipped.
+#define TIMECODE_MAX_LATE_US 500
+// Size of the UART transmit FIFO.
+#define TIMECODE_UART_FIFO 128
+
+enum TimeCodeFormat : uint8_t {
+	TIMECODE_OFF,
+	TIMECODE_ZDA,
+	TIMECODE_RMC,
+	TIMECODE_FORMAT_COUNT,
+};
+
+struct TimeCodeStats {
+	uint32_t sent;
+	uint32_t skipped;
+	// Time from the second edge to the sentence entering the FIFO.
+	uint32_t maxLateMicros;
+	uint64_t totalLateMicros;
+};
+
+class TimeCodeOutput {
+	uint8_t format = TIMECODE_OFF;
+	char sentence[NMEA_SENTENCE_MAX];
+	size_t length = 0;
+	// Wall clock time in microseconds of the edge the sentence is for, or
+	// 0 if none is prepared.
+	uint64_t edge = 0;
+	TimeCodeStats stats = {};
+
+    public:
+	void setFormat(uint8_t format);
+	bool running() const
+	{
+		return format != TIMECODE_OFF;
+	}
+
+	// Prepare or send the next sentence, and return the number of
+	// milliseconds until it should be called again.
+	uint32_t poll();
+
+	const TimeCodeStats &getStats() const
+	{
+		return stats;
+	}
+
+    private:
+	void cancel();
+};
+
+#endif // _TIMECODE_h
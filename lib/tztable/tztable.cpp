@@ -0,0 +1,95 @@
+#include "tztable.h"
+
+using namespace ace_time;
+
+#define SECONDS_PER_DAY 86400
+
+static bool sameState(const ZonedExtra &a, const ZonedExtra &b)
+{
+	return a.timeOffset().toSeconds() == b.timeOffset().toSeconds() && strcmp(a.abbrev(), b.abbrev()) == 0;
+}
+
+void TzTable::clear()
+{
+	magic = 0;
+	zoneId = 0;
+	firstYear = 0;
+	count = 0;
+	until = 0;
+}
+
+bool TzTable::matches(uint32_t zoneId, int16_t firstYear) const
+{
+	return magic == TZ_TABLE_MAGIC && this->zoneId == zoneId && this->firstYear == firstYear;
+}
+
+/*
+ * Step through the window a day at a time, comparing the UTC offset and
+ * abbreviation at the start of each day with the previous one. Each change
+ * is then pinned to the second by bisecting the day it happened in.
+ */
+bool TzTable::build(const TimeZone &tz, int16_t firstYear)
+{
+	int64_t from = LocalDateTime::forComponents(firstYear, 1, 1, 0, 0, 0).toUnixSeconds64();
+	int64_t end = LocalDateTime::forComponents(firstYear + TZ_TABLE_YEARS, 1, 1, 0, 0, 0).toUnixSeconds64();
+
+	magic = TZ_TABLE_MAGIC;
+	zoneId = tz.getZoneId();
+	this->firstYear = firstYear;
+	until = end;
+	count = 0;
+
+	ZonedExtra prev = ZonedExtra::forUnixSeconds64(from, tz);
+	if (prev.isError())
+		return false;
+	int64_t changed = from;
+
+	for (int64_t day = from + SECONDS_PER_DAY; day <= end; day += SECONDS_PER_DAY) {
+		ZonedExtra cur = ZonedExtra::forUnixSeconds64(day, tz);
+		int64_t lo = day - SECONDS_PER_DAY;
+
+		// Normally at most one change per day, but be thorough.
+		while (!sameState(cur, prev)) {
+			int64_t hi = day;
+			while (hi - lo > 1) {
+				int64_t mid = lo + (hi - lo) / 2;
+				if (sameState(ZonedExtra::forUnixSeconds64(mid, tz), prev))
+					lo = mid;
+				else
+					hi = mid;
+			}
+			if (count >= TZ_TABLE_MAX_ENTRIES - 1) {
+				count = 0;
+				return false;
+			}
+			entries[count].utc = changed;
+			entries[count].offsetMinutes = prev.timeOffset().toMinutes();
+			strlcpy(entries[count].abbrev, prev.abbrev(), sizeof(entries[count].abbrev));
+			count++;
+
+			prev = ZonedExtra::forUnixSeconds64(hi, tz);
+			changed = hi;
+			lo = hi;
+		}
+	}
+
+	entries[count].utc = changed;
+	entries[count].offsetMinutes = prev.timeOffset().toMinutes();
+	strlcpy(entries[count].abbrev, prev.abbrev(), sizeof(entries[count].abbrev));
+	count++;
+	return true;
+}
+
+const TzTransition &TzTable::find(uint32_t utc) const
+{
+	// Find the last entry starting at or before 'utc'.
+	uint8_t lo = 0, hi = count;
+	while (hi - lo > 1) {
+		uint8_t mid = (lo + hi) / 2;
+		if (entries[mid].utc <= utc)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return entries[lo];
+}
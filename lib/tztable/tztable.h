@@ -0,0 +1,63 @@
+/*
+ * tztable.h - precomputed time zone transition table
+ *
+ * AceTime derives a zone's transitions from its rules whenever its zone
+ * processor cache misses. A TzTable instead holds every UTC offset change of
+ * one zone over a window of TZ_TABLE_YEARS years, found once with AceTime,
+ * so converting UTC to local time is a binary search over a few entries.
+ * The table is plain data, so it can be stored in the EEPROM as it is and
+ * reused across boots.
+ */
+
+#ifndef _TZTABLE_h
+#define _TZTABLE_h
+
+#include <Arduino.h>
+#include <AceTime.h>
+
+// Number of years, starting with January 1st UTC of the first, covered by
+// a table.
+#define TZ_TABLE_YEARS 5
+// Most transitions a table can hold, including the state at the start of the
+// window. A few zones change offset four times a year.
+#define TZ_TABLE_MAX_ENTRIES 22
+// Longest abbreviation, including the terminating NUL.
+#define TZ_ABBREV_SIZE 7
+#define TZ_TABLE_MAGIC 0x4c425a54
+
+struct TzTransition {
+	uint32_t utc; // Unix seconds from which this entry applies
+	int16_t offsetMinutes; // UTC offset, including DST
+	char abbrev[TZ_ABBREV_SIZE];
+};
+
+struct TzTable {
+	uint32_t magic;
+	uint32_t zoneId;
+	int16_t firstYear;
+	uint8_t count; // 0 if the window could not be tabulated
+	uint32_t until; // end of the window, in Unix seconds
+	TzTransition entries[TZ_TABLE_MAX_ENTRIES];
+
+	// Discard the table.
+	void clear();
+
+	// Whether the table was built for this zone and window, whether or
+	// not that succeeded.
+	bool matches(uint32_t zoneId, int16_t firstYear) const;
+
+	// Tabulate the transitions of 'tz' from January 1st of 'firstYear'.
+	// Returns false if the zone changes offset too often to fit.
+	bool build(const ace_time::TimeZone &tz, int16_t firstYear);
+
+	// Whether 'utc' is covered by the table.
+	bool covers(uint32_t utc) const
+	{
+		return count > 0 && utc >= entries[0].utc && utc < until;
+	}
+
+	// The entry in effect at 'utc', which must be covered by the table.
+	const TzTransition &find(uint32_t utc) const;
+};
+
+#endif // _TZTABLE_h
@@ -0,0 +1,3 @@
+#include "wallclock.h"
+
+WallClock Clock;
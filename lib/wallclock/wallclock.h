@@ -0,0 +1,77 @@
+/*
+ * wallclock.h - sub-second wall clock
+ *
+ * TimeLib keeps the time in whole seconds. WallClock keeps it in
+ * microseconds, as an offset from the free-running micros64() counter that
+ * is fixed whenever the time is set, and remembers when the time was last
+ * set from an authoritative source such as NTP.
+ */
+
+#ifndef _WALLCLOCK_h
+#define _WALLCLOCK_h
+
+#include <Arduino.h>
+
+class WallClock {
+	// Unix time in microseconds minus micros64().
+	int64_t offset = 0;
+	bool valid = false;
+	bool synced = false;
+	// micros64() at the last sync.
+	uint64_t syncedAt = 0;
+
+    public:
+	// The current time is 'seconds' and 'micros' microseconds.
+	void set(time_t seconds, uint32_t micros = 0)
+	{
+		offset = (int64_t)seconds * 1000000 + micros - (int64_t)micros64();
+		valid = true;
+	}
+
+	// As set(), from an authoritative time source.
+	void sync(time_t seconds, uint32_t micros = 0)
+	{
+		set(seconds, micros);
+		synced = true;
+		syncedAt = micros64();
+	}
+
+	// Continue from a snapshot: the current time is 'unixMicros', and
+	// the last sync was 'syncAge' seconds ago, or never if UINT32_MAX.
+	void resume(uint64_t unixMicros, uint32_t syncAge)
+	{
+		offset = (int64_t)unixMicros - (int64_t)micros64();
+		valid = true;
+		synced = syncAge != UINT32_MAX;
+		// This may wrap below zero early in the boot, which the unsigned
+		// differences taken from it allow for.
+		syncedAt = micros64() - (uint64_t)syncAge * 1000000;
+	}
+
+	bool isSet() const
+	{
+		return valid;
+	}
+
+	// Unix time in microseconds.
+	uint64_t nowMicros() const
+	{
+		return micros64() + offset;
+	}
+
+	// Unix time in microseconds of the last sync.
+	uint64_t lastSyncMicros() const
+	{
+		return syncedAt + offset;
+	}
+
+	// Seconds since the last sync, or UINT32_MAX if there has been none.
+	uint32_t sinceSync() const
+	{
+		return synced ? (micros64() - syncedAt) / 1000000 : UINT32_MAX;
+	}
+};
+
+extern WallClock Clock;
+
+#endif // _WALLCLOCK_h
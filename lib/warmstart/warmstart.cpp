@@ -0,0 +1,80 @@
+#include "warmstart.h"
+#include <user_interface.h>
+
+// The layout of the record is part of the magic number, so that a snapshot
+// saved by firmware with a different one is not loaded after an update.
+#define WARMSTART_MAGIC (0x4d524157 ^ sizeof(WarmStartRecord))
+
+static_assert(sizeof(WarmStartRecord) % 4 == 0, "WarmStartRecord must be a whole number of RTC memory blocks");
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+	uint32_t crc = 0xffffffff;
+
+	while (len--) {
+		crc ^= *data++;
+		for (uint8_t bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static uint32_t recordCrc(const WarmStartRecord &record)
+{
+	const uint8_t *start = (const uint8_t *)&record.rtcTicks;
+	return crc32(start, (const uint8_t *)(&record + 1) - start);
+}
+
+void WarmStart::save(const WarmStartState &state)
+{
+	WarmStartRecord record;
+
+	record.magic = WARMSTART_MAGIC;
+	record.rtcTicks = system_get_rtc_time();
+	record.rtcPeriod = system_rtc_clock_cali_proc();
+	record.state = state;
+	record.crc = recordCrc(record);
+	ESP.rtcUserMemoryWrite(WARMSTART_RTC_BLOCK, (uint32_t *)&record, sizeof(record));
+}
+
+bool WarmStart::load(WarmStartState &state)
+{
+	WarmStartRecord record;
+
+	// A power-on or an external reset stops the RTC timer.
+	switch (ESP.getResetInfoPtr()->reason) {
+	case REASON_SOFT_RESTART:
+	case REASON_WDT_RST:
+	case REASON_EXCEPTION_RST:
+	case REASON_SOFT_WDT_RST:
+		break;
+	default:
+		return false;
+	}
+	if (!ESP.rtcUserMemoryRead(WARMSTART_RTC_BLOCK, (uint32_t *)&record, sizeof(record)) ||
+	    record.magic != WARMSTART_MAGIC || record.crc != recordCrc(record))
+		return false;
+
+	// The RTC timer wraps after some hours, which the age limit allows
+	// for. Its period drifts with temperature, so use the average of the
+	// period then and now.
+	uint32_t ticks = system_get_rtc_time() - record.rtcTicks;
+	uint32_t period = (record.rtcPeriod + system_rtc_clock_cali_proc()) / 2;
+	uint64_t elapsed = ((uint64_t)ticks * period) >> 12;
+	if (elapsed > (uint64_t)WARMSTART_MAX_AGE_S * 1000000)
+		return false;
+
+	state = record.state;
+	state.utcMicros += elapsed;
+	if (state.syncAge != UINT32_MAX)
+		state.syncAge += elapsed / 1000000;
+	loadedAge = elapsed / 1000;
+	return true;
+}
+
+void WarmStart::clear()
+{
+	WarmStartRecord record = {};
+
+	ESP.rtcUserMemoryWrite(WARMSTART_RTC_BLOCK, (uint32_t *)&record, sizeof(record));
+}
@@ -0,0 +1,78 @@
+/*
+ * warmstart.h - clock state kept across a warm restart
+ *
+ * A software restart, an OTA update or a watchdog reset clears RAM but
+ * neither the RTC user memory nor the ESP8266's RTC timer, which keeps
+ * counting through the reset. A snapshot of the wall clock taken together
+ * with the RTC timer therefore tells the next boot the current time to
+ * within a few milliseconds, without waiting for the BQ32000, which only
+ * gives whole seconds, or for NTP. The snapshot also carries the state that
+ * would otherwise have to be relearned. It is protected by a CRC, and is
+ * trusted only after a reset that leaves the RTC timer running.
+ */
+
+#ifndef _WARMSTART_h
+#define _WARMSTART_h
+
+#include <Arduino.h>
+
+// First block of RTC user memory used, after the StallRecord.
+#define WARMSTART_RTC_BLOCK 48
+// A snapshot older than this is not trusted. The RTC timer runs from an
+// internal oscillator that is only calibrated to within a fraction of a
+// percent.
+#define WARMSTART_MAX_AGE_S 300
+
+struct WarmStartState {
+	// Unix time in microseconds.
+	uint64_t utcMicros;
+	// Seconds since the last NTP sync, or UINT32_MAX if there was none.
+	uint32_t syncAge;
+	// The last NTP sync's correction, its average change from one sync to
+	// the next, its round trip time and its reference ID.
+	int32_t ntpOffsetMicros;
+	uint32_t ntpJitterMicros;
+	uint32_t ntpDelayMicros;
+	uint32_t ntpRefId;
+	// Where the time was set from, and the display slot chosen with the
+	// touch sensor.
+	uint8_t timeSource;
+	uint8_t displaySlot;
+	uint8_t reserved[2];
+};
+
+struct WarmStartRecord {
+	uint32_t magic;
+	// CRC-32 of everything after it.
+	uint32_t crc;
+	// The RTC timer and its period in microseconds, as a 20.12 fixed point
+	// number, when the snapshot was taken.
+	uint32_t rtcTicks;
+	uint32_t rtcPeriod;
+	WarmStartState state;
+};
+
+class WarmStart {
+	uint32_t loadedAge = 0;
+
+    public:
+	// Save 'state', which must be as of now. This is cheap enough to call
+	// every second, and safe to call as the chip resets.
+	void save(const WarmStartState &state);
+
+	// Load the snapshot saved before the reset that started this boot into
+	// 'state', with its time advanced to the present. Returns false if
+	// there is none that can be trusted.
+	bool load(WarmStartState &state);
+
+	// Invalidate the snapshot, so that the next boot is a cold one.
+	void clear();
+
+	// Age in milliseconds of the snapshot when it was loaded.
+	uint32_t age() const
+	{
+		return loadedAge;
+	}
+};
+
+#endif // _WARMSTART_h
@@ -0,0 +1,295 @@
+#include "wifiroam.h"
+#include "log.h"
+
+static uint8_t reasonBucket(uint8_t reason)
+{
+	if (reason >= 1 && reason <= 24)
+		return reason;
+	if (reason >= 200 && reason < 200 + WIFI_REASON_BUCKETS - 25)
+		return reason - 200 + 25;
+	return 0;
+}
+
+uint8_t WifiRoamer::bucketReason(uint8_t bucket)
+{
+	if (bucket >= 25)
+		return bucket - 25 + 200;
+	return bucket;
+}
+
+void WifiRoamer::setNetwork(uint8_t i, const char *ssid, const char *password)
+{
+	if (i >= WIFI_NETWORKS_MAX)
+		return;
+	ssids[i] = ssid;
+	passwords[i] = password;
+}
+
+bool WifiRoamer::configured(uint8_t i) const
+{
+	return ssids[i] && ssids[i][0] != '\0' && passwords[i] && passwords[i][0] != '\0';
+}
+
+void WifiRoamer::begin()
+{
+	leave();
+	failures = 0;
+	backoff = 0;
+
+	for (uint8_t i = 0; i < WIFI_NETWORKS_MAX; i++) {
+		if (configured(i)) {
+			startScan();
+			return;
+		}
+	}
+	enter(WIFI_IDLE);
+}
+
+void WifiRoamer::poll()
+{
+	uint32_t now = millis();
+	int8_t results;
+
+	switch (state) {
+	case WIFI_IDLE:
+		break;
+	case WIFI_BACKOFF:
+		if (now - since >= backoff)
+			startScan();
+		break;
+	case WIFI_SCANNING:
+		results = WiFi.scanComplete();
+		if (results != WIFI_SCAN_RUNNING) {
+			scanned(results);
+		} else if (now - since >= WIFI_CONNECT_TIMEOUT_MS) {
+			LOG_WARN(WIFI, "[Wi-Fi] Scan timed out.");
+			fail();
+		}
+		break;
+	case WIFI_CONNECTING:
+		if (now - since >= WIFI_CONNECT_TIMEOUT_MS) {
+			LOG_WARN(WIFI, "[Wi-Fi] Timed out connecting to \"%s\".", network());
+			leave();
+			fail();
+		}
+		break;
+	case WIFI_ONLINE:
+		if (roamScan) {
+			results = WiFi.scanComplete();
+			if (results != WIFI_SCAN_RUNNING) {
+				roamScan = false;
+				roam(results);
+			}
+			break;
+		}
+		// The SDK reports 31 when it has no RSSI to give.
+		int32_t rssi = WiFi.RSSI();
+		if (rssi >= WIFI_ROAM_RSSI_DBM || rssi == 31) {
+			weakSince = 0;
+			break;
+		}
+		if (weakSince == 0)
+			weakSince = now | 1;
+		if (now - weakSince >= WIFI_ROAM_HOLD_MS && now - lastRoamScan >= WIFI_ROAM_SCAN_INTERVAL_MS) {
+			LOG_INFO(WIFI, "[Wi-Fi] Signal weak at %d dBm, looking for a better access point.", rssi);
+			lastRoamScan = now;
+			stats.scans++;
+			roamScan = true;
+			WiFi.scanNetworks(true, false);
+		}
+		break;
+	}
+}
+
+void WifiRoamer::gotIP()
+{
+	uint32_t now = millis();
+	uint32_t took = now - attemptStart;
+
+	if (state == WIFI_ONLINE)
+		return;
+	stats.connects++;
+	stats.totalConnectMillis += took;
+	if (took > stats.maxConnectMillis)
+		stats.maxConnectMillis = took;
+	failures = 0;
+	backoff = 0;
+	onlineSince = now;
+	weakSince = 0;
+	// The access point was just chosen as the strongest.
+	lastRoamScan = now;
+	enter(WIFI_ONLINE);
+	LOG_INFO(WIFI, "[Wi-Fi] Online after %u ms.", took);
+}
+
+void WifiRoamer::disconnected(uint8_t reason)
+{
+	if (leaving) {
+		leaving = false;
+		return;
+	}
+	if (state == WIFI_ONLINE) {
+		stats.reasons[reasonBucket(reason)]++;
+		stats.disconnects++;
+		stats.onlineMillis += millis() - onlineSince;
+		roamScan = false;
+		retry();
+	} else if (state == WIFI_CONNECTING) {
+		stats.reasons[reasonBucket(reason)]++;
+		fail();
+	}
+}
+
+uint64_t WifiRoamer::onlineMillis() const
+{
+	if (state == WIFI_ONLINE)
+		return stats.onlineMillis + (millis() - onlineSince);
+	return stats.onlineMillis;
+}
+
+/*
+ * Return the index of the strongest scan result for a configured network,
+ * and store which network it is into 'network', or return -1 if none of
+ * them were found.
+ */
+int8_t WifiRoamer::strongest(int8_t results, uint8_t &network) const
+{
+	int8_t best = -1;
+	int32_t bestRssi = 0;
+
+	for (int8_t i = 0; i < results; i++) {
+		// Read the SDK's record rather than WiFi.SSID(), which copies
+		// the SSID into a String on the heap.
+		const bss_info *info = (const bss_info *)WiFi.getScanInfoByIndex(i);
+		if (!info)
+			continue;
+		for (uint8_t k = 0; k < WIFI_NETWORKS_MAX; k++) {
+			if (!configured(k) || strlen(ssids[k]) != info->ssid_len ||
+			    memcmp(info->ssid, ssids[k], info->ssid_len) != 0)
+				continue;
+			if (best < 0 || info->rssi > bestRssi) {
+				best = i;
+				bestRssi = info->rssi;
+				network = k;
+			}
+			break;
+		}
+	}
+	return best;
+}
+
+void WifiRoamer::enter(WifiState s)
+{
+	state = s;
+	since = millis();
+}
+
+void WifiRoamer::startScan()
+{
+	attemptStart = millis();
+	stats.scans++;
+	roamScan = false;
+	WiFi.scanNetworks(true, false);
+	enter(WIFI_SCANNING);
+}
+
+/*
+ * Join the strongest configured network found by the scan. If none was
+ * found, which is also the case for networks that hide their SSID, or the
+ * scan failed, try the configured networks in turn without pinning an
+ * access point.
+ */
+void WifiRoamer::scanned(int8_t results)
+{
+	uint8_t network = current;
+	int8_t best = strongest(results, network);
+
+	if (best >= 0) {
+		const uint8_t *bssid = WiFi.BSSID(best);
+		LOG_INFO(WIFI, "[Wi-Fi] Joining \"%s\" at BSSID %02X:%02X:%02X:%02X:%02X:%02X, channel %d, RSSI %d dBm.",
+			 ssids[network], bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5],
+			 WiFi.channel(best), WiFi.RSSI(best));
+		join(network, WiFi.channel(best), bssid);
+	} else {
+		for (uint8_t i = 1; i <= WIFI_NETWORKS_MAX; i++) {
+			network = (current + i) % WIFI_NETWORKS_MAX;
+			if (configured(network))
+				break;
+		}
+		LOG_INFO(WIFI, "[Wi-Fi] No configured network found by the scan, trying \"%s\".", ssids[network]);
+		join(network, 0, nullptr);
+	}
+	WiFi.scanDelete();
+}
+
+/*
+ * Move to the strongest access point found by a scan while connected, if it
+ * is a different one and clearly stronger than the current one.
+ */
+void WifiRoamer::roam(int8_t results)
+{
+	uint8_t network = current;
+	int8_t best = strongest(results, network);
+	int32_t rssi = WiFi.RSSI();
+
+	if (best >= 0 && memcmp(WiFi.BSSID(best), WiFi.BSSID(), 6) != 0 && WiFi.RSSI(best) >= rssi + WIFI_ROAM_MARGIN_DB) {
+		const uint8_t *bssid = WiFi.BSSID(best);
+		LOG_INFO(WIFI, "[Wi-Fi] Roaming from %d dBm to \"%s\" at BSSID %02X:%02X:%02X:%02X:%02X:%02X, channel %d, RSSI %d dBm.",
+			 rssi, ssids[network], bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5],
+			 WiFi.channel(best), WiFi.RSSI(best));
+		stats.roams++;
+		leave();
+		attemptStart = millis();
+		join(network, WiFi.channel(best), bssid);
+	} else {
+		LOG_INFO(WIFI, "[Wi-Fi] No better access point found.");
+	}
+	WiFi.scanDelete();
+}
+
+void WifiRoamer::join(uint8_t network, int32_t channel, const uint8_t *bssid)
+{
+	current = network;
+	stats.attempts++;
+	WiFi.begin(ssids[network], passwords[network], channel, bssid);
+	enter(WIFI_CONNECTING);
+}
+
+/*
+ * Drop the current connection or attempt. A connected station reports the
+ * disconnect as an event, which is then not counted as a lost connection.
+ */
+void WifiRoamer::leave()
+{
+	if (state == WIFI_ONLINE)
+		stats.onlineMillis += millis() - onlineSince;
+	if (WiFi.status() == WL_CONNECTED)
+		leaving = true;
+	roamScan = false;
+	WiFi.disconnect();
+	enter(WIFI_IDLE);
+}
+
+void WifiRoamer::fail()
+{
+	stats.failures++;
+	if (failures < UINT8_MAX)
+		failures++;
+	retry();
+}
+
+/*
+ * Wait before the next attempt. The limit doubles with every consecutive
+ * failure, and the wait is drawn at random from its upper half.
+ */
+void WifiRoamer::retry()
+{
+	uint8_t shift = failures < 10 ? failures : 10;
+	uint32_t limit = (uint32_t)WIFI_BACKOFF_MIN_MS << shift;
+
+	if (limit > WIFI_BACKOFF_MAX_MS)
+		limit = WIFI_BACKOFF_MAX_MS;
+	backoff = limit / 2 + random(limit / 2 + 1);
+	enter(WIFI_BACKOFF);
+	LOG_INFO(WIFI, "[Wi-Fi] Retrying in %u ms.", backoff);
+}
@@ -0,0 +1,149 @@
+/*
+ * wifiroam.h - Wi-Fi network selection, reconnection and roaming
+ *
+ * Up to WIFI_NETWORKS_MAX networks can be configured. Every connection
+ * attempt starts with one scan and joins the access point with the
+ * strongest signal that carries any of them, pinned by BSSID and channel so
+ * that the SDK does not wander off to a weaker one. Failed attempts and lost
+ * connections are retried after an exponential backoff with random jitter,
+ * so that clocks which lose the same access point do not all come back at
+ * the same moment. While connected, a signal that stays below
+ * WIFI_ROAM_RSSI_DBM starts a scan, and the clock moves to an access point
+ * that is clearly stronger if there is one.
+ *
+ * The SDK's own automatic reconnection must be turned off, as it would fight
+ * with this.
+ */
+
+#ifndef _WIFIROAM_h
+#define _WIFIROAM_h
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#define WIFI_NETWORKS_MAX 3
+// An attempt that has not got an IP address within this long has failed.
+#define WIFI_CONNECT_TIMEOUT_MS 20000
+// The backoff doubles after every failed attempt, between these bounds.
+#define WIFI_BACKOFF_MIN_MS 1000
+#define WIFI_BACKOFF_MAX_MS 300000
+// Look for a better access point once the signal has stayed below
+// WIFI_ROAM_RSSI_DBM for WIFI_ROAM_HOLD_MS, at most once every
+// WIFI_ROAM_SCAN_INTERVAL_MS, and move only to one at least
+// WIFI_ROAM_MARGIN_DB stronger.
+#define WIFI_ROAM_RSSI_DBM (-75)
+#define WIFI_ROAM_HOLD_MS 30000
+#define WIFI_ROAM_SCAN_INTERVAL_MS 300000
+#define WIFI_ROAM_MARGIN_DB 8
+// Disconnect reasons are counted in buckets: 1 to 24 for the 802.11 reason
+// codes, 25 onwards for the SDK's own codes from 200, and 0 for any other.
+#define WIFI_REASON_BUCKETS 32
+
+enum WifiState : uint8_t {
+	WIFI_IDLE,
+	WIFI_SCANNING,
+	WIFI_CONNECTING,
+	WIFI_ONLINE,
+	WIFI_BACKOFF,
+};
+
+struct WifiStats {
+	uint32_t scans;
+	uint32_t attempts;
+	uint32_t connects;
+	uint32_t failures;
+	// Connections lost after getting an IP address.
+	uint32_t disconnects;
+	uint32_t roams;
+	// Time from the start of an attempt, including its scan, to getting an
+	// IP address.
+	uint32_t maxConnectMillis;
+	uint64_t totalConnectMillis;
+	// Time spent connected, not counting the current connection.
+	uint64_t onlineMillis;
+	uint16_t reasons[WIFI_REASON_BUCKETS];
+};
+
+class WifiRoamer {
+	const char *ssids[WIFI_NETWORKS_MAX] = {};
+	const char *passwords[WIFI_NETWORKS_MAX] = {};
+	WifiState state = WIFI_IDLE;
+	// The network of the current or latest attempt.
+	uint8_t current = 0;
+	// Failed attempts since the last connection, which set the backoff.
+	uint8_t failures = 0;
+	// Whether a scan for roaming is running while connected.
+	bool roamScan = false;
+	// Whether the next disconnect was caused by leaving an access point.
+	bool leaving = false;
+	uint32_t since = 0;
+	uint32_t attemptStart = 0;
+	uint32_t backoff = 0;
+	uint32_t onlineSince = 0;
+	uint32_t weakSince = 0;
+	uint32_t lastRoamScan = 0;
+	WifiStats stats = {};
+
+    public:
+	// Set network 'i' to the given strings, which must stay valid. A
+	// network without both an SSID and a password is not used.
+	void setNetwork(uint8_t i, const char *ssid, const char *password);
+
+	// Drop any connection and start over with a scan, e.g. after the
+	// networks have changed.
+	void begin();
+
+	// Advance scans, attempts and backoff, and check whether to roam.
+	void poll();
+
+	// Report the station's events. These are called from the Wi-Fi event
+	// handlers.
+	void gotIP();
+	void disconnected(uint8_t reason);
+
+	WifiState getState() const
+	{
+		return state;
+	}
+
+	// The SSID of the network of the current or latest attempt.
+	const char *network() const
+	{
+		return ssids[current] ? ssids[current] : "";
+	}
+
+	// Consecutive failed attempts, and the current backoff.
+	uint8_t failedAttempts() const
+	{
+		return failures;
+	}
+	uint32_t backoffMillis() const
+	{
+		return backoff;
+	}
+
+	// Total time spent connected, including the current connection.
+	uint64_t onlineMillis() const;
+
+	const WifiStats &getStats() const
+	{
+		return stats;
+	}
+
+	// The reason code counted in a bucket of WifiStats.reasons, or 0.
+	static uint8_t bucketReason(uint8_t bucket);
+
+    private:
+	bool configured(uint8_t i) const;
+	int8_t strongest(int8_t results, uint8_t &network) const;
+	void enter(WifiState s);
+	void startScan();
+	void scanned(int8_t results);
+	void roam(int8_t results);
+	void join(uint8_t network, int32_t channel, const uint8_t *bssid);
+	void leave();
+	void fail();
+	void retry();
+};
+
+#endif // _WIFIROAM_h
@@ -0,0 +1,28 @@
+# PlatformIO extra script for over-the-air updates.
+#
+# After every build the firmware image is compressed with gzip next to the
+# uncompressed one, and the SHA-256 of the compressed image, which the 'ota'
+# command expects, is printed. The bootloader inflates the compressed image
+# when it installs it.
+
+Import("env")
+
+import gzip
+import hashlib
+import os
+
+
+def compress_image(source, target, env):
+    image = target[0].get_abspath()
+    compressed = image + ".gz"
+    with open(image, "rb") as f:
+        data = f.read()
+    # A fixed mtime keeps the output, and so its hash, reproducible.
+    packed = gzip.compress(data, compresslevel=9, mtime=0)
+    with open(compressed, "wb") as f:
+        f.write(packed)
+    print("Compressed image: %s, %d bytes (%d%% of the original)" % (compressed, len(packed), len(packed) * 100 // len(data)))
+    print("Install it with: ota %s" % hashlib.sha256(packed).hexdigest())
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", compress_image)
@@ -0,0 +1,78 @@
+# PlatformIO extra script for the time zone database.
+#
+# If the build environment sets 'custom_tz_zones' to a list of time zone
+# names, a registry holding only those zones is generated into the build
+# directory and linked instead of the complete AceTime registry. The zones
+# that are not referenced are then discarded by the linker.
+#
+# After every build the size of the firmware image and the time it takes to
+# upload it at the configured upload speed are printed.
+
+Import("env")
+
+import os
+
+
+def zone_symbol(name):
+    # AceTime's naming of the ZoneInfo symbol for a zone or link.
+    return "kZone" + name.replace("+", "_PLUS_").replace("/", "_").replace("-", "_")
+
+
+def zone_id(name):
+    # AceTime's zone ID, the djb2 hash of the zone name. The registry is
+    # sorted by it so that zones are found with a binary search.
+    h = 5381
+    for c in name.encode():
+        h = (h * 33 + c) & 0xFFFFFFFF
+    return h
+
+
+def generate_registry(zones):
+    out_dir = os.path.join(env.subst("$BUILD_DIR"), "tzdb")
+    out_file = os.path.join(out_dir, "tz_registry.h")
+    lines = [
+        "// Generated by scripts/tzdb.py from custom_tz_zones. Do not edit.",
+        "",
+        "#ifndef _TZ_REGISTRY_h",
+        "#define _TZ_REGISTRY_h",
+        "",
+        "#include <AceTime.h>",
+        "",
+        "typedef decltype(&ace_time::zonedbx::kZoneEtc_UTC) TzZoneInfoPtr;",
+        "",
+        "static const TzZoneInfoPtr kTzRegistry[] ACE_TIME_PROGMEM = {",
+    ]
+    for name in sorted(zones, key=zone_id):
+        lines.append("\t&ace_time::zonedbx::%s, // %s" % (zone_symbol(name), name))
+    lines += [
+        "};",
+        "",
+        "static const uint16_t kTzRegistrySize = sizeof(kTzRegistry) / sizeof(kTzRegistry[0]);",
+        "",
+        "#endif // _TZ_REGISTRY_h",
+        "",
+    ]
+    content = "\n".join(lines)
+
+    # Only rewrite the header when it changes, to avoid needless rebuilds.
+    os.makedirs(out_dir, exist_ok=True)
+    if not os.path.exists(out_file) or open(out_file).read() != content:
+        with open(out_file, "w") as f:
+            f.write(content)
+
+    env.Append(CPPPATH=[out_dir], CPPDEFINES=["TZ_TRIMMED_REGISTRY"])
+    print("Time zone database trimmed to %d zones: %s" % (len(zones), " ".join(zones)))
+
+
+def report_size(source, target, env):
+    size = os.path.getsize(target[0].get_abspath())
+    speed = int(env.GetProjectOption("upload_speed", "115200"))
+    # Ten bits on the wire per byte, ignoring esptool's compression.
+    print("Firmware image: %d bytes, about %.1f s to upload at %d baud" % (size, size * 10.0 / speed, speed))
+
+
+zones = env.GetProjectOption("custom_tz_zones", "").split()
+if zones:
+    generate_registry(zones)
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", report_size)
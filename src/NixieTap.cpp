@@ -6,6 +6,21 @@
 #include <NtpClientLib.h>
 #include <TimeLib.h>
 #include <EEPROM.h>
+#include <log.h>
+#include <alloccount.h>
+#include <tztable.h>
+#include <alarms.h>
+#include <wallclock.h>
+#include <sntpserver.h>
+#include <metrics.h>
+#include <latency.h>
+#include <jsonwriter.h>
+#include <ota.h>
+#include <tasks.h>
+#include <stall.h>
+#include <timecode.h>
+#include <wifiroam.h>
+#include <warmstart.h>
 
 using namespace ace_time;
 
@@ -16,154 +31,600 @@ IRAM_ATTR void irq_1Hz_int();
 IRAM_ATTR void touchButtonPressed();
 
 const char *wifiDisconnectReasonStr(const enum WiFiDisconnectReason);
+void abortConfigBatch();
+void applyConfig(uint8_t);
 void connectWiFi();
 void enableSecDot();
 void firstRunInit();
+void loadAlarms();
 void loadTimeZone();
-void parseSerialSet(String);
+void loadWear();
+void loadWorldZones();
+time_t ntpSyncProvider();
+void parseConfig(const char *);
+void parseOta(const char *);
+void parseSerialSet(const char *);
+void parseSchedule(const char *);
+void printSchedule();
+void printBenchmarks();
+void printConfig();
+void printDisplayStats();
 void printESPInfo();
+void printLog(unsigned int);
+void printRtcStats();
+void printSntpStats();
+void printStallInfo();
+void printStatusJson();
+void printTicker();
+void printTimeCodeStats();
 void printTime(time_t);
+void printTimestamp(time_t, int16_t);
+void printTzTable();
+void printWear();
+void printWifiStats();
 void processSyncEvent(NTPSyncEvent_t);
+void printTaskStats();
 void readAndParseSerial();
 void readConfigButton();
 void readParameters();
+void rescheduleAlarms();
 void resetEepromToDefault();
+bool resumeWarmStart();
+uint32_t runConsoleTask();
+uint32_t runDisplayTask();
+uint32_t runInputTask();
+uint32_t runNetworkTask();
+uint32_t runTimeCodeTask();
+uint32_t runTimeTask();
+void runAlarm(const AlarmRule &);
+void saveAlarms();
+void saveWarmStart();
+void saveWear();
+void sendMetrics();
 void setSystemTimeFromRTC();
 void setupWiFi();
 void startNTPClient();
 void stopNTPClient();
+void updateBlanking(time_t);
+void updateMetrics();
+void updateSntpServer();
+void updateSntpStatus();
+bool updateTzTable(TzTable &, const TimeZone &, time_t, bool);
+void updateTzTables(time_t);
+int32_t zoneOffset(const TimeZone &, const TzTable &, time_t);
 
 volatile bool dot_state = LOW;
 volatile bool touch_button_pressed = false;
 bool stopDef = false, secDotDef = false;
-bool serialTicker = false;
+// Lines per second printed by the serial ticker, or 0 if it is off, and
+// the number of the last tick printed.
+uint8_t tickerRate = 0;
+uint64_t tickerLast = 0;
 bool ntpInitialized = false;
 bool syncEventTriggered = false;
 
 time_t current_time;
 time_t last_printed_time;
+unsigned long last_wear_save;
+unsigned long last_warm_save;
+unsigned long last_touch;
+unsigned long last_metrics;
+// Where the system time was last set from: "rtc", "ntp" or "manual".
+const char *time_source = "none";
+// The time sources, numbered for the warm restart snapshot.
+const char *const TIME_SOURCES[] = { "none", "rtc", "ntp", "manual" };
+// Whether this boot resumed from the warm restart snapshot.
+bool warmBoot = false;
 
 uint8_t configButton = 0;
 uint32_t buttonCounter;
 volatile uint8_t state = 0, dotPosition = 0b10;
 NTPSyncEvent_t ntpEvent;
-String serialCommand = "";
+char serialCommand[128];
+size_t serialCommandLen = 0;
+// Whether 'set' commands are being batched by 'config begin', and the
+// subsystems to restart when the batch is committed.
+bool configBatch = false;
+uint8_t configPending = 0;
 
 char cfg_ssid[50] = "\0";
 char cfg_password[50] = "\0";
+// Additional Wi-Fi networks, tried when they have a stronger signal.
+char cfg_ssid2[50] = "\0";
+char cfg_password2[50] = "\0";
+char cfg_ssid3[50] = "\0";
+char cfg_password3[50] = "\0";
 char cfg_ntp_server[50] = "\0";
 char cfg_time_zone[50] = "\0";
+char cfg_world_zones[150] = "\0";
+char cfg_metrics_host[50] = "\0";
+char cfg_ota_url[100] = "\0";
 uint8_t cfg_24hr_enabled = 1;
 uint8_t cfg_ntp_enabled = 1;
+uint8_t cfg_display_timer = 0;
+uint8_t cfg_sntp_server = 0;
+uint8_t cfg_time_code = 0;
+uint16_t cfg_night_start = 0;
+uint16_t cfg_night_end = 0;
+uint16_t cfg_idle_timeout = 0;
+uint16_t cfg_wake_time = 30;
+uint16_t cfg_metrics_interval = 10;
 uint32_t cfg_ntp_sync_interval = 3671;
 
 #define DEFAULT__24HR_ENABLED		1
 #define DEFAULT__NTP_ENABLED		1
+#define DEFAULT__DISPLAY_TIMER		0
+#define DEFAULT__SNTP_SERVER		0
+#define DEFAULT__TIME_CODE		0
+#define DEFAULT__NIGHT_START		0
+#define DEFAULT__NIGHT_END		0
+#define DEFAULT__IDLE_TIMEOUT		0
+#define DEFAULT__WAKE_TIME		30
+#define DEFAULT__METRICS_INTERVAL	10
 #define DEFAULT__NTP_SERVER		"time.google.com"
 #define DEFAULT__NTP_SYNC_INTERVAL	3671
 #define DEFAULT__TIME_ZONE		"America/New_York"
+#define DEFAULT__WORLD_ZONES		""
+#define DEFAULT__METRICS_HOST		""
+#define DEFAULT__OTA_URL		""
 
 #define EEPROM_ADDR__24HR_ENABLED	10	// 1 byte
 #define EEPROM_ADDR__NTP_ENABLED	11	// 1 byte
+#define EEPROM_ADDR__DISPLAY_TIMER	12	// 1 byte
+#define EEPROM_ADDR__SNTP_SERVER	13	// 1 byte
+#define EEPROM_ADDR__NIGHT_START	14	// 2 bytes
+#define EEPROM_ADDR__NIGHT_END		16	// 2 bytes
+#define EEPROM_ADDR__IDLE_TIMEOUT	18	// 2 bytes
+#define EEPROM_ADDR__WAKE_TIME		20	// 2 bytes
+#define EEPROM_ADDR__METRICS_INTERVAL	22	// 2 bytes
+#define EEPROM_ADDR__TIME_CODE		24	// 1 byte
 #define EEPROM_ADDR__NTP_SYNC_INTERVAL	50	// 4 bytes
 #define EEPROM_ADDR__SSID		100	// 50 bytes
 #define EEPROM_ADDR__PASSWORD		150	// 50 bytes
 #define EEPROM_ADDR__NTP_SERVER		200	// 50 bytes
 #define EEPROM_ADDR__TIME_ZONE		250	// 50 bytes
+#define EEPROM_ADDR__SSID2		300	// 50 bytes
+#define EEPROM_ADDR__PASSWORD2		350	// 50 bytes
+#define EEPROM_ADDR__SSID3		400	// 50 bytes
+#define EEPROM_ADDR__PASSWORD3		450	// 50 bytes
 #define EEPROM_ADDR__MAGIC		500	// 8 bytes
-
+#define EEPROM_ADDR__WEAR		512	// 4 + 4 * NIXIE_TUBES * NIXIE_DIGITS bytes
+#define EEPROM_ADDR__TZ_TABLE		1024	// sizeof(TzTable) bytes
+#define EEPROM_ADDR__WORLD_ZONES	1400	// 150 bytes
+#define EEPROM_ADDR__ALARMS		1560	// 4 + 1 + 4 * ALARM_MAX bytes
+#define EEPROM_ADDR__METRICS_HOST	1600	// 50 bytes
+#define EEPROM_ADDR__OTA_URL		1650	// 100 bytes
+
+#define EEPROM_SIZE			2048
 #define EEPROM_MAGIC			0x4e49584945544150
-
-static const int TZ_CACHE_SIZE = 1;
+#define EEPROM_WEAR_MAGIC		0x52414557
+#define EEPROM_ALARMS_MAGIC		0x4d52414c
+
+// How often the cathode wear counters are saved to non-volatile memory.
+#define WEAR_SAVE_INTERVAL_MS		(6 * 60 * 60 * 1000UL)
+
+// How often the clock is saved to RTC user memory for a warm restart.
+#define WARM_SAVE_INTERVAL_MS		1000
+
+// Highest rate of the serial ticker, in lines per second. The console task
+// runs every CONSOLE_TASK_INTERVAL_MS.
+#define TICKER_RATE_MAX			50
+
+// Subsystems that have to be restarted after settings change, as passed to
+// applyConfig().
+#define CONFIG_APPLY_DISPLAY		0x01
+#define CONFIG_APPLY_TIME_ZONE		0x02
+#define CONFIG_APPLY_WORLD_ZONES	0x04
+#define CONFIG_APPLY_WIFI		0x08
+#define CONFIG_APPLY_NTP		0x10
+#define CONFIG_APPLY_SNTP		0x20
+#define CONFIG_APPLY_METRICS		0x40
+#define CONFIG_APPLY_TIME_CODE		0x80
+
+// Number of log messages shown by the 'log' command without an argument.
+#define LOG_HISTORY_LINES		20
+
+// Version of the layout of the 'status json' output. Bump it whenever a
+// field is renamed, moved or removed; adding a field does not need it.
+#define STATUS_JSON_SCHEMA		1
+#define STATUS_JSON_SIZE		1792
+
+// How often each task of the main loop runs, and how late a run may start
+// before it counts as a deadline miss, in milliseconds. The display task
+// is also woken by the second and touch interrupts, and sleeps for
+// BLANK_LOOP_DELAY_MS instead while the tubes are blanked.
+#define TIME_CODE_TASK_DEADLINE_MS	1
+#define DISPLAY_TASK_INTERVAL_MS	10
+#define DISPLAY_TASK_DEADLINE_MS	5
+#define INPUT_TASK_INTERVAL_MS		20
+#define INPUT_TASK_DEADLINE_MS		20
+#define TIME_TASK_INTERVAL_MS		100
+#define TIME_TASK_DEADLINE_MS		100
+#define NETWORK_TASK_INTERVAL_MS	100
+#define NETWORK_TASK_DEADLINE_MS	500
+#define CONSOLE_TASK_INTERVAL_MS	10
+#define CONSOLE_TASK_DEADLINE_MS	100
+
+// Longest pass of the main loop, in milliseconds, that is not reported as a
+// stall. The software watchdog resets the chip after about 3 seconds.
+#define STALL_THRESHOLD_MS		250
+
+// How long the display task sleeps while the tubes are blanked.
+#define BLANK_LOOP_DELAY_MS		50
+
+// Most time zones that can be shown besides the local one.
+#define WORLD_ZONES_MAX			3
+
+// NtpClientLib does not report the stratum of the server it syncs with, so
+// assume a stratum 2 server, as most public and local ones are, and serve
+// stratum 3. Claiming a lower stratum than the true one could make clients
+// prefer this clock over better ones.
+#define SNTP_UPSTREAM_STRATUM		2
+
+// Time since the last NTP sync after which the SNTP server reports itself as
+// unsynchronised.
+#define SNTP_MAX_SYNC_AGE		(24 * 60 * 60UL)
+
+// NtpClientLib truncates the time it receives to whole seconds, which leaves
+// up to a second of error. The time is taken to be in the middle of that
+// second, so the remaining error is at most half a second.
+#define SNTP_SYNC_DISPERSION_US		500000
+
+// Frequency tolerance assumed for the ESP8266's crystal, which adds to the
+// error of the clock as the last sync ages.
+#define SNTP_DRIFT_PPM			50
+
+// Longest interval between metrics reports, in seconds.
+#define METRICS_INTERVAL_MAX		3600
+
+// Dots identifying each world clock slot.
+static const uint8_t WORLD_ZONE_DOTS[WORLD_ZONES_MAX] = { 0b10, 0b110, 0b1110 };
+
+// One zone processor for the local time zone and one for each world zone.
+static const int TZ_CACHE_SIZE = 1 + WORLD_ZONES_MAX;
 static ExtendedZoneProcessorCache<TZ_CACHE_SIZE> zoneProcessorCache;
+#ifdef TZ_TRIMMED_REGISTRY
+// Only the zones listed in custom_tz_zones, see scripts/tzdb.py.
+#include <tz_registry.h>
+static ExtendedZoneManager zoneManager(
+	kTzRegistrySize,
+	kTzRegistry,
+	zoneProcessorCache);
+#else
 static ExtendedZoneManager zoneManager(
 	zonedbx::kZoneAndLinkRegistrySize,
 	zonedbx::kZoneAndLinkRegistry,
 	zoneProcessorCache);
+#endif // TZ_TRIMMED_REGISTRY
 TimeZone time_zone;
+TzTable tzTable;
+TimeZone world_zones[WORLD_ZONES_MAX];
+TzTable worldTzTables[WORLD_ZONES_MAX];
+uint8_t worldZoneCount = 0;
+AlarmScheduler alarms;
+SntpServer sntpServer;
+// Round-trip time and reference ID of the last NTP sync.
+uint32_t ntpDelayMicros = 0;
+uint32_t ntpRefId = 0;
+// Correction made to the wall clock by the last NTP sync, and the average
+// change in the correction from one sync to the next, both saturated at
+// about 35 minutes.
+int32_t ntpOffsetMicros = 0;
+uint32_t ntpJitterMicros = 0;
+MetricsClient metrics;
+OtaUpdater ota;
+// Duration of the passes of the main loop since the last metrics report.
+LatencyHistogram loopLatency;
+TimeCodeOutput timeCode;
+WifiRoamer wifiRoamer;
+WarmStart warmStart;
+// The tasks run by the main loop, added to the scheduler highest priority
+// first. The time code task sleeps until just before each second edge.
+TaskScheduler scheduler;
+Task timeCodeTask("timecode", runTimeCodeTask, TIME_CODE_TASK_DEADLINE_MS);
+Task displayTask("display", runDisplayTask, DISPLAY_TASK_DEADLINE_MS);
+Task inputTask("input", runInputTask, INPUT_TASK_DEADLINE_MS);
+Task timeTask("time", runTimeTask, TIME_TASK_DEADLINE_MS);
+Task networkTask("network", runNetworkTask, NETWORK_TASK_DEADLINE_MS);
+Task consoleTask("console", runConsoleTask, CONSOLE_TASK_DEADLINE_MS);
 
 void setup()
 {
-	Serial.println("\33[2K\r\nNixie Tap is booting!");
+	Serial.begin(115200);
+	LOG_INFO(SYSTEM, "\33[2K\r\nNixie Tap is booting!");
+
+	// Report what the main loop was doing when it last stalled or reset.
+	Stall.begin(STALL_THRESHOLD_MS);
+	Stall.enter("setup");
+	printStallInfo();
+
+	// After a restart, an update or a watchdog reset, carry on with the
+	// clock from before the reset. The progress bar is then left out, and
+	// the time is shown from the first pass of the main loop.
+	warmBoot = resumeWarmStart();
 
 	// Progress bar: 25%.
-	nixieTap.write(10, 10, 10, 10, 0b10);
+	if (!warmBoot) {
+		nixieTap.write(10, 10, 10, 10, 0b10);
+	}
 
 	// Touch button interrupt.
 	attachInterrupt(digitalPinToInterrupt(TOUCH_BUTTON), touchButtonPressed, RISING);
 
 	// Progress bar: 50%.
-	nixieTap.write(10, 10, 10, 10, 0b110);
+	if (!warmBoot) {
+		nixieTap.write(10, 10, 10, 10, 0b110);
+	}
 
 	// Reset EEPROM if uninitialized.
 	firstRunInit();
 
 	// Read all stored parameters from EEPROM.
 	readParameters();
+	loadWear();
+	loadAlarms();
+	nixieTap.setTimerDriver(cfg_display_timer);
+	timeCode.setFormat(cfg_time_code);
 
 	// Setup WiFi station mode settings and begin connection attempt.
 	setupWiFi();
 	connectWiFi();
+	updateSntpServer();
+	updateMetrics();
 
 	// Load time zone.
 	loadTimeZone();
+	loadWorldZones();
 
 	// Progress bar: 75%.
-	nixieTap.write(10, 10, 10, 10, 0b1110);
+	if (!warmBoot) {
+		nixieTap.write(10, 10, 10, 10, 0b1110);
+	}
 
-	// Set the system time from the on-board RTC.
-	setSystemTimeFromRTC();
+	// Set the system time from the on-board RTC, unless it was resumed.
+	if (!warmBoot) {
+		setSystemTimeFromRTC();
+	}
 	printTime(now());
+	rescheduleAlarms();
 
 	enableSecDot();
 
 	// Progress bar: 100%.
-	nixieTap.write(10, 10, 10, 10, 0b11110);
+	if (!warmBoot) {
+		nixieTap.write(10, 10, 10, 10, 0b11110);
+	}
+
+	// Heap allocations are only counted from here on.
+	allocCountReset();
+
+	scheduler.add(timeCodeTask);
+	scheduler.add(displayTask);
+	scheduler.add(inputTask);
+	scheduler.add(timeTask);
+	scheduler.add(networkTask);
+	scheduler.add(consoleTask);
 }
 
 void loop()
 {
-	// Handle an event triggered from the NTP client.
-	if (syncEventTriggered) {
-		processSyncEvent(ntpEvent);
-		syncEventTriggered = false;
+	uint32_t loop_start = micros();
+
+	// Account for the heap allocations made during the previous pass.
+	allocCountLoop();
+
+	// Run the most urgent task that is due, or let the system idle until
+	// the next one is.
+	Stall.beginPass();
+	uint32_t idle = scheduler.runNext();
+	if (Stall.endPass()) {
+		const StallRecord &stall = Stall.lastStall();
+		LOG_WARN(SYSTEM, "[Stall] Main loop pass took %u ms, %u ms of it in stage '%s'.",
+			 stall.passMicros / 1000, stall.stageMicros / 1000, stall.stage);
+	}
+	if (idle > 0) {
+		delay(idle);
+		return;
 	}
 
+	loopLatency.record(micros() - loop_start);
+}
+
+/*
+ * Send the time code at the second edge.
+ */
+uint32_t runTimeCodeTask()
+{
+	Stall.enter("time code");
+	return timeCode.poll();
+}
+
+/*
+ * Show the time, the world clock or the date, depending on the slot chosen
+ * with the touch sensor.
+ */
+uint32_t runDisplayTask()
+{
+	Stall.enter("display");
+
 	// Get the current time and calculate its offset from UTC.
 	current_time = now();
-	int32_t offset = ZonedDateTime::forUnixSeconds64(current_time, time_zone).timeOffset().toSeconds();
+	int32_t offset = zoneOffset(time_zone, tzTable, current_time);
 
-	// State machine.
-	if (state > 1) {
+	// State machine. Slot 0 is the local time, followed by a slot for each
+	// world zone and then the date.
+	if (state > worldZoneCount + 1) {
 		state = 0;
 	}
+	uint8_t slot = state;
+
+	// Print the current time if the touch sensor was pressed. Switching
+	// between zones shows the new time at once; only the switches to and
+	// from the date are animated. A touch while the tubes are blanked only
+	// wakes them up, showing the time.
+	if (touch_button_pressed) {
+		touch_button_pressed = false;
+		last_touch = millis();
+		if (nixieTap.getBlank()) {
+			slot = state = 0;
+		} else if (slot == 0 || slot == worldZoneCount + 1) {
+			nixieTap.setAnimation(true);
+		}
+		printTime(current_time);
+	}
+
+	// Blank or light the tubes.
+	updateBlanking(current_time + offset);
+
+	// An anti-poisoning run shows a frame every WEAR_FRAME_MS until it is
+	// over, and then the tubes go back to the slot.
+	if (nixieTap.exercising()) {
+		uint32_t wait = nixieTap.exerciseStep();
+		if (wait > 0)
+			return wait;
+	}
+
+	// Likewise a slot-machine spin, after which the slot is written again
+	// to show the new digits.
+	if (nixieTap.spinning()) {
+		uint32_t wait = nixieTap.spinStep();
+		if (wait > 0)
+			return wait;
+	}
 
 	// Slot 0 - time
-	if (state == 0) {
+	if (slot == 0 && !nixieTap.getBlank()) {
 		nixieTap.writeTime(current_time + offset, dot_state, cfg_24hr_enabled);
 	}
 
-	// Slot 1 - date
-	if (state == 1) {
+	// Slots 1 to worldZoneCount - world clock
+	if (slot >= 1 && slot <= worldZoneCount && !nixieTap.getBlank()) {
+		const TimeZone &zone = world_zones[slot - 1];
+		int32_t zone_offset = zoneOffset(zone, worldTzTables[slot - 1], current_time);
+		nixieTap.writeZoneTime(current_time + zone_offset, WORLD_ZONE_DOTS[slot - 1], cfg_24hr_enabled);
+	}
+
+	// Last slot - date
+	if (slot == worldZoneCount + 1 && !nixieTap.getBlank()) {
 		nixieTap.writeDate(current_time + offset, 1);
 	}
 
-	// Print the current time if the touch sensor was pressed.
-	if (touch_button_pressed) {
-		touch_button_pressed = false;
-		printTime(current_time);
+	// A spin started above shows its next frame after SLOT_FRAME_MS.
+	if (nixieTap.spinning()) {
+		return SLOT_FRAME_MS;
+	}
+
+	// Nothing needs refreshing while the tubes are blanked.
+	return nixieTap.getBlank() ? BLANK_LOOP_DELAY_MS : DISPLAY_TASK_INTERVAL_MS;
+}
+
+/*
+ * Handle config button presses.
+ */
+uint32_t runInputTask()
+{
+	Stall.enter("input");
+	readConfigButton();
+	return INPUT_TASK_INTERVAL_MS;
+}
+
+/*
+ * Keep the clock, the time zone tables and the scheduled events up to date.
+ */
+uint32_t runTimeTask()
+{
+	// Handle an event triggered from the NTP client.
+	if (syncEventTriggered) {
+		Stall.enter("ntp event");
+		processSyncEvent(ntpEvent);
+		syncEventTriggered = false;
 	}
 
+	Stall.enter("tz tables");
+	time_t t = now();
+	updateTzTables(t);
+
+	// Keep what the SNTP server reports about the clock up to date.
+	if (sntpServer.running()) {
+		Stall.enter("sntp status");
+		updateSntpStatus();
+	}
+
+	// Run any scheduled event that is due.
+	Stall.enter("alarms");
+	int8_t alarm = alarms.poll(t);
+	if (alarm >= 0) {
+		runAlarm(alarms.rule(alarm));
+	}
+
+	// Keep the warm restart snapshot fresh, for resets that give no
+	// warning.
+	if (millis() - last_warm_save >= WARM_SAVE_INTERVAL_MS) {
+		Stall.enter("warm save");
+		saveWarmStart();
+	}
+
+	// Periodically save the cathode wear counters. They are left staged
+	// during a 'config begin' batch, which must reach flash all at once.
+	if (millis() - last_wear_save >= WEAR_SAVE_INTERVAL_MS) {
+		Stall.enter("wear save");
+		saveWear();
+		if (!configBatch) {
+			EEPROM.commit();
+		}
+	}
+
+	return TIME_TASK_INTERVAL_MS;
+}
+
+/*
+ * Download firmware updates and report metrics.
+ */
+uint32_t runNetworkTask()
+{
+	// Download a firmware update, and restart into it once it is complete.
+	Stall.enter("ota");
+	if (ota.active() && ota.poll()) {
+		// Only a committed batch may reach flash.
+		abortConfigBatch();
+		LOG_INFO(SYSTEM, "Nixie Tap is restarting into the new firmware!");
+		Log.flush();
+		saveWear();
+		EEPROM.commit();
+		saveWarmStart();
+		ESP.restart();
+	}
+
+	// Scan, connect, reconnect or roam.
+	Stall.enter("wifi");
+	wifiRoamer.poll();
+
+	// Report metrics to the collector.
+	if (metrics.running() && millis() - last_metrics >= cfg_metrics_interval * 1000UL) {
+		Stall.enter("metrics");
+		sendMetrics();
+	}
+
+	// An update downloads one chunk per run, so keep coming back for the
+	// next one while giving the other tasks their turn.
+	return ota.active() ? 1 : NETWORK_TASK_INTERVAL_MS;
+}
+
+/*
+ * Handle the serial interface and send pending log output to the UART.
+ */
+uint32_t runConsoleTask()
+{
 	// Print the current time if the serial ticker is enabled.
-	if (serialTicker) {
-		printTime(current_time);
+	Stall.enter("console");
+	if (tickerRate) {
+		printTicker();
 	}
 
-	// Handle serial interface input.
 	readAndParseSerial();
-
-	// Handle config button presses.
-	readConfigButton();
+	Stall.enter("log drain");
+	Log.drain();
+	return CONSOLE_TASK_INTERVAL_MS;
 }
 
 void setupWiFi()
@@ -171,25 +632,29 @@ void setupWiFi()
 	WiFi.mode(WIFI_STA);
 	WiFi.hostname("NixieTap");
 	WiFi.persistent(false);
-	WiFi.setAutoReconnect(true);
+	// Reconnecting is left to wifiRoamer, which picks the strongest access
+	// point and backs off between attempts.
+	WiFi.setAutoReconnect(false);
+	wifiRoamer.setNetwork(0, cfg_ssid, cfg_password);
+	wifiRoamer.setNetwork(1, cfg_ssid2, cfg_password2);
+	wifiRoamer.setNetwork(2, cfg_ssid3, cfg_password3);
 
 	static WiFiEventHandler eh_sta_dhcp_timeout =
 		WiFi.onStationModeDHCPTimeout([](void)
 	{
-		Serial.println("[Wi-Fi] DHCP timeout");
+		LOG_WARN(WIFI, "[Wi-Fi] DHCP timeout");
 	});
 
 	static WiFiEventHandler eh_sta_got_ip =
 		WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP& event)
 	{
-		Serial.print("[Wi-Fi] DHCP succeeded, IP address ");
-		Serial.print(WiFi.localIP());
-		Serial.print(", subnet mask ");
-		Serial.print(WiFi.subnetMask());
-		Serial.print(", gateway ");
-		Serial.print(WiFi.gatewayIP());
-		Serial.print(", DNS ");
-		Serial.println(WiFi.dnsIP());
+		IPAddress ip = WiFi.localIP(), mask = WiFi.subnetMask(), gw = WiFi.gatewayIP(), dns = WiFi.dnsIP();
+		LOG_INFO(WIFI, "[Wi-Fi] DHCP succeeded, IP address %u.%u.%u.%u, subnet mask %u.%u.%u.%u, gateway %u.%u.%u.%u, DNS %u.%u.%u.%u",
+			 ip[0], ip[1], ip[2], ip[3],
+			 mask[0], mask[1], mask[2], mask[3],
+			 gw[0], gw[1], gw[2], gw[3],
+			 dns[0], dns[1], dns[2], dns[3]);
+		wifiRoamer.gotIP();
 
 		// Start the NTP client if enabled.
 		startNTPClient();
@@ -206,33 +671,24 @@ void setupWiFi()
 			"AUTH_WPA_WPA2_PSK",
 			"AUTH_MAX"
 		};
-		Serial.print("[Wi-Fi] Authentication mode changed, old mode ");
-		Serial.print(AUTH_MODE_NAMES[event.oldMode]);
-		Serial.print(", new mode ");
-		Serial.println(AUTH_MODE_NAMES[event.newMode]);
+		LOG_INFO(WIFI, "[Wi-Fi] Authentication mode changed, old mode %s, new mode %s",
+			 AUTH_MODE_NAMES[event.oldMode], AUTH_MODE_NAMES[event.newMode]);
 	});
 
 	static WiFiEventHandler eh_sta_connected =
 		WiFi.onStationModeConnected([](const WiFiEventStationModeConnected& event)
 	{
-		Serial.print("[Wi-Fi] Station connected, SSID \"");
-		Serial.print(WiFi.SSID());
-		Serial.print("\", channel ");
-		Serial.print(event.channel);
-		Serial.print(", RSSI ");
-		Serial.print(WiFi.RSSI());
-		Serial.print(" dBm, BSSID ");
-		Serial.println(WiFi.BSSIDstr());
+		LOG_INFO(WIFI, "[Wi-Fi] Station connected, SSID \"%s\", channel %u, RSSI %d dBm, BSSID %02X:%02X:%02X:%02X:%02X:%02X",
+			 event.ssid.c_str(), event.channel, (int)WiFi.RSSI(),
+			 event.bssid[0], event.bssid[1], event.bssid[2], event.bssid[3], event.bssid[4], event.bssid[5]);
 	});
 
 	static WiFiEventHandler eh_sta_disconnected =
 		WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected& event)
 	{
-		Serial.print("[Wi-Fi] Station disconnected, reason: ");
-		Serial.print(wifiDisconnectReasonStr(event.reason));
-		Serial.print(" (");
-		Serial.print((unsigned)event.reason);
-		Serial.println(")");
+		LOG_INFO(WIFI, "[Wi-Fi] Station disconnected, reason: %s (%u)",
+			 wifiDisconnectReasonStr(event.reason), (unsigned)event.reason);
+		wifiRoamer.disconnected(event.reason);
 
 		// Stop the NTP client if it's running.
 		stopNTPClient();
@@ -241,39 +697,221 @@ void setupWiFi()
 
 void connectWiFi()
 {
-	WiFi.disconnect();
+	wifiRoamer.begin();
 
-	if (cfg_ssid[0] == '\0' || cfg_password[0] == '\0') {
+	if (wifiRoamer.getState() == WIFI_IDLE) {
 		return;
 	}
-
-	WiFi.begin(cfg_ssid, cfg_password);
-
-	Serial.print("[Wi-Fi] Connecting to access point: ");
-	Serial.println(cfg_ssid);
+	LOG_INFO(WIFI, "[Wi-Fi] Scanning for access points of: %s %s %s", cfg_ssid, cfg_ssid2, cfg_ssid3);
 }
 
 void loadTimeZone()
 {
 	time_zone = zoneManager.createForZoneName(cfg_time_zone);
 	if (!time_zone.isError()) {
-		Serial.print("[Time] Loaded time zone: ");
-		Serial.println(cfg_time_zone);
+		LOG_INFO(TIME, "[Time] Loaded time zone: %s", cfg_time_zone);
 	} else {
-		Serial.println("[Time] Unable to load time zone, using UTC.");
+		LOG_WARN(TIME, "[Time] Unable to load time zone, using UTC.");
 
 		// Use UTC instead.
 		time_zone = zoneManager.createForZoneInfo(&zonedbx::kZoneEtc_UTC);
 		if (time_zone.isError()) {
-			Serial.println("[Time] WARNING! Unable to load UTC time zone.");
+			LOG_ERROR(TIME, "[Time] WARNING! Unable to load UTC time zone.");
+		}
+	}
+
+	// The transition table is rebuilt for the new zone on first use.
+	tzTable.clear();
+}
+
+/*
+ * Load the world clock zones, a space separated list of zone names. Unknown
+ * names are skipped.
+ */
+void loadWorldZones()
+{
+	char names[sizeof(cfg_world_zones)];
+	char *save;
+
+	strlcpy(names, cfg_world_zones, sizeof(names));
+	worldZoneCount = 0;
+	for (char *name = strtok_r(names, " ", &save); name != NULL && worldZoneCount < WORLD_ZONES_MAX;
+	     name = strtok_r(NULL, " ", &save)) {
+		TimeZone zone = zoneManager.createForZoneName(name);
+		if (zone.isError()) {
+			LOG_WARN(TIME, "[Time] Unable to load world clock zone: %s", name);
+			continue;
+		}
+		world_zones[worldZoneCount] = zone;
+		worldTzTables[worldZoneCount].clear();
+		worldZoneCount++;
+		LOG_INFO(TIME, "[Time] Loaded world clock zone %u: %s", worldZoneCount, name);
+	}
+}
+
+/*
+ * Return the UTC offset of time zone 'tz' at 't', in seconds. This is a
+ * lookup in the zone's transition table, falling back to AceTime outside it.
+ */
+int32_t zoneOffset(const TimeZone &tz, const TzTable &table, time_t t)
+{
+	if (table.covers(t)) {
+		return table.find(t).offsetMinutes * 60;
+	}
+	return ZonedDateTime::forUnixSeconds64(t, tz).timeOffset().toSeconds();
+}
+
+/*
+ * Bring the transition tables up to date, rebuilding at most one table per
+ * call so that the main loop never stalls for long. The tables of the world
+ * zones are all built ahead of time, so switching to a zone never waits for
+ * one.
+ */
+void updateTzTables(time_t t)
+{
+	if (updateTzTable(tzTable, time_zone, t, true)) {
+		return;
+	}
+	for (uint8_t i = 0; i < worldZoneCount; i++) {
+		if (updateTzTable(worldTzTables[i], world_zones[i], t, false)) {
+			return;
+		}
+	}
+}
+
+/*
+ * Make 'table' cover the TZ_TABLE_YEARS years starting with the year of 't'.
+ * For the local time zone ('stored') a table for the same zone and window
+ * in the EEPROM is reused; otherwise the table is built and staged in the
+ * EEPROM, to be saved with the next commit. Returns whether any work was
+ * done.
+ */
+bool updateTzTable(TzTable &table, const TimeZone &tz, time_t t, bool stored)
+{
+	int16_t first = year(t);
+	uint32_t zoneId = tz.getZoneId();
+
+	// Don't tabulate before the clock has been set, and only try each
+	// window once.
+	if (first < 2000 || table.matches(zoneId, first)) {
+		return false;
+	}
+
+	PrintBuffer<50> name;
+	tz.printTo(name);
+
+	if (stored) {
+		EEPROM.get(EEPROM_ADDR__TZ_TABLE, table);
+		if (table.matches(zoneId, first) && table.count > 0 && table.count <= TZ_TABLE_MAX_ENTRIES) {
+			LOG_INFO(TIME, "[Time] Loaded %u transitions for %s, %d-%d, from EEPROM.",
+				 table.count, name.c_str(), first, first + TZ_TABLE_YEARS - 1);
+			return true;
+		}
+	}
+
+	unsigned long start = millis();
+	if (table.build(tz, first)) {
+		LOG_INFO(TIME, "[Time] Tabulated %u transitions for %s, %d-%d, in %lu ms.",
+			 table.count, name.c_str(), first, first + TZ_TABLE_YEARS - 1, millis() - start);
+		if (stored) {
+			EEPROM.put(EEPROM_ADDR__TZ_TABLE, table);
+		}
+	} else {
+		LOG_WARN(TIME, "[Time] Too many transitions to tabulate for %s, %d-%d.",
+			 name.c_str(), first, first + TZ_TABLE_YEARS - 1);
+	}
+	return true;
+}
+
+/*
+ * Blank the tubes during the night window and after idle_timeout minutes
+ * without a touch, unless a touch within the last wake_time seconds has
+ * woken them up.
+ */
+void updateBlanking(time_t local)
+{
+	static CivilClock civil;
+	const CivilTime &ct = civil.at(local);
+	unsigned long idle = millis() - last_touch;
+	uint16_t m = ct.hour * 60 + ct.minute;
+	bool night, blank;
+
+	if (cfg_night_start < cfg_night_end) {
+		night = m >= cfg_night_start && m < cfg_night_end;
+	} else if (cfg_night_start > cfg_night_end) {
+		night = m >= cfg_night_start || m < cfg_night_end;
+	} else {
+		night = false;
+	}
+
+	if (idle < cfg_wake_time * 1000UL) {
+		blank = false;
+	} else {
+		blank = night || (cfg_idle_timeout != 0 && idle >= cfg_idle_timeout * 60000UL);
+	}
+	nixieTap.setBlank(blank);
+}
+
+/*
+ * Save the clock, the NTP state and the display slot to RTC user memory, to
+ * be resumed after a warm restart.
+ */
+void saveWarmStart()
+{
+	WarmStartState snapshot = {};
+
+	last_warm_save = millis();
+	if (!Clock.isSet()) {
+		return;
+	}
+	snapshot.utcMicros = Clock.nowMicros();
+	snapshot.syncAge = Clock.sinceSync();
+	snapshot.ntpOffsetMicros = ntpOffsetMicros;
+	snapshot.ntpJitterMicros = ntpJitterMicros;
+	snapshot.ntpDelayMicros = ntpDelayMicros;
+	snapshot.ntpRefId = ntpRefId;
+	for (uint8_t i = 0; i < sizeof(TIME_SOURCES) / sizeof(TIME_SOURCES[0]); i++) {
+		if (strcmp(time_source, TIME_SOURCES[i]) == 0) {
+			snapshot.timeSource = i;
 		}
 	}
+	snapshot.displaySlot = state;
+	warmStart.save(snapshot);
+}
+
+/*
+ * Continue the clock, the NTP state and the display slot from the snapshot
+ * saved before the reset. Returns false if there is no snapshot that can be
+ * trusted, and the time has to be read from the on-board RTC instead.
+ */
+bool resumeWarmStart()
+{
+	WarmStartState snapshot;
+
+	if (!warmStart.load(snapshot)) {
+		return false;
+	}
+	Clock.resume(snapshot.utcMicros, snapshot.syncAge);
+	setTime(snapshot.utcMicros / 1000000);
+	if (snapshot.timeSource < sizeof(TIME_SOURCES) / sizeof(TIME_SOURCES[0])) {
+		time_source = TIME_SOURCES[snapshot.timeSource];
+	}
+	ntpOffsetMicros = snapshot.ntpOffsetMicros;
+	ntpJitterMicros = snapshot.ntpJitterMicros;
+	ntpDelayMicros = snapshot.ntpDelayMicros;
+	ntpRefId = snapshot.ntpRefId;
+	state = snapshot.displaySlot;
+	LOG_INFO(TIME, "[Time] System time resumed from the snapshot saved %u ms before.", warmStart.age());
+	return true;
 }
 
 void setSystemTimeFromRTC()
 {
-	setTime(RTC.get());
-	Serial.println("[Time] System time has been set from the on-board RTC.");
+	time_t t = RTC.get();
+	setTime(t);
+	Clock.set(t);
+	time_source = "rtc";
+	LOG_INFO(TIME, "[Time] System time has been set from the on-board RTC.");
 }
 
 void startNTPClient()
@@ -282,59 +920,99 @@ void startNTPClient()
 		return;
 	}
 
+	// NTP.begin() resolves the server name, which can block.
+	StallStage stage("ntp begin");
+
 	if (ntpInitialized) {
-		Serial.println("[NTP] Restarting NTP client.");
+		LOG_INFO(NTP, "[NTP] Restarting NTP client.");
 		NTP.stop();
 		ntpInitialized = false;
 	} else {
-		Serial.println("[NTP] Starting NTP client.");
+		LOG_INFO(NTP, "[NTP] Starting NTP client.");
 	}
 
 	NTP.onNTPSyncEvent([](NTPSyncEvent_t event) {
 		ntpEvent = event;
 		syncEventTriggered = true;
+		timeTask.wake();
 	});
 
 	if (!NTP.setInterval(cfg_ntp_sync_interval)) {
-		Serial.println("[NTP] Failed to set sync interval!");
+		LOG_ERROR(NTP, "[NTP] Failed to set sync interval!");
 	}
 
 	if (NTP.begin(cfg_ntp_server)) {
 		ntpInitialized = true;
+		// Take over as the time provider to time the NTP request.
+		setSyncProvider(ntpSyncProvider);
 	} else {
-		Serial.println("[NTP] Failed to start NTP client!");
+		LOG_ERROR(NTP, "[NTP] Failed to start NTP client!");
 	}
 }
 
 void stopNTPClient()
 {
 	if (ntpInitialized) {
-		Serial.println("[NTP] Stopping NTP client.");
+		LOG_INFO(NTP, "[NTP] Stopping NTP client.");
 		NTP.stop();
 		ntpInitialized = false;
 	}
 }
 
+/*
+ * Sync the system time from NTP, and set the wall clock to the time at which
+ * the NTP response was sent, allowing for half the round trip to get here.
+ */
+time_t ntpSyncProvider()
+{
+	uint64_t start = micros64();
+	time_t t = NTP.getTime();
+	if (t == 0) {
+		return 0;
+	}
+	ntpDelayMicros = micros64() - start;
+	uint32_t us = SNTP_SYNC_DISPERSION_US + ntpDelayMicros / 2;
+	if (Clock.isSet()) {
+		// A clock set from a wrong RTC can be off by years, so work in 64
+		// bits and only saturate what is kept.
+		int64_t offset = (int64_t)t * 1000000 + us - (int64_t)Clock.nowMicros();
+		if (Clock.sinceSync() != UINT32_MAX) {
+			int64_t change = offset - ntpOffsetMicros;
+			int64_t jitter = ntpJitterMicros + ((change < 0 ? -change : change) - (int64_t)ntpJitterMicros) / 4;
+			ntpJitterMicros = jitter > INT32_MAX ? INT32_MAX : jitter;
+		}
+		ntpOffsetMicros = offset > INT32_MAX ? INT32_MAX : offset < -INT32_MAX ? -INT32_MAX : offset;
+	}
+	Clock.sync(t, us);
+	time_source = "ntp";
+
+	// The reference ID of a secondary server is the IPv4 address of its
+	// upstream, which is only known if the server is given as one.
+	IPAddress ip;
+	ntpRefId = ip.fromString(cfg_ntp_server) ? (uint32_t)ip[0] << 24 | ip[1] << 16 | ip[2] << 8 | ip[3] : 0;
+	return t;
+}
+
 void processSyncEvent(NTPSyncEvent_t ntpEvent)
 {
 	if (ntpEvent < 0) {
-		Serial.print("[NTP] Time sync error: ");
 		if (ntpEvent == noResponse) {
-			Serial.println("NTP server not reachable.");
+			LOG_WARN(NTP, "[NTP] Time sync error: NTP server not reachable.");
 		} else if (ntpEvent == invalidAddress) {
-			Serial.println("Invalid NTP server address.");
+			LOG_WARN(NTP, "[NTP] Time sync error: Invalid NTP server address.");
 		} else if (ntpEvent == errorSending) {
-			Serial.println("Error sending request.");
+			LOG_WARN(NTP, "[NTP] Time sync error: Error sending request.");
 		} else if (ntpEvent == responseError) {
-			Serial.println("NTP response error.");
+			LOG_WARN(NTP, "[NTP] Time sync error: NTP response error.");
 		} else {
-			Serial.println("Unknown event.");
+			LOG_WARN(NTP, "[NTP] Time sync error: Unknown event.");
 		}
 	} else {
 		if (ntpEvent == timeSyncd && NTP.SyncStatus()) {
 			time_t ntp_time = NTP.getLastNTPSync();
 			RTC.set(ntp_time);
 			printTime(ntp_time);
+			rescheduleAlarms();
 		}
 	}
 }
@@ -359,6 +1037,7 @@ void enableSecDot()
 void irq_1Hz_int()
 {
 	dot_state = !dot_state;
+	displayTask.wake();
 }
 
 /*
@@ -368,321 +1047,1584 @@ void touchButtonPressed()
 {
 	state++;
 	touch_button_pressed = true;
-	nixieTap.setAnimation(true);
+	displayTask.wake();
+}
+
+/*
+ * If string 's' begins with 'prefix', return a pointer to the remainder of
+ * 's' following the prefix. Otherwise, return NULL.
+ */
+static const char *skipPrefix(const char *s, const char *prefix)
+{
+	size_t len = strlen(prefix);
+	return (strncmp(s, prefix, len) == 0) ? s + len : NULL;
 }
 
 void readAndParseSerial()
 {
-	if (Serial.available() > 0) {
-		serialCommand.concat(Serial.readStringUntil('\n'));
-
-		if (serialCommand.endsWith("\r")) {
-			serialCommand.trim();
-
-			if (serialCommand == "espinfo") {
-				printESPInfo();
-			} else if (serialCommand == "init") {
-				resetEepromToDefault();
-			} else if (serialCommand == "read") {
-				readParameters();
-			} else if (serialCommand == "restart") {
-				Serial.println("Nixie Tap is restarting!");
-				EEPROM.commit();
-				ESP.restart();
-			} else if (serialCommand == "set") {
-				Serial.println("Available 'set' commands: "
-					       "24hr_enabled, "
-					       "ntp_enabled, "
-					       "ntp_sync_interval, "
-					       "ntp_server, "
-					       "time_zone, "
-					       "ssid, "
-					       "password, "
-					       "time.");
-			} else if (serialCommand.startsWith("set ")) {
-				parseSerialSet(serialCommand.substring(strlen("set ")));
-			} else if (serialCommand == "ticker") {
-				if (serialTicker) {
-					Serial.println("[Time] Turning off serial ticker.");
-				} else {
-					Serial.println("[Time] Turning on serial ticker.");
-				}
-				serialTicker = !serialTicker;
-			} else if (serialCommand == "time") {
-				printTime(now());
-			} else if (serialCommand == "write") {
-				EEPROM.commit();
-				Serial.println("[EEPROM Commit] Writing settings to non-volatile memory.");
-			} else if (serialCommand == "help") {
-				Serial.println("Available commands: "
-					       "espinfo, "
-					       "init, "
-					       "read, "
-					       "restart, "
-					       "set, "
-					       "ticker, "
-					       "time, "
-					       "write, "
-					       "help.");
-			} else {
-				Serial.print("Unknown command: ");
-				Serial.println(serialCommand);
+	const char *arg;
+
+	// Accumulate input into the command buffer without blocking. A command
+	// is terminated by either CR or LF.
+	while (Serial.available() > 0) {
+		int c = Serial.read();
+		if (c != '\r' && c != '\n') {
+			if (serialCommandLen < sizeof(serialCommand) - 1) {
+				serialCommand[serialCommandLen++] = c;
 			}
+			continue;
+		}
+
+		// Trim leading and trailing whitespace.
+		serialCommand[serialCommandLen] = '\0';
+		while (serialCommandLen > 0 && isspace(serialCommand[serialCommandLen - 1])) {
+			serialCommand[--serialCommandLen] = '\0';
+		}
+		const char *cmd = serialCommand;
+		while (isspace(*cmd)) {
+			cmd++;
+		}
+		serialCommandLen = 0;
 
-			serialCommand = "";
+		// Blank lines, and comments such as those of 'config dump'.
+		if (*cmd == '\0' || *cmd == '#') {
+			continue;
+		}
+
+		if (strcmp(cmd, "bench") == 0) {
+			printBenchmarks();
+		} else if ((arg = skipPrefix(cmd, "config "))) {
+			parseConfig(arg);
+		} else if (strcmp(cmd, "display") == 0) {
+			printDisplayStats();
+		} else if (strcmp(cmd, "espinfo") == 0) {
+			printESPInfo();
+		} else if (strcmp(cmd, "log") == 0) {
+			printLog(LOG_HISTORY_LINES);
+		} else if ((arg = skipPrefix(cmd, "log "))) {
+			printLog(atoi(arg));
+		} else if (strcmp(cmd, "init") == 0) {
+			if (configBatch) {
+				LOG_INFO(CONSOLE, "[Config] A batch is open; finish it with 'config commit' or 'config abort'.");
+				continue;
+			}
+			resetEepromToDefault();
+		} else if (strcmp(cmd, "ota") == 0) {
+			ota.printProgress();
+		} else if ((arg = skipPrefix(cmd, "ota "))) {
+			parseOta(arg);
+		} else if (strcmp(cmd, "read") == 0) {
+			readParameters();
+		} else if (strcmp(cmd, "restart") == 0 || strcmp(cmd, "restart cold") == 0) {
+			if (configBatch) {
+				LOG_INFO(CONSOLE, "[Config] A batch is open; finish it with 'config commit' or 'config abort'.");
+				continue;
+			}
+			LOG_INFO(SYSTEM, "Nixie Tap is restarting!");
+			Log.flush();
+			saveWear();
+			EEPROM.commit();
+			if (strcmp(cmd, "restart") == 0) {
+				saveWarmStart();
+			} else {
+				warmStart.clear();
+			}
+			ESP.restart();
+		} else if (strcmp(cmd, "rtc") == 0) {
+			printRtcStats();
+		} else if (strcmp(cmd, "schedule") == 0) {
+			printSchedule();
+		} else if ((arg = skipPrefix(cmd, "schedule "))) {
+			parseSchedule(arg);
+		} else if (strcmp(cmd, "set") == 0) {
+			LOG_INFO(CONSOLE, "Available 'set' commands: "
+					  "24hr_enabled, "
+					  "ntp_enabled, "
+					  "ntp_sync_interval, "
+					  "display_timer, "
+					  "sntp_server, "
+					  "time_code, "
+					  "night_start, "
+					  "night_end, "
+					  "idle_timeout, "
+					  "wake_time, "
+					  "metrics_host, "
+					  "metrics_interval, "
+					  "ntp_server, "
+					  "ota_url, "
+					  "time_zone, "
+					  "world_zones, "
+					  "ssid, "
+					  "password, "
+					  "ssid2, "
+					  "password2, "
+					  "ssid3, "
+					  "password3, "
+					  "time.");
+		} else if ((arg = skipPrefix(cmd, "set "))) {
+			parseSerialSet(arg);
+		} else if (strcmp(cmd, "sntp") == 0) {
+			printSntpStats();
+		} else if (strcmp(cmd, "status json") == 0) {
+			printStatusJson();
+		} else if (strcmp(cmd, "tasks") == 0) {
+			printTaskStats();
+		} else if (strcmp(cmd, "tasks reset") == 0) {
+			scheduler.resetStats();
+			LOG_INFO(SYSTEM, "[Tasks] Statistics reset.");
+		} else if (strcmp(cmd, "timecode") == 0) {
+			printTimeCodeStats();
+		} else if (strcmp(cmd, "ticker") == 0) {
+			if (tickerRate) {
+				LOG_INFO(TIME, "[Time] Turning off serial ticker.");
+				tickerRate = 0;
+			} else {
+				LOG_INFO(TIME, "[Time] Turning on serial ticker.");
+				tickerRate = 1;
+			}
+		} else if ((arg = skipPrefix(cmd, "ticker "))) {
+			int rate = atoi(arg);
+			if (rate < 0 || rate > TICKER_RATE_MAX) {
+				LOG_INFO(TIME, "[Time] Ticker rate must be 0 to %u lines per second.", TICKER_RATE_MAX);
+			} else if (rate == 0) {
+				LOG_INFO(TIME, "[Time] Turning off serial ticker.");
+				tickerRate = 0;
+			} else {
+				LOG_INFO(TIME, "[Time] Turning on serial ticker, %d lines per second.", rate);
+				tickerRate = rate;
+			}
+		} else if (strcmp(cmd, "time") == 0) {
+			printTime(now());
+		} else if (strcmp(cmd, "tz") == 0) {
+			printTzTable();
+		} else if (strcmp(cmd, "wear") == 0) {
+			printWear();
+		} else if (strcmp(cmd, "wifi") == 0) {
+			printWifiStats();
+		} else if (strcmp(cmd, "write") == 0) {
+			if (configBatch) {
+				LOG_INFO(CONSOLE, "[Config] A batch is open; finish it with 'config commit' or 'config abort'.");
+				continue;
+			}
+			EEPROM.commit();
+			LOG_INFO(EEPROM, "[EEPROM Commit] Writing settings to non-volatile memory.");
+		} else if (strcmp(cmd, "help") == 0) {
+			LOG_INFO(CONSOLE, "Available commands: "
+					  "bench, "
+					  "config, "
+					  "display, "
+					  "espinfo, "
+					  "init, "
+					  "log, "
+					  "ota, "
+					  "read, "
+					  "restart, "
+					  "rtc, "
+					  "schedule, "
+					  "set, "
+					  "sntp, "
+					  "status json, "
+					  "tasks, "
+					  "ticker, "
+					  "timecode, "
+					  "time, "
+					  "tz, "
+					  "wear, "
+					  "wifi, "
+					  "write, "
+					  "help.");
+		} else {
+			LOG_INFO(CONSOLE, "Unknown command: %s", cmd);
 		}
 	}
 }
 
-void parseSerialSet(String s)
+void parseSerialSet(const char *s)
 {
-	if (s.startsWith("24hr_enabled ")) {
-		uint8_t val = (uint8_t)atoi(s.substring(strlen("24hr_enabled ")).c_str());
+	const char *arg;
+
+	if ((arg = skipPrefix(s, "24hr_enabled "))) {
+		uint8_t val = (uint8_t)atoi(arg);
 		cfg_24hr_enabled = val;
-		Serial.print("[EEPROM Write] ");
-		Serial.print("24hr_enabled: ");
-		Serial.println(val);
+		LOG_INFO(EEPROM, "[EEPROM Write] 24hr_enabled: %u", (unsigned)val);
 		EEPROM.put(EEPROM_ADDR__24HR_ENABLED, val);
-	} else if (s.startsWith("ntp_enabled ")) {
-		uint8_t val = (uint8_t)atoi(s.substring(strlen("ntp_enabled ")).c_str());
+	} else if ((arg = skipPrefix(s, "ntp_enabled "))) {
+		uint8_t val = (uint8_t)atoi(arg);
 		cfg_ntp_enabled = val;
-		Serial.print("[EEPROM Write] ");
-		Serial.print("ntp_enabled: ");
-		Serial.println(val);
+		LOG_INFO(EEPROM, "[EEPROM Write] ntp_enabled: %u", (unsigned)val);
 		EEPROM.put(EEPROM_ADDR__NTP_ENABLED, val);
 
 		// Stop or start the NTP client.
-		if (cfg_ntp_enabled == 0 && ntpInitialized) {
-			stopNTPClient();
-		} else if (cfg_ntp_enabled == 1 && !ntpInitialized) {
-			startNTPClient();
-		}
-	} else if (s.startsWith("ntp_sync_interval ")) {
-		uint32_t val = (uint8_t)atoi(s.substring(strlen("ntp_sync_interval ")).c_str());
+		applyConfig(CONFIG_APPLY_NTP);
+	} else if ((arg = skipPrefix(s, "ntp_sync_interval "))) {
+		uint32_t val = (uint32_t)strtoul(arg, NULL, 10);
 		cfg_ntp_sync_interval = val;
-		Serial.print("[EEPROM Write] ");
-		Serial.print("ntp_sync_interval: ");
-		Serial.println(val);
+		LOG_INFO(EEPROM, "[EEPROM Write] ntp_sync_interval: %u", (unsigned)val);
 		EEPROM.put(EEPROM_ADDR__NTP_SYNC_INTERVAL, val);
 
 		// Restart the NTP client if necessary.
-		if (cfg_ntp_enabled && ntpInitialized) {
-			startNTPClient();
+		applyConfig(CONFIG_APPLY_NTP);
+	} else if ((arg = skipPrefix(s, "display_timer "))) {
+		uint8_t val = (uint8_t)atoi(arg) ? 1 : 0;
+		cfg_display_timer = val;
+		LOG_INFO(EEPROM, "[EEPROM Write] display_timer: %u", (unsigned)val);
+		EEPROM.put(EEPROM_ADDR__DISPLAY_TIMER, val);
+
+		// Switch display drivers.
+		applyConfig(CONFIG_APPLY_DISPLAY);
+	} else if ((arg = skipPrefix(s, "sntp_server "))) {
+		uint8_t val = (uint8_t)atoi(arg) ? 1 : 0;
+		cfg_sntp_server = val;
+		LOG_INFO(EEPROM, "[EEPROM Write] sntp_server: %u", (unsigned)val);
+		EEPROM.put(EEPROM_ADDR__SNTP_SERVER, val);
+
+		// Start or stop the SNTP server.
+		applyConfig(CONFIG_APPLY_SNTP);
+	} else if ((arg = skipPrefix(s, "time_code "))) {
+		int val = atoi(arg);
+		if (val < 0 || val >= TIMECODE_FORMAT_COUNT) {
+			LOG_INFO(CONSOLE, "The time code must be 0 (off), 1 (ZDA) or 2 (RMC).");
+			return;
+		}
+		cfg_time_code = val;
+		LOG_INFO(EEPROM, "[EEPROM Write] time_code: %u", (unsigned)cfg_time_code);
+		EEPROM.put(EEPROM_ADDR__TIME_CODE, cfg_time_code);
+		applyConfig(CONFIG_APPLY_TIME_CODE);
+	} else if ((arg = skipPrefix(s, "night_start ")) || (arg = skipPrefix(s, "night_end "))) {
+		unsigned int hour, minute;
+		bool start = skipPrefix(s, "night_start ") != NULL;
+		if (sscanf(arg, "%u:%u", &hour, &minute) != 2 || hour > 23 || minute > 59) {
+			LOG_INFO(CONSOLE, "Unable to parse time of day: %s", arg);
+			return;
 		}
-	} else if (s.startsWith("ntp_server ")) {
-		strcpy(cfg_ntp_server, s.substring(strlen("ntp_server ")).c_str());
-		Serial.print("[EEPROM Write] ");
-		Serial.print("ntp_server: ");
-		Serial.println(cfg_ntp_server);
+		uint16_t val = hour * 60 + minute;
+		if (start) {
+			cfg_night_start = val;
+			LOG_INFO(EEPROM, "[EEPROM Write] night_start: %02u:%02u", hour, minute);
+			EEPROM.put(EEPROM_ADDR__NIGHT_START, val);
+		} else {
+			cfg_night_end = val;
+			LOG_INFO(EEPROM, "[EEPROM Write] night_end: %02u:%02u", hour, minute);
+			EEPROM.put(EEPROM_ADDR__NIGHT_END, val);
+		}
+	} else if ((arg = skipPrefix(s, "idle_timeout "))) {
+		uint16_t val = (uint16_t)atoi(arg);
+		cfg_idle_timeout = val;
+		LOG_INFO(EEPROM, "[EEPROM Write] idle_timeout: %u", (unsigned)val);
+		EEPROM.put(EEPROM_ADDR__IDLE_TIMEOUT, val);
+	} else if ((arg = skipPrefix(s, "wake_time "))) {
+		uint16_t val = (uint16_t)atoi(arg);
+		cfg_wake_time = val;
+		LOG_INFO(EEPROM, "[EEPROM Write] wake_time: %u", (unsigned)val);
+		EEPROM.put(EEPROM_ADDR__WAKE_TIME, val);
+	} else if ((arg = skipPrefix(s, "metrics_host")) && (*arg == '\0' || *arg == ' ')) {
+		while (*arg == ' ') {
+			arg++;
+		}
+		strlcpy(cfg_metrics_host, arg, sizeof(cfg_metrics_host));
+		LOG_INFO(EEPROM, "[EEPROM Write] metrics_host: %s", cfg_metrics_host);
+		EEPROM.put(EEPROM_ADDR__METRICS_HOST, cfg_metrics_host);
+
+		// Send metrics to the new collector.
+		applyConfig(CONFIG_APPLY_METRICS);
+	} else if ((arg = skipPrefix(s, "ota_url")) && (*arg == '\0' || *arg == ' ')) {
+		while (*arg == ' ') {
+			arg++;
+		}
+		strlcpy(cfg_ota_url, arg, sizeof(cfg_ota_url));
+		LOG_INFO(EEPROM, "[EEPROM Write] ota_url: %s", cfg_ota_url);
+		EEPROM.put(EEPROM_ADDR__OTA_URL, cfg_ota_url);
+	} else if ((arg = skipPrefix(s, "metrics_interval "))) {
+		uint16_t val = (uint16_t)atoi(arg);
+		if (val == 0 || val > METRICS_INTERVAL_MAX) {
+			LOG_INFO(CONSOLE, "The metrics interval must be 1 to %u seconds.", METRICS_INTERVAL_MAX);
+			return;
+		}
+		cfg_metrics_interval = val;
+		LOG_INFO(EEPROM, "[EEPROM Write] metrics_interval: %u", (unsigned)val);
+		EEPROM.put(EEPROM_ADDR__METRICS_INTERVAL, val);
+	} else if ((arg = skipPrefix(s, "ntp_server "))) {
+		strlcpy(cfg_ntp_server, arg, sizeof(cfg_ntp_server));
+		LOG_INFO(EEPROM, "[EEPROM Write] ntp_server: %s", cfg_ntp_server);
 		EEPROM.put(EEPROM_ADDR__NTP_SERVER, cfg_ntp_server);
 
 		// Restart the NTP client if necessary.
-		if (cfg_ntp_enabled && ntpInitialized) {
-			startNTPClient();
+		applyConfig(CONFIG_APPLY_NTP);
+	} else if ((arg = skipPrefix(s, "time_zone "))) {
+		// Only accept zones in the database linked into this build.
+		if (zoneManager.createForZoneName(arg).isError()) {
+			LOG_INFO(CONSOLE, "Unknown time zone: %s", arg);
+			return;
 		}
-	} else if (s.startsWith("time_zone ")) {
-		strcpy(cfg_time_zone, s.substring(strlen("time_zone ")).c_str());
-		Serial.print("[EEPROM Write] ");
-		Serial.print("time_zone: ");
-		Serial.println(cfg_time_zone);
+		strlcpy(cfg_time_zone, arg, sizeof(cfg_time_zone));
+		LOG_INFO(EEPROM, "[EEPROM Write] time_zone: %s", cfg_time_zone);
 		EEPROM.put(EEPROM_ADDR__TIME_ZONE, cfg_time_zone);
 
 		// Reload time zone.
-		loadTimeZone();
-	} else if (s.startsWith("ssid ")) {
-		strcpy(cfg_ssid, s.substring(strlen("ssid ")).c_str());
-		Serial.print("[EEPROM Write] ");
-		Serial.print("ssid: ");
-		Serial.println(cfg_ssid);
+		applyConfig(CONFIG_APPLY_TIME_ZONE);
+	} else if ((arg = skipPrefix(s, "world_zones")) && (*arg == '\0' || *arg == ' ')) {
+		// Only accept zones in the database linked into this build.
+		char names[sizeof(cfg_world_zones)];
+		char *save;
+		uint8_t count = 0;
+		strlcpy(names, arg, sizeof(names));
+		for (char *name = strtok_r(names, " ", &save); name != NULL; name = strtok_r(NULL, " ", &save)) {
+			if (zoneManager.createForZoneName(name).isError()) {
+				LOG_INFO(CONSOLE, "Unknown time zone: %s", name);
+				return;
+			}
+			count++;
+		}
+		if (count > WORLD_ZONES_MAX) {
+			LOG_INFO(CONSOLE, "At most %u world clock zones are supported.", WORLD_ZONES_MAX);
+			return;
+		}
+		while (*arg == ' ') {
+			arg++;
+		}
+		strlcpy(cfg_world_zones, arg, sizeof(cfg_world_zones));
+		LOG_INFO(EEPROM, "[EEPROM Write] world_zones: %s", cfg_world_zones);
+		EEPROM.put(EEPROM_ADDR__WORLD_ZONES, cfg_world_zones);
+
+		// Reload the world clock zones.
+		applyConfig(CONFIG_APPLY_WORLD_ZONES);
+	} else if ((arg = skipPrefix(s, "ssid "))) {
+		strlcpy(cfg_ssid, arg, sizeof(cfg_ssid));
+		LOG_INFO(EEPROM, "[EEPROM Write] ssid: %s", cfg_ssid);
 		EEPROM.put(EEPROM_ADDR__SSID, cfg_ssid);
 
 		// Restart WiFi connection because the SSID has changed.
-		connectWiFi();
-	} else if (s.startsWith("password ")) {
-		strcpy(cfg_password, s.substring(strlen("password ")).c_str());
-		Serial.print("[EEPROM Write] ");
-		Serial.print("password: ");
-		Serial.println(cfg_password);
+		applyConfig(CONFIG_APPLY_WIFI);
+	} else if ((arg = skipPrefix(s, "password "))) {
+		strlcpy(cfg_password, arg, sizeof(cfg_password));
+		LOG_INFO(EEPROM, "[EEPROM Write] password: %s", cfg_password);
 		EEPROM.put(EEPROM_ADDR__PASSWORD, cfg_password);
 
 		// Restart WiFi connection because the password has changed.
-		connectWiFi();
-	} else if (s.startsWith("time ")) {
-		String s_time = s.substring(strlen("time "));
-		auto odt = OffsetDateTime::forDateString(s_time.c_str());
+		applyConfig(CONFIG_APPLY_WIFI);
+	} else if (((arg = skipPrefix(s, "ssid2")) || (arg = skipPrefix(s, "ssid3"))) && (*arg == '\0' || *arg == ' ')) {
+		bool second = skipPrefix(s, "ssid2") != NULL;
+		while (*arg == ' ') {
+			arg++;
+		}
+		if (second) {
+			strlcpy(cfg_ssid2, arg, sizeof(cfg_ssid2));
+			LOG_INFO(EEPROM, "[EEPROM Write] ssid2: %s", cfg_ssid2);
+			EEPROM.put(EEPROM_ADDR__SSID2, cfg_ssid2);
+		} else {
+			strlcpy(cfg_ssid3, arg, sizeof(cfg_ssid3));
+			LOG_INFO(EEPROM, "[EEPROM Write] ssid3: %s", cfg_ssid3);
+			EEPROM.put(EEPROM_ADDR__SSID3, cfg_ssid3);
+		}
+
+		// Rescan, as the strongest network may have changed.
+		applyConfig(CONFIG_APPLY_WIFI);
+	} else if (((arg = skipPrefix(s, "password2")) || (arg = skipPrefix(s, "password3"))) && (*arg == '\0' || *arg == ' ')) {
+		bool second = skipPrefix(s, "password2") != NULL;
+		while (*arg == ' ') {
+			arg++;
+		}
+		if (second) {
+			strlcpy(cfg_password2, arg, sizeof(cfg_password2));
+			LOG_INFO(EEPROM, "[EEPROM Write] password2: %s", cfg_password2);
+			EEPROM.put(EEPROM_ADDR__PASSWORD2, cfg_password2);
+		} else {
+			strlcpy(cfg_password3, arg, sizeof(cfg_password3));
+			LOG_INFO(EEPROM, "[EEPROM Write] password3: %s", cfg_password3);
+			EEPROM.put(EEPROM_ADDR__PASSWORD3, cfg_password3);
+		}
+
+		// Rescan, as the strongest network may have changed.
+		applyConfig(CONFIG_APPLY_WIFI);
+	} else if ((arg = skipPrefix(s, "time "))) {
+		auto odt = OffsetDateTime::forDateString(arg);
 		if (!odt.isError()) {
 			time_t odt_unix = odt.toUnixSeconds64();
 			setTime(odt_unix);
+			Clock.set(odt_unix);
+			time_source = "manual";
 			RTC.set(odt_unix);
 			last_printed_time = 0;
 			printTime(odt_unix);
+			rescheduleAlarms();
 		} else {
-			Serial.print("Unable to parse timestamp: ");
-			Serial.println(s_time);
+			LOG_INFO(CONSOLE, "Unable to parse timestamp: %s", arg);
 		}
 	} else {
-		Serial.print("Unable to parse 'set' command: ");
-		Serial.println(s);
+		LOG_INFO(CONSOLE, "Unable to parse 'set' command: %s", s);
 	}
 }
 
+/*
+ * Restart the subsystems in 'flags', CONFIG_APPLY_*, for their changed
+ * settings. Inside a 'config begin' batch they are only noted, so that
+ * each is restarted once by 'config commit'.
+ */
+void applyConfig(uint8_t flags)
+{
+	if (configBatch) {
+		configPending |= flags;
+		return;
+	}
+
+	if (flags & CONFIG_APPLY_DISPLAY) {
+		nixieTap.setTimerDriver(cfg_display_timer);
+	}
+	if (flags & CONFIG_APPLY_TIME_ZONE) {
+		loadTimeZone();
+		rescheduleAlarms();
+	}
+	if (flags & CONFIG_APPLY_WORLD_ZONES) {
+		loadWorldZones();
+	}
+	if (flags & CONFIG_APPLY_WIFI) {
+		// Reconnecting restarts the NTP client once the network is up.
+		connectWiFi();
+	}
+	if (flags & CONFIG_APPLY_NTP) {
+		if (!cfg_ntp_enabled && ntpInitialized) {
+			stopNTPClient();
+		} else if (cfg_ntp_enabled && !(flags & CONFIG_APPLY_WIFI) &&
+			   (ntpInitialized || WiFi.status() == WL_CONNECTED)) {
+			startNTPClient();
+		}
+	}
+	if (flags & CONFIG_APPLY_SNTP) {
+		updateSntpServer();
+	}
+	if (flags & CONFIG_APPLY_METRICS) {
+		updateMetrics();
+	}
+	if (flags & CONFIG_APPLY_TIME_CODE) {
+		timeCode.setFormat(cfg_time_code);
+		timeCodeTask.wake();
+	}
+}
+
+/*
+ * Handle 'config dump', which prints the settings as commands that restore
+ * them, and the 'config begin', 'config commit' and 'config abort' batch.
+ */
+void parseConfig(const char *s)
+{
+	if (strcmp(s, "dump") == 0) {
+		printConfig();
+	} else if (strcmp(s, "begin") == 0) {
+		configBatch = true;
+		configPending = 0;
+		LOG_INFO(CONSOLE, "[Config] Batching settings until 'config commit'.");
+	} else if (strcmp(s, "commit") == 0) {
+		if (!configBatch) {
+			LOG_INFO(CONSOLE, "[Config] No batch to commit; start one with 'config begin'.");
+			return;
+		}
+		configBatch = false;
+		applyConfig(configPending);
+		configPending = 0;
+		EEPROM.commit();
+		LOG_INFO(EEPROM, "[EEPROM Commit] Writing settings to non-volatile memory.");
+	} else if (strcmp(s, "abort") == 0) {
+		if (!configBatch) {
+			LOG_INFO(CONSOLE, "[Config] No batch to abort.");
+			return;
+		}
+		abortConfigBatch();
+	} else {
+		LOG_INFO(CONSOLE, "Unable to parse 'config' command: %s", s);
+	}
+}
+
+/*
+ * Discard the 'config begin' batch, if one is open, by reloading the
+ * settings from flash. The wear counters and scheduled events staged since
+ * the last write are staged again.
+ */
+void abortConfigBatch()
+{
+	if (!configBatch) {
+		return;
+	}
+	configBatch = false;
+	configPending = 0;
+	EEPROM.begin(EEPROM_SIZE);
+	saveWear();
+	saveAlarms();
+	readParameters();
+	LOG_INFO(CONSOLE, "[Config] Batch discarded.");
+}
+
+/*
+ * Print the settings as a script of commands which, pasted into the serial
+ * console of another Nixie Tap, give it the same settings with a single
+ * flash write and without restarting anything more than once. The script is
+ * longer than the ring buffer holds, so each line is sent before the next is
+ * formatted.
+ */
+#define CONFIG_LINE(fmt, ...)                                  \
+	do {                                                   \
+		LOG_INFO(CONSOLE, fmt, ##__VA_ARGS__);         \
+		Log.flush();                                   \
+	} while (0)
+
+void printConfig()
+{
+	Log.flush();
+	CONFIG_LINE("# Nixie Tap settings, chip %06x", ESP.getChipId());
+	CONFIG_LINE("config begin");
+	CONFIG_LINE("set 24hr_enabled %u", cfg_24hr_enabled);
+	CONFIG_LINE("set ntp_enabled %u", cfg_ntp_enabled);
+	CONFIG_LINE("set ntp_sync_interval %u", cfg_ntp_sync_interval);
+	CONFIG_LINE("set display_timer %u", cfg_display_timer);
+	CONFIG_LINE("set sntp_server %u", cfg_sntp_server);
+	CONFIG_LINE("set time_code %u", cfg_time_code);
+	CONFIG_LINE("set night_start %02u:%02u", cfg_night_start / 60, cfg_night_start % 60);
+	CONFIG_LINE("set night_end %02u:%02u", cfg_night_end / 60, cfg_night_end % 60);
+	CONFIG_LINE("set idle_timeout %u", cfg_idle_timeout);
+	CONFIG_LINE("set wake_time %u", cfg_wake_time);
+	CONFIG_LINE("set metrics_host %s", cfg_metrics_host);
+	CONFIG_LINE("set metrics_interval %u", cfg_metrics_interval);
+	CONFIG_LINE("set ota_url %s", cfg_ota_url);
+	CONFIG_LINE("set world_zones %s", cfg_world_zones);
+	// These take no empty value.
+	if (cfg_ntp_server[0] != '\0') {
+		CONFIG_LINE("set ntp_server %s", cfg_ntp_server);
+	}
+	if (cfg_time_zone[0] != '\0') {
+		CONFIG_LINE("set time_zone %s", cfg_time_zone);
+	}
+	if (cfg_ssid[0] != '\0') {
+		CONFIG_LINE("set ssid %s", cfg_ssid);
+	}
+	if (cfg_password[0] != '\0') {
+		CONFIG_LINE("set password %s", cfg_password);
+	}
+	CONFIG_LINE("set ssid2 %s", cfg_ssid2);
+	CONFIG_LINE("set password2 %s", cfg_password2);
+	CONFIG_LINE("set ssid3 %s", cfg_ssid3);
+	CONFIG_LINE("set password3 %s", cfg_password3);
+	for (uint8_t i = 0; i < alarms.size(); i++) {
+		const AlarmRule &rule = alarms.rule(i);
+		char days[32];
+		alarmFormatDays(rule.days, days, sizeof(days));
+		CONFIG_LINE("schedule add %02u:%02u %s %s", rule.hour, rule.minute, days, alarmActionName(rule.action));
+	}
+	CONFIG_LINE("config commit");
+}
+
+#undef CONFIG_LINE
+
+/*
+ * Handle 'ota SHA256', which downloads and installs the firmware image at
+ * ota_url if its SHA-256 matches, and 'ota abort'.
+ */
+void parseOta(const char *s)
+{
+	if (strcmp(s, "abort") == 0) {
+		ota.abort();
+		return;
+	}
+	if (cfg_ota_url[0] == '\0') {
+		LOG_INFO(CONSOLE, "Set ota_url to the URL of the firmware image first.");
+		return;
+	}
+	ota.begin(cfg_ota_url, s);
+}
+
+/*
+ * Handle 'schedule add HH:MM DAYS ACTION' and 'schedule del N'. DAYS is
+ * "daily", "weekdays", "weekends" or a list of days such as "mon,wed,fri".
+ */
+void parseSchedule(const char *s)
+{
+	const char *arg;
+
+	if ((arg = skipPrefix(s, "add "))) {
+		unsigned int hour, minute;
+		char days[32], action[16];
+		AlarmRule rule;
+		if (sscanf(arg, "%u:%u %31s %15s", &hour, &minute, days, action) != 4 || hour > 23 || minute > 59) {
+			LOG_INFO(CONSOLE, "Usage: schedule add HH:MM daily|weekdays|weekends|mon,tue,... antipoison|ntp_sync");
+			return;
+		}
+		rule.hour = hour;
+		rule.minute = minute;
+		if (!alarmParseDays(days, rule.days)) {
+			LOG_INFO(CONSOLE, "Unable to parse days: %s", days);
+			return;
+		}
+		rule.action = alarmParseAction(action);
+		if (rule.action == ALARM_ACTION_NONE) {
+			LOG_INFO(CONSOLE, "Unknown action: %s", action);
+			return;
+		}
+		if (!alarms.add(rule)) {
+			LOG_INFO(CONSOLE, "At most %u scheduled events are supported.", ALARM_MAX);
+			return;
+		}
+	} else if ((arg = skipPrefix(s, "del "))) {
+		if (!alarms.remove(atoi(arg) - 1)) {
+			LOG_INFO(CONSOLE, "No such scheduled event: %s", arg);
+			return;
+		}
+	} else {
+		LOG_INFO(CONSOLE, "Unable to parse 'schedule' command: %s", s);
+		return;
+	}
+
+	rescheduleAlarms();
+	saveAlarms();
+	printSchedule();
+}
+
+void printSchedule()
+{
+	if (alarms.size() == 0) {
+		LOG_INFO(ALARM, "[Alarm] No scheduled events.");
+		return;
+	}
+	for (uint8_t i = 0; i < alarms.size(); i++) {
+		const AlarmRule &rule = alarms.rule(i);
+		char days[32];
+		PrintBuffer<64> next;
+		alarmFormatDays(rule.days, days, sizeof(days));
+		if (alarms.nextFiring(i) != ALARM_NEVER) {
+			ZonedDateTime::forUnixSeconds64(alarms.nextFiring(i), time_zone).printTo(next);
+		}
+		LOG_INFO(ALARM, "[Alarm] %u: %02u:%02u %s %s, next %s", i + 1, rule.hour, rule.minute, days,
+			 alarmActionName(rule.action), next.c_str());
+	}
+}
+
+/*
+ * Called by the core as the chip resets after an exception or a software
+ * watchdog timeout.
+ */
+extern "C" void custom_crash_callback(struct rst_info *rst_info, uint32_t stack, uint32_t stack_end)
+{
+	Stall.saveReset();
+	saveWarmStart();
+}
+
+/*
+ * Print the longest recent pass of the main loop and, if the watchdog or an
+ * exception reset the chip, the stage of the loop that was executing.
+ */
+void printStallInfo()
+{
+	const StallRecord &stall = Stall.lastStall();
+
+	if (Stall.resetStage()[0] != '\0' && Stall.resetPassMicros() == 0) {
+		LOG_WARN(SYSTEM, "[Stall] Reset in stage '%s'.", Stall.resetStage());
+	} else if (Stall.resetStage()[0] != '\0') {
+		LOG_WARN(SYSTEM, "[Stall] Reset in stage '%s', %u ms into its pass.",
+			 Stall.resetStage(), Stall.resetPassMicros() / 1000);
+	}
+	if (stall.passMicros != 0) {
+		LOG_INFO(SYSTEM, "[Stall] Last stall: pass of %u ms, %u ms of it in stage '%s', %u s after boot.",
+			 stall.passMicros / 1000, stall.stageMicros / 1000, stall.stage, stall.uptime);
+	}
+	LOG_INFO(SYSTEM, "[Stall] Stalls over %u ms since boot: %u", STALL_THRESHOLD_MS, Stall.stalls());
+}
+
 void printESPInfo()
 {
-	Serial.print("[ESP] Boot mode: ");
-	Serial.println(ESP.getBootMode());
+	LOG_INFO(ESP, "[ESP] Boot mode: %u", ESP.getBootMode());
+	LOG_INFO(ESP, "[ESP] Boot version: %u", ESP.getBootVersion());
+	LOG_INFO(ESP, "[ESP] Reset reason: %s", ESP.getResetReason().c_str());
+	LOG_INFO(ESP, "[ESP] Reset info: %s", ESP.getResetInfo().c_str());
+	printStallInfo();
+	LOG_INFO(ESP, "[ESP] Warm boot: %s", warmBoot ? "yes" : "no");
+	LOG_INFO(ESP, "[ESP] Free heap: %u", ESP.getFreeHeap());
+	LOG_INFO(ESP, "[ESP] Heap fragmentation: %u", ESP.getHeapFragmentation());
+	LOG_INFO(ESP, "[ESP] Max free block size: %u", ESP.getMaxFreeBlockSize());
+	LOG_INFO(ESP, "[ESP] Chip ID: %u", ESP.getChipId());
+	LOG_INFO(ESP, "[ESP] Core version: %s", ESP.getCoreVersion().c_str());
+	LOG_INFO(ESP, "[ESP] Full version: %s", ESP.getFullVersion().c_str());
+	LOG_INFO(ESP, "[ESP] SDK version: %s", ESP.getSdkVersion());
+	LOG_INFO(ESP, "[ESP] CPU frequency MHz: %u", ESP.getCpuFreqMHz());
+	LOG_INFO(ESP, "[ESP] Sketch size: %u", ESP.getSketchSize());
+	LOG_INFO(ESP, "[ESP] Free sketch space: %u", ESP.getFreeSketchSpace());
+	LOG_INFO(ESP, "[ESP] Sketch MD5: %s", ESP.getSketchMD5().c_str());
+	LOG_INFO(ESP, "[ESP] Flash chip ID: %u", ESP.getFlashChipId());
+	LOG_INFO(ESP, "[ESP] Flash chip size: %u", ESP.getFlashChipSize());
+	LOG_INFO(ESP, "[ESP] Flash chip speed: %u", ESP.getFlashChipSpeed());
+#ifdef ALLOC_TRACKING
+	LOG_INFO(ESP, "[ESP] Heap allocations since boot: %u (%u frees)", allocCount.allocs, allocCount.frees);
+	LOG_INFO(ESP, "[ESP] Loop passes with heap allocations: %u of %u, max %u per pass",
+		 allocCount.loopsAllocating, allocCount.loops, allocCount.maxPerLoop);
+#endif // ALLOC_TRACKING
+}
 
-	Serial.print("[ESP] Boot version: ");
-	Serial.println(ESP.getBootVersion());
+/*
+ * Print which driver refreshes the display and, for the timer driver, how
+ * much of each DISPLAY_TICK_US tick its interrupt uses.
+ */
+void printDisplayStats()
+{
+	DisplayTimerStats stats;
+	uint32_t lit, blank;
 
-	Serial.print("[ESP] Reset reason: ");
-	Serial.println(ESP.getResetReason());
+	nixieTap.getBlankStats(lit, blank);
+	LOG_INFO(DISPLAY, "[Display] Tubes lit for %u.%u h and blanked for %u.%u h, saving about %u Wh.",
+		 lit / 3600, lit % 3600 / 360, blank / 3600, blank % 3600 / 360,
+		 (uint32_t)((uint64_t)blank * NIXIE_LIT_MILLIWATTS / 3600000));
 
-	Serial.print("[ESP] Reset info: ");
-	Serial.println(ESP.getResetInfo());
+	if (!nixieTap.getTimerDriver()) {
+		LOG_INFO(DISPLAY, "[Display] Refreshed from the main loop.");
+		return;
+	}
+	nixieTap.getTimerStats(stats);
+	uint32_t mhz = ESP.getCpuFreqMHz();
+	uint32_t avg = stats.ticks ? stats.totalCycles / stats.ticks : 0;
+	LOG_INFO(DISPLAY, "[Display] Refreshed from the timer interrupt every %u us.", DISPLAY_TICK_US);
+	LOG_INFO(DISPLAY, "[Display] Interrupts: %u, frames latched: %u", stats.ticks, stats.latches);
+	LOG_INFO(DISPLAY, "[Display] Interrupt time: max %u.%02u us, average %u.%02u us, %u%% of a tick at most",
+		 stats.maxCycles / mhz, stats.maxCycles % mhz * 100 / mhz, avg / mhz, avg % mhz * 100 / mhz,
+		 stats.maxCycles / mhz * 100 / DISPLAY_TICK_US);
+}
 
-	Serial.print("[ESP] Free heap: ");
-	Serial.println(ESP.getFreeHeap());
+/*
+ * Print how often each task of the main loop has run, its share of the CPU
+ * time, and how late it has started. 'tasks reset' starts the counts over.
+ */
+void printTaskStats()
+{
+	uint64_t period = scheduler.statsPeriod();
+
+	LOG_INFO(SYSTEM, "[Tasks] Statistics for the last %u s, highest priority first:", (uint32_t)(period / 1000000));
+	for (uint8_t i = 0; i < scheduler.size(); i++) {
+		const Task &task = scheduler.task(i);
+		uint32_t share = period ? task.busyTime() * 10000 / period : 0;
+		LOG_INFO(SYSTEM, "[Tasks] %-8s runs %u, CPU %u.%02u%%, longest run %u us, latest start %u us, deadline misses %u",
+			 task.name(), task.runCount(), share / 100, share % 100,
+			 task.longestRun(), task.latestStart(), task.deadlineMisses());
+	}
+}
 
-	Serial.print("[ESP] Heap fragmentation: ");
-	Serial.println(ESP.getHeapFragmentation());
+/*
+ * Print whether the on-board RTC responds, and how long the calls to it
+ * have taken.
+ */
+void printRtcStats()
+{
+	const BQ32000Stats &stats = BQ32000RTC::stats();
+	const struct {
+		const char *name;
+		const BQ32000Timing &timing;
+	} calls[] = {
+		{ "get", stats.get },
+		{ "set", stats.set },
+		{ "setIRQ", stats.setIRQ },
+	};
+
+	LOG_INFO(TIME, "[RTC] Chip present: %s, I2C clock %u kHz", RTC.chipPresent() ? "yes" : "no", BQ32000_I2C_CLOCK / 1000);
+	for (const auto &call : calls) {
+		LOG_INFO(TIME, "[RTC] %s(): %u calls, average %u us, max %u us", call.name, call.timing.calls,
+			 call.timing.calls ? call.timing.totalMicros / call.timing.calls : 0, call.timing.maxMicros);
+	}
+	LOG_INFO(TIME, "[RTC] Bus recoveries: %u, failed: %u", stats.busRecoveries, stats.busFailures);
+}
 
-	Serial.print("[ESP] Max free block size: ");
-	Serial.println(ESP.getMaxFreeBlockSize());
+/*
+ * Print how many time code sentences have been sent, and how long after the
+ * second edge they were handed to the UART.
+ */
+void printTimeCodeStats()
+{
+	const TimeCodeStats &stats = timeCode.getStats();
 
-	Serial.print("[ESP] Chip ID: ");
-	Serial.println(ESP.getChipId());
+	if (!timeCode.running()) {
+		LOG_INFO(TIME, "[Time Code] Not running.");
+		return;
+	}
+	LOG_INFO(TIME, "[Time Code] Sentences sent: %u, skipped: %u", stats.sent, stats.skipped);
+	LOG_INFO(TIME, "[Time Code] Edge to UART latency: average %u us, max %u us",
+		 stats.sent ? (uint32_t)(stats.totalLateMicros / stats.sent) : 0, stats.maxLateMicros);
+}
 
-	Serial.print("[ESP] Core version: ");
-	Serial.println(ESP.getCoreVersion());
+/*
+ * Start or stop the SNTP server to match its setting.
+ */
+void updateSntpServer()
+{
+	if (cfg_sntp_server && !sntpServer.running()) {
+		sntpServer.begin();
+		updateSntpStatus();
+	} else if (!cfg_sntp_server && sntpServer.running()) {
+		sntpServer.end();
+	}
+}
 
-	Serial.print("[ESP] Full version: ");
-	Serial.println(ESP.getFullVersion());
+/*
+ * Report the stratum, leap indicator and error bounds of the clock to the
+ * SNTP server. The maximum error grows with the time since the last sync,
+ * and past SNTP_MAX_SYNC_AGE, or if NTP has never synced, the clock is
+ * reported as unsynchronised.
+ */
+void updateSntpStatus()
+{
+	SntpStatus status;
+	uint32_t age = Clock.sinceSync();
+
+	if (age <= SNTP_MAX_SYNC_AGE) {
+		status.leap = SNTP_LEAP_NONE;
+		status.stratum = SNTP_UPSTREAM_STRATUM + 1;
+		status.refId = ntpRefId;
+		status.refTimeMicros = Clock.lastSyncMicros();
+		status.rootDelayMicros = ntpDelayMicros;
+		status.rootDispersionMicros = SNTP_SYNC_DISPERSION_US + age * SNTP_DRIFT_PPM;
+	}
+	sntpServer.setStatus(status);
+}
 
-	Serial.print("[ESP] SDK version: ");
-	Serial.println(ESP.getSdkVersion());
+/*
+ * Start or stop sending metrics to match the metrics_host setting.
+ */
+void updateMetrics()
+{
+	if (cfg_metrics_host[0] != '\0') {
+		metrics.begin(cfg_metrics_host);
+	} else if (metrics.running()) {
+		LOG_INFO(SYSTEM, "[Metrics] Stopped sending metrics.");
+		metrics.end();
+	}
+	last_metrics = millis();
+	loopLatency.reset();
+}
 
-	Serial.print("[ESP] CPU frequency MHz: ");
-	Serial.println(ESP.getCpuFreqMHz());
+/*
+ * Send one metrics report covering the time since the last one.
+ */
+void sendMetrics()
+{
+	char tags[24];
+
+	last_metrics = millis();
+	if (WiFi.status() == WL_CONNECTED) {
+		snprintf(tags, sizeof(tags), "host=nixietap-%06x", ESP.getChipId());
+		metrics.start("nixietap", tags);
+		metrics.field("uptime_s", (int64_t)(micros64() / 1000000));
+		metrics.field("heap_free", (int64_t)ESP.getFreeHeap());
+		metrics.field("heap_frag_pct", (int64_t)ESP.getHeapFragmentation());
+		metrics.field("heap_max_block", (int64_t)ESP.getMaxFreeBlockSize());
+		metrics.field("rssi_dbm", (int64_t)WiFi.RSSI());
+		metrics.field("wifi_online_s", (int64_t)(wifiRoamer.onlineMillis() / 1000));
+		metrics.field("wifi_disconnects", (int64_t)wifiRoamer.getStats().disconnects);
+		metrics.field("wifi_roams", (int64_t)wifiRoamer.getStats().roams);
+		if (Clock.sinceSync() != UINT32_MAX) {
+			metrics.field("ntp_sync_age_s", (int64_t)Clock.sinceSync());
+			metrics.field("ntp_offset_us", (int64_t)ntpOffsetMicros);
+			metrics.field("ntp_delay_us", (int64_t)ntpDelayMicros);
+			metrics.field("ntp_jitter_us", (int64_t)ntpJitterMicros);
+		}
+		metrics.field("loop_count", (int64_t)loopLatency.count());
+		metrics.field("loop_p50_us", (int64_t)loopLatency.percentile(50));
+		metrics.field("loop_p90_us", (int64_t)loopLatency.percentile(90));
+		metrics.field("loop_p99_us", (int64_t)loopLatency.percentile(99));
+		metrics.field("loop_max_us", (int64_t)loopLatency.max());
+		metrics.field("spi_frames", (int64_t)nixieTap.getFrameCount());
+		if (sntpServer.running()) {
+			metrics.field("sntp_requests", (int64_t)sntpServer.getStats().requests);
+		}
+		metrics.send(Clock.isSet() ? Clock.nowMicros() * 1000 : 0);
+	}
+	loopLatency.reset();
+}
 
-	Serial.print("[ESP] Sketch size: ");
-	Serial.println(ESP.getSketchSize());
+/*
+ * Print the state of the Wi-Fi connection, and how reliably it has been
+ * established and kept since boot.
+ */
+void printWifiStats()
+{
+	static const char *const STATE_NAMES[] = { "idle", "scanning", "connecting", "online", "backing off" };
+	const WifiStats &stats = wifiRoamer.getStats();
+	uint32_t online = wifiRoamer.onlineMillis() / 1000;
+	uint32_t uptime = micros64() / 1000000;
+
+	LOG_INFO(WIFI, "[Wi-Fi] State: %s, network \"%s\", RSSI %d dBm",
+		 STATE_NAMES[wifiRoamer.getState()], wifiRoamer.network(), (int)WiFi.RSSI());
+	if (wifiRoamer.getState() == WIFI_BACKOFF) {
+		LOG_INFO(WIFI, "[Wi-Fi] %u consecutive failed attempts, waiting %u ms.",
+			 wifiRoamer.failedAttempts(), wifiRoamer.backoffMillis());
+	}
+	LOG_INFO(WIFI, "[Wi-Fi] Scans: %u, attempts: %u, connects: %u, failures: %u, disconnects: %u, roams: %u",
+		 stats.scans, stats.attempts, stats.connects, stats.failures, stats.disconnects, stats.roams);
+	LOG_INFO(WIFI, "[Wi-Fi] Connect time: average %u ms, max %u ms",
+		 stats.connects ? (uint32_t)(stats.totalConnectMillis / stats.connects) : 0, stats.maxConnectMillis);
+	LOG_INFO(WIFI, "[Wi-Fi] Online %u s of %u s uptime (%u%%)", online, uptime, uptime ? (uint32_t)((uint64_t)online * 100 / uptime) : 0);
+	for (uint8_t i = 0; i < WIFI_REASON_BUCKETS; i++) {
+		uint8_t reason = WifiRoamer::bucketReason(i);
+		if (stats.reasons[i] == 0) {
+			continue;
+		}
+		LOG_INFO(WIFI, "[Wi-Fi] Disconnect reason %s (%u): %u",
+			 reason ? wifiDisconnectReasonStr((WiFiDisconnectReason)reason) : "other", reason, stats.reasons[i]);
+	}
+}
 
-	Serial.print("[ESP] Free sketch space: ");
-	Serial.println(ESP.getFreeSketchSpace());
+void printSntpStats()
+{
+	if (!sntpServer.running()) {
+		LOG_INFO(NTP, "[SNTP] Server is not running.");
+		return;
+	}
+	const SntpStats &stats = sntpServer.getStats();
+	uint32_t uptime = sntpServer.uptime();
+	uint32_t sync = Clock.sinceSync();
+	if (sync == UINT32_MAX) {
+		LOG_INFO(NTP, "[SNTP] Serving unsynchronised time, NTP has not synced yet.");
+	} else if (sync > SNTP_MAX_SYNC_AGE) {
+		LOG_INFO(NTP, "[SNTP] Serving unsynchronised time, last synced %u s ago.", sync);
+	} else {
+		LOG_INFO(NTP, "[SNTP] Serving stratum %u time, last synced %u s ago.", SNTP_UPSTREAM_STRATUM + 1, sync);
+	}
+	LOG_INFO(NTP, "[SNTP] %u requests in %u s, %u.%02u per second on average, %u at peak.",
+		 stats.requests, uptime, uptime ? stats.requests / uptime : 0, uptime ? stats.requests * 100 / uptime % 100 : 0, stats.peakRate);
+	LOG_INFO(NTP, "[SNTP] %u responses, %u requests rejected.", stats.responses, stats.rejected);
+	if (stats.responses) {
+		LOG_INFO(NTP, "[SNTP] Response latency %u us on average, %u us at most.",
+			 (uint32_t)(stats.totalLatencyMicros / stats.responses), stats.maxLatencyMicros);
+	}
+}
 
-	Serial.print("[ESP] Sketch MD5: ");
-	Serial.println(ESP.getSketchMD5());
+/*
+ * Print the system information, settings, time source, NTP statistics and
+ * counters as a single line of JSON, for automated polling. The passwords are
+ * never included, only whether each is set.
+ */
+void printStatusJson()
+{
+	static char buf[STATUS_JSON_SIZE];
+	JsonWriter json(buf, sizeof(buf));
+	PrintBuffer<64> local;
+	char text[16];
+
+	json.beginObject();
+	json.add("schema", (uint32_t)STATUS_JSON_SCHEMA);
+	json.add("uptime_s", (uint64_t)(micros64() / 1000000));
+
+	json.beginObject("esp");
+	json.add("chip_id", ESP.getChipId());
+	json.add("sdk", ESP.getSdkVersion());
+	json.add("cpu_mhz", (uint32_t)ESP.getCpuFreqMHz());
+	json.add("reset_reason", (uint32_t)ESP.getResetInfoPtr()->reason);
+	json.add("warm_boot", warmBoot);
+	json.add("free_heap", ESP.getFreeHeap());
+	json.add("heap_frag_pct", (uint32_t)ESP.getHeapFragmentation());
+	json.add("max_free_block", ESP.getMaxFreeBlockSize());
+	json.add("sketch_size", ESP.getSketchSize());
+	json.add("free_sketch_space", ESP.getFreeSketchSpace());
+	json.add("flash_size", ESP.getFlashChipSize());
+	json.endObject();
+
+	json.beginObject("settings");
+	json.add("24hr_enabled", (uint32_t)cfg_24hr_enabled);
+	json.add("ntp_enabled", (uint32_t)cfg_ntp_enabled);
+	json.add("ntp_sync_interval", cfg_ntp_sync_interval);
+	json.add("display_timer", (uint32_t)cfg_display_timer);
+	json.add("sntp_server", (uint32_t)cfg_sntp_server);
+	json.add("time_code", (uint32_t)cfg_time_code);
+	snprintf(text, sizeof(text), "%02u:%02u", cfg_night_start / 60, cfg_night_start % 60);
+	json.add("night_start", text);
+	snprintf(text, sizeof(text), "%02u:%02u", cfg_night_end / 60, cfg_night_end % 60);
+	json.add("night_end", text);
+	json.add("idle_timeout", (uint32_t)cfg_idle_timeout);
+	json.add("wake_time", (uint32_t)cfg_wake_time);
+	json.add("metrics_host", cfg_metrics_host);
+	json.add("metrics_interval", (uint32_t)cfg_metrics_interval);
+	json.add("ota_url", cfg_ota_url);
+	json.add("ntp_server", cfg_ntp_server);
+	json.add("time_zone", cfg_time_zone);
+	json.add("world_zones", cfg_world_zones);
+	json.add("ssid", cfg_ssid);
+	json.add("password_set", cfg_password[0] != '\0');
+	json.add("ssid2", cfg_ssid2);
+	json.add("password2_set", cfg_password2[0] != '\0');
+	json.add("ssid3", cfg_ssid3);
+	json.add("password3_set", cfg_password3[0] != '\0');
+	json.endObject();
+
+	json.beginObject("time");
+	time_t t = now();
+	ZonedDateTime::forUnixSeconds64(t, time_zone).printTo(local);
+	json.add("unix", (int64_t)t);
+	json.add("local", local.c_str());
+	json.add("source", time_source);
+	json.add("alarms", (uint32_t)alarms.size());
+	json.endObject();
+
+	json.beginObject("ntp");
+	json.add("running", ntpInitialized);
+	uint32_t age = Clock.sinceSync();
+	if (age == UINT32_MAX) {
+		json.addNull("sync_age_s");
+	} else {
+		json.add("sync_age_s", age);
+		json.add("offset_us", ntpOffsetMicros);
+		json.add("delay_us", ntpDelayMicros);
+		json.add("jitter_us", ntpJitterMicros);
+	}
+	json.endObject();
+
+	json.beginObject("wifi");
+	json.add("connected", WiFi.status() == WL_CONNECTED);
+	IPAddress ip = WiFi.localIP();
+	snprintf(text, sizeof(text), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+	json.add("ip", text);
+	json.add("rssi_dbm", (int32_t)WiFi.RSSI());
+	json.add("network", wifiRoamer.network());
+	json.add("attempts", wifiRoamer.getStats().attempts);
+	json.add("disconnects", wifiRoamer.getStats().disconnects);
+	json.add("roams", wifiRoamer.getStats().roams);
+	json.add("online_s", (uint32_t)(wifiRoamer.onlineMillis() / 1000));
+	json.endObject();
+
+	json.beginObject("display");
+	uint32_t lit, blank;
+	nixieTap.getBlankStats(lit, blank);
+	json.add("blanked", nixieTap.getBlank());
+	json.add("timer_driver", nixieTap.getTimerDriver());
+	json.add("lit_s", lit);
+	json.add("blank_s", blank);
+	json.add("spi_frames", nixieTap.getFrameCount());
+	json.endObject();
+
+	json.beginObject("counters");
+	json.add("log_dropped", Log.dropped());
+	const SntpStats &sntp = sntpServer.getStats();
+	json.add("sntp_requests", sntp.requests);
+	json.add("sntp_responses", sntp.responses);
+	json.add("sntp_rejected", sntp.rejected);
+	json.add("metrics_sent", metrics.sent());
+	json.add("metrics_failed", metrics.failed());
+	json.add("stalls", Stall.stalls());
+	json.endObject();
+
+	json.beginObject("stall");
+	const StallRecord &stall = Stall.lastStall();
+	if (stall.passMicros != 0) {
+		json.add("last_stage", stall.stage);
+		json.add("last_pass_ms", stall.passMicros / 1000);
+	} else {
+		json.addNull("last_stage");
+		json.addNull("last_pass_ms");
+	}
+	if (Stall.resetStage()[0] != '\0') {
+		json.add("reset_stage", Stall.resetStage());
+	} else {
+		json.addNull("reset_stage");
+	}
+	json.endObject();
+	json.endObject();
+
+	if (!json.ok()) {
+		LOG_ERROR(CONSOLE, "Status does not fit in %u bytes.", STATUS_JSON_SIZE);
+		return;
+	}
+	// The line is longer than a log message can be, so it bypasses the
+	// ring buffer, after the messages already in it.
+	Log.flush();
+	Serial.write((const uint8_t *)json.c_str(), json.length());
+	Serial.write((const uint8_t *)"\r\n", 2);
+}
 
-	Serial.print("[ESP] Flash chip ID: ");
-	Serial.println(ESP.getFlashChipId());
+// Consumes the results of the benchmarked kernels so that they are not
+// optimised away.
+static volatile uint32_t benchSink;
+
+/*
+ * Time 'iterations' calls of 'kernel', less the cost of calling an empty
+ * kernel 'overhead' cycles, and print the cost of one call. Each result is
+ * printed as one line of key=value pairs, so that runs can be compared by
+ * scripts.
+ */
+static uint32_t benchKernel(const char *name, uint32_t iterations, void (*kernel)(uint32_t), uint32_t overhead)
+{
+#ifdef ALLOC_TRACKING
+	uint32_t allocs = allocCount.allocs;
+#endif // ALLOC_TRACKING
+	uint32_t start = ESP.getCycleCount();
+	for (uint32_t i = 0; i < iterations; i++) {
+		kernel(i);
+	}
+	uint32_t cycles = (ESP.getCycleCount() - start) / iterations;
+	cycles = cycles > overhead ? cycles - overhead : 0;
+	if (name == NULL) {
+		return cycles;
+	}
+#ifdef ALLOC_TRACKING
+	allocs = allocCount.allocs - allocs;
+	LOG_INFO(SYSTEM, "[Bench] kernel=%s iterations=%u cycles_per_op=%u ns_per_op=%u allocs_per_op=%u.%03u",
+		 name, iterations, cycles, cycles * 1000 / ESP.getCpuFreqMHz(),
+		 allocs / iterations, allocs % iterations * 1000 / iterations);
+#else
+	LOG_INFO(SYSTEM, "[Bench] kernel=%s iterations=%u cycles_per_op=%u ns_per_op=%u",
+		 name, iterations, cycles, cycles * 1000 / ESP.getCpuFreqMHz());
+#endif // ALLOC_TRACKING
+	return cycles;
+}
 
-	Serial.print("[ESP] Flash chip size: ");
-	Serial.println(ESP.getFlashChipSize());
+/*
+ * Benchmark the code that runs on every pass of the main loop or every
+ * display frame, on the clock's own hardware. This blocks for a few tenths
+ * of a second; the display timer interrupt, if enabled, keeps running and
+ * its time is included in the results.
+ */
+void printBenchmarks()
+{
+	static const time_t BENCH_EPOCH = 1700000000;
+	uint32_t overhead;
+
+	Log.flush();
+	LOG_INFO(SYSTEM, "[Bench] cpu_mhz=%u", ESP.getCpuFreqMHz());
+	overhead = benchKernel(NULL, 10000, [](uint32_t) {}, 0);
+
+	benchKernel("frame_encode", 10000, [](uint32_t i) {
+		uint8_t digits[NIXIE_TUBES] = { (uint8_t)(i % 10), (uint8_t)(i / 10 % 10), (uint8_t)(i / 100 % 10), (uint8_t)(i / 1000 % 10) };
+		uint8_t frame[NIXIE_FRAME_BYTES];
+		nixieTap.encodeFrame(digits, i & 0b11110, frame);
+		benchSink = frame[0] ^ frame[4];
+	}, overhead);
+
+	benchKernel("tz_offset_table", 10000, [](uint32_t i) {
+		benchSink = zoneOffset(time_zone, tzTable, BENCH_EPOCH + i * 3607);
+	}, overhead);
+
+	benchKernel("tz_offset_acetime", 200, [](uint32_t i) {
+		benchSink = ZonedDateTime::forUnixSeconds64(BENCH_EPOCH + i * 3607, time_zone).timeOffset().toSeconds();
+	}, overhead);
+
+	benchKernel("antipoison_spin", 2000, [](uint32_t i) {
+		uint8_t from[NIXIE_TUBES] = { 1, (uint8_t)(i % 10), 5, 9 };
+		uint8_t to[NIXIE_TUBES] = { (uint8_t)(i / 10 % 10), 3, 0, (uint8_t)(i % 7) };
+		uint8_t digits[NIXIE_TUBES];
+		SlotSpin spin(SLOT_DEFAULT_REEL, NIXIE_TUBES, from, to);
+		for (uint8_t f = 0; f <= spin.frames(); f++) {
+			spin.frame(f, digits);
+		}
+		benchSink = digits[0];
+	}, overhead);
+
+	benchKernel("marquee_step", 10000, [](uint32_t i) {
+		static Marquee marquee;
+		uint8_t digits[NIXIE_TUBES], dots;
+		if (i == 0) {
+			marquee.begin("192.168.100.200 -12.5");
+		}
+		marquee.step();
+		marquee.frame(digits, dots);
+		benchSink = digits[0] ^ dots;
+	}, overhead);
+
+	benchKernel("time_format", 200, [](uint32_t i) {
+		PrintBuffer<64> buf;
+		ZonedDateTime::forUnixSeconds64(BENCH_EPOCH + i * 3607, time_zone).printTo(buf);
+		benchSink = buf.c_str()[0];
+	}, overhead);
+
+	benchKernel("civil_time", 10000, [](uint32_t i) {
+		// Every call starts a new minute, the worst case.
+		static CivilClock civil;
+		benchSink = civil.at(BENCH_EPOCH + i * 61).day;
+	}, overhead);
+
+	benchKernel("iso8601_format", 2000, [](uint32_t i) {
+		char line[ISO8601_MAX + sizeof(cfg_time_zone)];
+		time_t t = BENCH_EPOCH + i * 3607;
+		formatIso8601(line, sizeof(line), t, i % 1000, zoneOffset(time_zone, tzTable, t), cfg_time_zone);
+		benchSink = line[0];
+	}, overhead);
+
+	benchKernel("bcd_convert", 10000, [](uint32_t i) {
+		benchSink = BQ32000RTC::bcd2bin(BQ32000RTC::bin2bcd(i % 100));
+	}, overhead);
+	Log.flush();
+}
 
-	Serial.print("[ESP] Flash chip speed: ");
-	Serial.println(ESP.getFlashChipSpeed());
+void printLog(unsigned int lines)
+{
+	Log.printHistory(lines);
+	LOG_INFO(SYSTEM, "[Log] %u messages dropped since boot.", Log.dropped());
 }
 
 void printTime(time_t t)
 {
 	if (t > last_printed_time) {
-		Serial.print("[Time] The time is now: ");
-		ZonedDateTime::forUnixSeconds64(t, time_zone).printTo(Serial);
-		Serial.print(" @ ");
-		Serial.println(t);
+		printTimestamp(t, -1);
 		last_printed_time = t;
 	}
 }
 
+/*
+ * Print the time 't' and 'millis' milliseconds in the local time zone, or
+ * whole seconds if 'millis' is negative. The UTC offset comes from the
+ * transition table, and the line is formatted on the stack.
+ */
+void printTimestamp(time_t t, int16_t millis)
+{
+	if (LOG_ENABLED(INFO, TIME)) {
+		char line[ISO8601_MAX + sizeof(cfg_time_zone)];
+		formatIso8601(line, sizeof(line), t, millis, zoneOffset(time_zone, tzTable, t), cfg_time_zone);
+		LOG_INFO(TIME, "[Time] The time is now: %s", line);
+	}
+}
+
+/*
+ * Print the time each time the ticker is due. Above one line per second the
+ * lines show milliseconds, taken from the sub-second wall clock.
+ */
+void printTicker()
+{
+	if (tickerRate == 1 || !Clock.isSet()) {
+		printTime(now());
+		return;
+	}
+
+	uint64_t us = Clock.nowMicros();
+	uint64_t tick = us / (1000000 / tickerRate);
+	if (tick != tickerLast) {
+		tickerLast = tick;
+		printTimestamp(us / 1000000, us / 1000 % 1000);
+	}
+}
+
+/*
+ * Print the time zone transition table used to convert UTC to local time.
+ */
+void printTzTable()
+{
+	if (tzTable.count == 0) {
+		LOG_INFO(TIME, "[Time] No transition table, converting with AceTime.");
+		return;
+	}
+	LOG_INFO(TIME, "[Time] Transitions for %s, %d-%d:", cfg_time_zone,
+		 tzTable.firstYear, tzTable.firstYear + TZ_TABLE_YEARS - 1);
+	for (uint8_t i = 0; i < tzTable.count; i++) {
+		const TzTransition &tr = tzTable.entries[i];
+		int16_t m = tr.offsetMinutes < 0 ? -tr.offsetMinutes : tr.offsetMinutes;
+		LOG_INFO(TIME, "[Time] %lu UTC%c%02d:%02d %s", (unsigned long)tr.utc,
+			 tr.offsetMinutes < 0 ? '-' : '+', m / 60, m % 60, tr.abbrev);
+	}
+}
+
+/*
+ * Print the on-time of each cathode, and the exercise still owed to the
+ * under-used ones by the anti-poisoning routine.
+ */
+void printWear()
+{
+	static const char *const TUBE_NAMES[NIXIE_TUBES] = { "H1", "H0", "M1", "M0" };
+	char line[LOG_LINE_MAX];
+	int len;
+
+	LOG_INFO(DISPLAY, "[Wear] Cathode on-time in hours, digits 0-9:");
+	for (uint8_t tube = 0; tube < NIXIE_TUBES; tube++) {
+		len = 0;
+		for (uint8_t digit = 0; digit < NIXIE_DIGITS; digit++) {
+			uint32_t s = nixieTap.getWear(tube, digit);
+			len += snprintf(line + len, sizeof(line) - len, " %u.%u", s / 3600, s % 3600 / 360);
+		}
+		LOG_INFO(DISPLAY, "[Wear] %s:%s", TUBE_NAMES[tube], line);
+	}
+
+	LOG_INFO(DISPLAY, "[Wear] Anti-poisoning exercise owed in seconds, digits 0-9:");
+	for (uint8_t tube = 0; tube < NIXIE_TUBES; tube++) {
+		len = 0;
+		for (uint8_t digit = 0; digit < NIXIE_DIGITS; digit++) {
+			uint32_t ms = nixieTap.getWearDeficit(tube, digit);
+			len += snprintf(line + len, sizeof(line) - len, " %u", (ms + 999) / 1000);
+		}
+		LOG_INFO(DISPLAY, "[Wear] %s:%s", TUBE_NAMES[tube], line);
+	}
+}
+
 void readParameters()
 {
-	Serial.println("[EEPROM] Reading settings from non-volatile memory.");
+	LOG_INFO(EEPROM, "[EEPROM] Reading settings from non-volatile memory.");
 
 	EEPROM.get(EEPROM_ADDR__24HR_ENABLED, cfg_24hr_enabled);
-	Serial.print("[EEPROM Read] ");
-	Serial.print("24hr_enabled: ");
-	Serial.println(cfg_24hr_enabled);
+	LOG_INFO(EEPROM, "[EEPROM Read] 24hr_enabled: %u", cfg_24hr_enabled);
 
 	EEPROM.get(EEPROM_ADDR__NTP_ENABLED, cfg_ntp_enabled);
-	Serial.print("[EEPROM Read] ");
-	Serial.print("ntp_enabled: ");
-	Serial.println(cfg_ntp_enabled);
+	LOG_INFO(EEPROM, "[EEPROM Read] ntp_enabled: %u", cfg_ntp_enabled);
+
+	EEPROM.get(EEPROM_ADDR__DISPLAY_TIMER, cfg_display_timer);
+	// Settings written by older firmware do not include this one.
+	if (cfg_display_timer > 1) {
+		cfg_display_timer = DEFAULT__DISPLAY_TIMER;
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] display_timer: %u", cfg_display_timer);
+
+	EEPROM.get(EEPROM_ADDR__SNTP_SERVER, cfg_sntp_server);
+	// Settings written by older firmware do not include this one.
+	if (cfg_sntp_server > 1) {
+		cfg_sntp_server = DEFAULT__SNTP_SERVER;
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] sntp_server: %u", cfg_sntp_server);
+
+	EEPROM.get(EEPROM_ADDR__TIME_CODE, cfg_time_code);
+	// Settings written by older firmware do not include this one.
+	if (cfg_time_code >= TIMECODE_FORMAT_COUNT) {
+		cfg_time_code = DEFAULT__TIME_CODE;
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] time_code: %u", cfg_time_code);
+
+	EEPROM.get(EEPROM_ADDR__NIGHT_START, cfg_night_start);
+	EEPROM.get(EEPROM_ADDR__NIGHT_END, cfg_night_end);
+	EEPROM.get(EEPROM_ADDR__IDLE_TIMEOUT, cfg_idle_timeout);
+	EEPROM.get(EEPROM_ADDR__WAKE_TIME, cfg_wake_time);
+	EEPROM.get(EEPROM_ADDR__METRICS_INTERVAL, cfg_metrics_interval);
+	// Settings written by older firmware do not include these.
+	if (cfg_night_start >= 24 * 60 || cfg_night_end >= 24 * 60) {
+		cfg_night_start = DEFAULT__NIGHT_START;
+		cfg_night_end = DEFAULT__NIGHT_END;
+	}
+	if (cfg_idle_timeout == 0xffff) {
+		cfg_idle_timeout = DEFAULT__IDLE_TIMEOUT;
+	}
+	if (cfg_wake_time == 0xffff) {
+		cfg_wake_time = DEFAULT__WAKE_TIME;
+	}
+	if (cfg_metrics_interval == 0 || cfg_metrics_interval > METRICS_INTERVAL_MAX) {
+		cfg_metrics_interval = DEFAULT__METRICS_INTERVAL;
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] night_start: %02u:%02u", cfg_night_start / 60, cfg_night_start % 60);
+	LOG_INFO(EEPROM, "[EEPROM Read] night_end: %02u:%02u", cfg_night_end / 60, cfg_night_end % 60);
+	LOG_INFO(EEPROM, "[EEPROM Read] idle_timeout: %u", cfg_idle_timeout);
+	LOG_INFO(EEPROM, "[EEPROM Read] wake_time: %u", cfg_wake_time);
+	LOG_INFO(EEPROM, "[EEPROM Read] metrics_interval: %u", cfg_metrics_interval);
 
 	EEPROM.get(EEPROM_ADDR__NTP_SYNC_INTERVAL, cfg_ntp_sync_interval);
-	Serial.print("[EEPROM Read] ");
-	Serial.print("ntp_sync_interval: ");
-	Serial.println(cfg_ntp_sync_interval);
+	LOG_INFO(EEPROM, "[EEPROM Read] ntp_sync_interval: %u", cfg_ntp_sync_interval);
 
 	EEPROM.get(EEPROM_ADDR__NTP_SERVER, cfg_ntp_server);
-	Serial.print("[EEPROM Read] ");
-	Serial.print("ntp_server: ");
-	Serial.println(cfg_ntp_server);
+	LOG_INFO(EEPROM, "[EEPROM Read] ntp_server: %s", cfg_ntp_server);
 
 	EEPROM.get(EEPROM_ADDR__TIME_ZONE, cfg_time_zone);
-	Serial.print("[EEPROM Read] ");
-	Serial.print("time_zone: ");
-	Serial.println(cfg_time_zone);
+	LOG_INFO(EEPROM, "[EEPROM Read] time_zone: %s", cfg_time_zone);
+
+	EEPROM.get(EEPROM_ADDR__WORLD_ZONES, cfg_world_zones);
+	// Settings written by older firmware do not include this one.
+	cfg_world_zones[sizeof(cfg_world_zones) - 1] = '\0';
+	if (!isprint(cfg_world_zones[0])) {
+		cfg_world_zones[0] = '\0';
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] world_zones: %s", cfg_world_zones);
+
+	EEPROM.get(EEPROM_ADDR__METRICS_HOST, cfg_metrics_host);
+	// Settings written by older firmware do not include this one.
+	cfg_metrics_host[sizeof(cfg_metrics_host) - 1] = '\0';
+	if (!isprint(cfg_metrics_host[0])) {
+		cfg_metrics_host[0] = '\0';
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] metrics_host: %s", cfg_metrics_host);
+
+	EEPROM.get(EEPROM_ADDR__OTA_URL, cfg_ota_url);
+	// Settings written by older firmware do not include this one.
+	cfg_ota_url[sizeof(cfg_ota_url) - 1] = '\0';
+	if (!isprint(cfg_ota_url[0])) {
+		cfg_ota_url[0] = '\0';
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] ota_url: %s", cfg_ota_url);
 
 	EEPROM.get(EEPROM_ADDR__SSID, cfg_ssid);
-	Serial.print("[EEPROM Read] ");
-	Serial.print("ssid: ");
-	Serial.println(cfg_ssid);
+	LOG_INFO(EEPROM, "[EEPROM Read] ssid: %s", cfg_ssid);
 
 	EEPROM.get(EEPROM_ADDR__PASSWORD, cfg_password);
-	Serial.print("[EEPROM Read] ");
-	Serial.print("password: ");
-	Serial.println(cfg_password);
+	LOG_INFO(EEPROM, "[EEPROM Read] password: %s", cfg_password);
+
+	EEPROM.get(EEPROM_ADDR__SSID2, cfg_ssid2);
+	EEPROM.get(EEPROM_ADDR__PASSWORD2, cfg_password2);
+	EEPROM.get(EEPROM_ADDR__SSID3, cfg_ssid3);
+	EEPROM.get(EEPROM_ADDR__PASSWORD3, cfg_password3);
+	// Settings written by older firmware do not include these.
+	char *extra[] = { cfg_ssid2, cfg_password2, cfg_ssid3, cfg_password3 };
+	for (char *value : extra) {
+		value[sizeof(cfg_ssid2) - 1] = '\0';
+		if (!isprint(value[0])) {
+			value[0] = '\0';
+		}
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] ssid2: %s", cfg_ssid2);
+	LOG_INFO(EEPROM, "[EEPROM Read] password2: %s", cfg_password2);
+	LOG_INFO(EEPROM, "[EEPROM Read] ssid3: %s", cfg_ssid3);
+	LOG_INFO(EEPROM, "[EEPROM Read] password3: %s", cfg_password3);
 }
 
 void resetEepromToDefault()
 {
-	Serial.println("[EEPROM] Writing defaults to non-volatile memory.");
+	LOG_INFO(EEPROM, "[EEPROM] Writing defaults to non-volatile memory.");
 
-	EEPROM.begin(512);
+	EEPROM.begin(EEPROM_SIZE);
 
 	EEPROM.put(EEPROM_ADDR__24HR_ENABLED, DEFAULT__24HR_ENABLED);
-	Serial.print("[EEPROM Reset] ");
-	Serial.print("24hr_enabled: ");
-	Serial.println(DEFAULT__24HR_ENABLED);
+	LOG_INFO(EEPROM, "[EEPROM Reset] 24hr_enabled: %u", DEFAULT__24HR_ENABLED);
 
 	EEPROM.put(EEPROM_ADDR__NTP_ENABLED, DEFAULT__NTP_ENABLED);
-	Serial.print("[EEPROM Reset] ");
-	Serial.print("ntp_enabled: ");
-	Serial.println(DEFAULT__NTP_ENABLED);
+	LOG_INFO(EEPROM, "[EEPROM Reset] ntp_enabled: %u", DEFAULT__NTP_ENABLED);
+
+	EEPROM.put(EEPROM_ADDR__DISPLAY_TIMER, DEFAULT__DISPLAY_TIMER);
+	LOG_INFO(EEPROM, "[EEPROM Reset] display_timer: %u", DEFAULT__DISPLAY_TIMER);
+
+	EEPROM.put(EEPROM_ADDR__SNTP_SERVER, DEFAULT__SNTP_SERVER);
+	LOG_INFO(EEPROM, "[EEPROM Reset] sntp_server: %u", DEFAULT__SNTP_SERVER);
+
+	EEPROM.put(EEPROM_ADDR__TIME_CODE, (uint8_t)DEFAULT__TIME_CODE);
+	LOG_INFO(EEPROM, "[EEPROM Reset] time_code: %u", DEFAULT__TIME_CODE);
+
+	EEPROM.put(EEPROM_ADDR__NIGHT_START, (uint16_t)DEFAULT__NIGHT_START);
+	LOG_INFO(EEPROM, "[EEPROM Reset] night_start: %02u:%02u", DEFAULT__NIGHT_START / 60, DEFAULT__NIGHT_START % 60);
+
+	EEPROM.put(EEPROM_ADDR__NIGHT_END, (uint16_t)DEFAULT__NIGHT_END);
+	LOG_INFO(EEPROM, "[EEPROM Reset] night_end: %02u:%02u", DEFAULT__NIGHT_END / 60, DEFAULT__NIGHT_END % 60);
+
+	EEPROM.put(EEPROM_ADDR__IDLE_TIMEOUT, (uint16_t)DEFAULT__IDLE_TIMEOUT);
+	LOG_INFO(EEPROM, "[EEPROM Reset] idle_timeout: %u", DEFAULT__IDLE_TIMEOUT);
+
+	EEPROM.put(EEPROM_ADDR__WAKE_TIME, (uint16_t)DEFAULT__WAKE_TIME);
+	LOG_INFO(EEPROM, "[EEPROM Reset] wake_time: %u", DEFAULT__WAKE_TIME);
+
+	EEPROM.put(EEPROM_ADDR__METRICS_INTERVAL, (uint16_t)DEFAULT__METRICS_INTERVAL);
+	LOG_INFO(EEPROM, "[EEPROM Reset] metrics_interval: %u", DEFAULT__METRICS_INTERVAL);
 
 	EEPROM.put(EEPROM_ADDR__NTP_SERVER, DEFAULT__NTP_SERVER);
-	Serial.print("[EEPROM Reset] ");
-	Serial.print("ntp_server: ");
-	Serial.println(DEFAULT__NTP_ENABLED);
+	LOG_INFO(EEPROM, "[EEPROM Reset] ntp_server: %s", DEFAULT__NTP_SERVER);
 
 	EEPROM.put(EEPROM_ADDR__NTP_SYNC_INTERVAL, DEFAULT__NTP_SYNC_INTERVAL);
-	Serial.print("[EEPROM Reset] ");
-	Serial.print("ntp_sync_interval: ");
-	Serial.println(DEFAULT__NTP_SYNC_INTERVAL);
+	LOG_INFO(EEPROM, "[EEPROM Reset] ntp_sync_interval: %u", DEFAULT__NTP_SYNC_INTERVAL);
 
 	EEPROM.put(EEPROM_ADDR__TIME_ZONE, DEFAULT__TIME_ZONE);
-	Serial.print("[EEPROM Reset] ");
-	Serial.print("time_zone: ");
-	Serial.println(DEFAULT__TIME_ZONE);
+	LOG_INFO(EEPROM, "[EEPROM Reset] time_zone: %s", DEFAULT__TIME_ZONE);
+
+	EEPROM.put(EEPROM_ADDR__WORLD_ZONES, DEFAULT__WORLD_ZONES);
+	LOG_INFO(EEPROM, "[EEPROM Reset] world_zones: (not set)");
+
+	EEPROM.put(EEPROM_ADDR__METRICS_HOST, DEFAULT__METRICS_HOST);
+	LOG_INFO(EEPROM, "[EEPROM Reset] metrics_host: (not set)");
+
+	EEPROM.put(EEPROM_ADDR__OTA_URL, DEFAULT__OTA_URL);
+	LOG_INFO(EEPROM, "[EEPROM Reset] ota_url: (not set)");
 
 	EEPROM.put(EEPROM_ADDR__SSID, "");
-	Serial.print("[EEPROM Reset] ");
-	Serial.println("ssid: (not set)");
+	LOG_INFO(EEPROM, "[EEPROM Reset] ssid: (not set)");
 
 	EEPROM.put(EEPROM_ADDR__PASSWORD, "");
-	Serial.print("[EEPROM Reset] ");
-	Serial.println("password: (not set)");
+	LOG_INFO(EEPROM, "[EEPROM Reset] password: (not set)");
+
+	EEPROM.put(EEPROM_ADDR__SSID2, "");
+	EEPROM.put(EEPROM_ADDR__PASSWORD2, "");
+	EEPROM.put(EEPROM_ADDR__SSID3, "");
+	EEPROM.put(EEPROM_ADDR__PASSWORD3, "");
+	LOG_INFO(EEPROM, "[EEPROM Reset] ssid2, password2, ssid3, password3: (not set)");
 
 	EEPROM.put(EEPROM_ADDR__MAGIC, EEPROM_MAGIC);
 
 	EEPROM.commit();
 }
 
+/*
+ * Recompute when each scheduled event next fires, after the rules, the time
+ * zone or the clock have changed.
+ */
+void rescheduleAlarms()
+{
+	alarms.schedule(time_zone, now());
+}
+
+void runAlarm(const AlarmRule &rule)
+{
+	StallStage stage(alarmActionName(rule.action));
+	LOG_INFO(ALARM, "[Alarm] Running scheduled %s.", alarmActionName(rule.action));
+	switch (rule.action) {
+	case ALARM_ACTION_ANTIPOISON:
+		nixieTap.antiPoisonNow();
+		break;
+	case ALARM_ACTION_NTP_SYNC:
+		// Restarting the client makes it sync straight away.
+		if (cfg_ntp_enabled && ntpInitialized) {
+			startNTPClient();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Load the scheduled events from EEPROM. Like the settings, changes are
+ * staged by saveAlarms() and saved with the 'write' command.
+ */
+void loadAlarms()
+{
+	uint32_t magic = 0;
+	uint8_t count = 0;
+	AlarmRule rule;
+
+	EEPROM.get(EEPROM_ADDR__ALARMS, magic);
+	EEPROM.get(EEPROM_ADDR__ALARMS + 4, count);
+	if (magic != EEPROM_ALARMS_MAGIC || count > ALARM_MAX) {
+		LOG_INFO(EEPROM, "[EEPROM] No scheduled events stored.");
+		return;
+	}
+	for (uint8_t i = 0; i < count; i++) {
+		EEPROM.get(EEPROM_ADDR__ALARMS + 5 + i * sizeof(AlarmRule), rule);
+		alarms.add(rule);
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] %u scheduled events.", count);
+}
+
+void saveAlarms()
+{
+	EEPROM.put(EEPROM_ADDR__ALARMS, (uint32_t)EEPROM_ALARMS_MAGIC);
+	EEPROM.put(EEPROM_ADDR__ALARMS + 4, alarms.size());
+	for (uint8_t i = 0; i < alarms.size(); i++) {
+		EEPROM.put(EEPROM_ADDR__ALARMS + 5 + i * sizeof(AlarmRule), alarms.rule(i));
+	}
+}
+
+/*
+ * Load the cathode wear counters from EEPROM. They are kept separately from
+ * the settings and are not reset by the 'init' command, since they describe
+ * the tubes rather than the configuration.
+ */
+void loadWear()
+{
+	uint32_t magic = 0, seconds;
+
+	EEPROM.get(EEPROM_ADDR__WEAR, magic);
+	if (magic != EEPROM_WEAR_MAGIC) {
+		LOG_INFO(EEPROM, "[EEPROM] No cathode wear counters stored, starting from zero.");
+		return;
+	}
+	for (uint8_t tube = 0; tube < NIXIE_TUBES; tube++) {
+		for (uint8_t digit = 0; digit < NIXIE_DIGITS; digit++) {
+			EEPROM.get(EEPROM_ADDR__WEAR + 4 * (1 + tube * NIXIE_DIGITS + digit), seconds);
+			nixieTap.setWear(tube, digit, seconds);
+		}
+	}
+	LOG_INFO(EEPROM, "[EEPROM Read] Cathode wear counters.");
+}
+
+/*
+ * Stage the cathode wear counters for the next EEPROM commit.
+ */
+void saveWear()
+{
+	for (uint8_t tube = 0; tube < NIXIE_TUBES; tube++) {
+		for (uint8_t digit = 0; digit < NIXIE_DIGITS; digit++) {
+			EEPROM.put(EEPROM_ADDR__WEAR + 4 * (1 + tube * NIXIE_DIGITS + digit), nixieTap.getWear(tube, digit));
+		}
+	}
+	EEPROM.put(EEPROM_ADDR__WEAR, (uint32_t)EEPROM_WEAR_MAGIC);
+	last_wear_save = millis();
+}
+
 void readConfigButton()
 {
 	configButton = digitalRead(CONFIG_BUTTON);
 	if (configButton) {
-		Serial.println("Button pressed.");
+		LOG_INFO(SYSTEM, "Button pressed.");
 		buttonCounter++;
 	}
 }
@@ -690,10 +2632,10 @@ void readConfigButton()
 void firstRunInit()
 {
 	uint64_t magic = 0;
-	EEPROM.begin(512);
+	EEPROM.begin(EEPROM_SIZE);
 	EEPROM.get(EEPROM_ADDR__MAGIC, magic);
 	if (magic != EEPROM_MAGIC) {
-		Serial.println("[EEPROM] Magic value mismatch.");
+		LOG_WARN(EEPROM, "[EEPROM] Magic value mismatch.");
 		resetEepromToDefault();
 	}
 }
@@ -0,0 +1,279 @@
+/*
+ * Arduino.h - host stand-in for the ESP8266 Arduino core
+ *
+ * Just enough of the core for the libraries under test and AceTime to build
+ * and run on a host with 'pio test -e native'. Time comes from the host's
+ * monotonic clock, the GPIOs read as idle, and Serial writes to stdout as a
+ * UART that always has its whole transmit FIFO free.
+ */
+
+#ifndef _ARDUINO_h
+#define _ARDUINO_h
+
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "pgmspace.h"
+
+// glibc only has strlcpy() from 2.38 on.
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+static inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (size != 0) {
+		size_t n = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+#endif
+
+#define ARDUINO_UART_FIFO 128
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x00
+#define INPUT_PULLUP 0x02
+#define OUTPUT 0x01
+#define OUTPUT_OPEN_DRAIN 0x03
+
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::max;
+using std::min;
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+
+static inline uint64_t micros64()
+{
+	static const auto start = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static inline unsigned long micros()
+{
+	return (uint32_t)micros64();
+}
+
+static inline unsigned long millis()
+{
+	return (uint32_t)(micros64() / 1000);
+}
+
+static inline void delayMicroseconds(unsigned int us)
+{
+	std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+static inline void delay(unsigned long ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static inline void yield()
+{
+}
+
+static inline void pinMode(uint8_t, uint8_t)
+{
+}
+
+static inline void digitalWrite(uint8_t, uint8_t)
+{
+}
+
+// The I2C and button lines are pulled up and idle.
+static inline int digitalRead(uint8_t)
+{
+	return HIGH;
+}
+
+static inline long random(long howbig)
+{
+	return howbig > 0 ? rand() % howbig : 0;
+}
+
+static inline long random(long howsmall, long howbig)
+{
+	return howsmall < howbig ? howsmall + random(howbig - howsmall) : howsmall;
+}
+
+class Print {
+    public:
+	virtual ~Print()
+	{
+	}
+
+	virtual size_t write(uint8_t c) = 0;
+
+	virtual size_t write(const uint8_t *buf, size_t size)
+	{
+		size_t n = 0;
+
+		while (size--)
+			n += write(*buf++);
+		return n;
+	}
+
+	size_t write(const char *s)
+	{
+		return write((const uint8_t *)s, strlen(s));
+	}
+
+	size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+	{
+		char line[256];
+		va_list args;
+
+		va_start(args, fmt);
+		int len = vsnprintf(line, sizeof(line), fmt, args);
+		va_end(args);
+		if (len < 0)
+			return 0;
+		return write((const uint8_t *)line, min((size_t)len, sizeof(line) - 1));
+	}
+
+	size_t print(const __FlashStringHelper *s)
+	{
+		return write((const char *)s);
+	}
+
+	size_t print(const char *s)
+	{
+		return write(s);
+	}
+
+	size_t print(char c)
+	{
+		return write((uint8_t)c);
+	}
+
+	size_t print(unsigned char n, int base = 10)
+	{
+		return print((unsigned long)n, base);
+	}
+
+	size_t print(int n, int base = 10)
+	{
+		return print((long)n, base);
+	}
+
+	size_t print(unsigned int n, int base = 10)
+	{
+		return print((unsigned long)n, base);
+	}
+
+	size_t print(long n, int base = 10)
+	{
+		if (base == 10 && n < 0)
+			return print('-') + print((unsigned long)-n, 10);
+		return print((unsigned long)n, base);
+	}
+
+	size_t print(unsigned long n, int base = 10)
+	{
+		char digits[8 * sizeof(n) + 1];
+		char *p = &digits[sizeof(digits) - 1];
+
+		if (base < 2)
+			base = 10;
+		*p = '\0';
+		do {
+			uint8_t d = n % base;
+			*--p = d < 10 ? '0' + d : 'A' + d - 10;
+			n /= base;
+		} while (n != 0);
+		return write(p);
+	}
+
+	size_t print(double n, int digits = 2)
+	{
+		return printf("%.*f", digits, n);
+	}
+
+	size_t println()
+	{
+		return write("\r\n");
+	}
+
+	template <typename T>
+	size_t println(T value)
+	{
+		return print(value) + println();
+	}
+
+	template <typename T>
+	size_t println(T value, int format)
+	{
+		return print(value, format) + println();
+	}
+};
+
+class HardwareSerial : public Print {
+    public:
+	void begin(unsigned long)
+	{
+	}
+
+	size_t write(uint8_t c) override
+	{
+		return fwrite(&c, 1, 1, stdout);
+	}
+
+	size_t write(const uint8_t *buf, size_t size) override
+	{
+		return fwrite(buf, 1, size, stdout);
+	}
+
+	using Print::write;
+
+	int availableForWrite()
+	{
+		return ARDUINO_UART_FIFO;
+	}
+
+	int available()
+	{
+		return 0;
+	}
+
+	int read()
+	{
+		return -1;
+	}
+
+	void flush()
+	{
+		fflush(stdout);
+	}
+};
+
+inline HardwareSerial Serial;
+
+#endif // _ARDUINO_h
@@ -0,0 +1,106 @@
+/*
+ * ESP8266WiFi.h - host stand-in for the ESP8266 core's TCP client
+ *
+ * WiFiClient on top of the host's sockets, with the same non-blocking
+ * reads as on the clock: available() and read() return whatever has
+ * arrived, and never wait for more.
+ */
+
+#ifndef _ESP8266WIFI_h
+#define _ESP8266WIFI_h
+
+#include <Arduino.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class WiFiClient : public Print {
+	int sock = -1;
+
+    public:
+	~WiFiClient()
+	{
+		stop();
+	}
+
+	int connect(const char *host, uint16_t port)
+	{
+		struct addrinfo hints = {}, *res;
+		char service[8];
+
+		stop();
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		snprintf(service, sizeof(service), "%u", port);
+		if (getaddrinfo(host, service, &hints, &res) != 0)
+			return 0;
+		sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		if (sock >= 0 && ::connect(sock, res->ai_addr, res->ai_addrlen) != 0)
+			stop();
+		freeaddrinfo(res);
+		return sock >= 0;
+	}
+
+	void setNoDelay(bool on)
+	{
+		int flag = on;
+
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+	}
+
+	size_t write(uint8_t c) override
+	{
+		return write(&c, 1);
+	}
+
+	size_t write(const uint8_t *buf, size_t size) override
+	{
+		ssize_t n = sock >= 0 ? send(sock, buf, size, MSG_NOSIGNAL) : -1;
+		return n > 0 ? n : 0;
+	}
+
+	int available()
+	{
+		int n = 0;
+
+		if (sock < 0 || ioctl(sock, FIONREAD, &n) != 0)
+			return 0;
+		return n;
+	}
+
+	int read()
+	{
+		uint8_t c;
+
+		return read(&c, 1) == 1 ? c : -1;
+	}
+
+	int read(uint8_t *buf, size_t size)
+	{
+		ssize_t n = sock >= 0 ? recv(sock, buf, size, MSG_DONTWAIT) : -1;
+		return n > 0 ? n : 0;
+	}
+
+	// Whether the connection is open or still has data to read.
+	uint8_t connected()
+	{
+		uint8_t c;
+
+		if (sock < 0)
+			return 0;
+		return recv(sock, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 0;
+	}
+
+	void stop()
+	{
+		if (sock >= 0) {
+			close(sock);
+			sock = -1;
+		}
+	}
+};
+
+#endif // _ESP8266WIFI_h
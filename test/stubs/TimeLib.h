@@ -0,0 +1,64 @@
+/*
+ * TimeLib.h - host stand-in for the Time library
+ *
+ * Only the conversion between Unix time and its calendar fields, with the
+ * same conventions as the Time library: years are counted from 1970 and
+ * the weekday from Sunday as 1.
+ */
+
+#ifndef _TIMELIB_h
+#define _TIMELIB_h
+
+#include <stdint.h>
+#include <time.h>
+
+typedef struct {
+	uint8_t Second;
+	uint8_t Minute;
+	uint8_t Hour;
+	uint8_t Wday;
+	uint8_t Day;
+	uint8_t Month;
+	uint8_t Year;
+} tmElements_t;
+
+#define tmYearToCalendar(Y) ((Y) + 1970)
+#define CalendarYrToTm(Y) ((Y) - 1970)
+#define tmYearToY2k(Y) ((Y) - 30)
+#define y2kYearToTm(Y) ((Y) + 30)
+
+static inline time_t makeTime(const tmElements_t &tm)
+{
+	// Days from civil, counting years from March so that the leap day
+	// comes last.
+	int32_t y = tmYearToCalendar(tm.Year) - (tm.Month <= 2);
+	int32_t era = (y >= 0 ? y : y - 399) / 400;
+	uint32_t yoe = y - era * 400;
+	uint32_t doy = (153 * (tm.Month + (tm.Month > 2 ? -3 : 9)) + 2) / 5 + tm.Day - 1;
+	uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	int64_t days = (int64_t)era * 146097 + doe - 719468;
+
+	return days * 86400 + tm.Hour * 3600 + tm.Minute * 60 + tm.Second;
+}
+
+static inline void breakTime(time_t t, tmElements_t &tm)
+{
+	int64_t days = t / 86400;
+	uint32_t secs = t % 86400;
+
+	tm.Second = secs % 60;
+	tm.Minute = secs / 60 % 60;
+	tm.Hour = secs / 3600;
+	tm.Wday = (days + 4) % 7 + 1;
+	days += 719468;
+	int32_t era = days / 146097;
+	uint32_t doe = days - (int64_t)era * 146097;
+	uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	uint32_t mp = (5 * doy + 2) / 153;
+	tm.Day = doy - (153 * mp + 2) / 5 + 1;
+	tm.Month = mp < 10 ? mp + 3 : mp - 9;
+	tm.Year = CalendarYrToTm(yoe + era * 400 + (tm.Month <= 2));
+}
+
+#endif // _TIMELIB_h
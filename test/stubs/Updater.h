@@ -0,0 +1,98 @@
+/*
+ * Updater.h - host stand-in for the ESP8266 core's firmware updater
+ *
+ * The image is kept in memory instead of being written to flash. Like the
+ * real Updater, it only completes once every byte announced to begin() has
+ * been written, and an image larger than the free flash is refused.
+ */
+
+#ifndef _UPDATER_h
+#define _UPDATER_h
+
+#include <Arduino.h>
+#include <vector>
+
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_WRITE 1
+#define UPDATE_ERROR_SPACE 4
+#define UPDATE_ERROR_SIZE 5
+#define UPDATE_ERROR_NO_DATA 8
+
+// Flash free for a new image on a 4 MB module with a 1 MB sketch area.
+#define UPDATER_FREE_SPACE (1024 * 1024)
+
+class UpdaterClass {
+	std::vector<uint8_t> image;
+	size_t expected = 0;
+	bool running = false;
+	bool finished = false;
+	uint8_t error = UPDATE_ERROR_OK;
+
+    public:
+	bool begin(size_t size, int = 0, int = -1, uint8_t = 0)
+	{
+		image.clear();
+		finished = false;
+		if (size == 0 || size > UPDATER_FREE_SPACE) {
+			error = UPDATE_ERROR_SPACE;
+			return false;
+		}
+		expected = size;
+		running = true;
+		error = UPDATE_ERROR_OK;
+		return true;
+	}
+
+	size_t write(uint8_t *data, size_t len)
+	{
+		if (!running || image.size() + len > expected) {
+			error = UPDATE_ERROR_WRITE;
+			return 0;
+		}
+		image.insert(image.end(), data, data + len);
+		return len;
+	}
+
+	// Complete the update if the whole image has been written, and
+	// otherwise discard it.
+	bool end(bool = false)
+	{
+		if (!running) {
+			error = UPDATE_ERROR_NO_DATA;
+			return false;
+		}
+		running = false;
+		if (image.size() != expected) {
+			error = UPDATE_ERROR_SIZE;
+			image.clear();
+			return false;
+		}
+		finished = true;
+		return true;
+	}
+
+	uint8_t getError()
+	{
+		return error;
+	}
+
+	bool isRunning()
+	{
+		return running;
+	}
+
+	bool isFinished()
+	{
+		return finished;
+	}
+
+	// The image written so far. Only the host has this.
+	const std::vector<uint8_t> &written() const
+	{
+		return image;
+	}
+};
+
+inline UpdaterClass Update;
+
+#endif // _UPDATER_h
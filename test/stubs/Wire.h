@@ -0,0 +1,135 @@
+/*
+ * Wire.h - host stand-in for the ESP8266 core's I2C master
+ *
+ * Transfers go to the I2cDevice models attached to the bus with attach().
+ * A transfer to an address with nothing attached is answered with a NACK,
+ * and so are the next 'failures' transfers, to stand in for a device that
+ * holds the bus. The transfers are counted, so that tests can check how
+ * many bus transactions a driver makes.
+ */
+
+#ifndef _WIRE_h
+#define _WIRE_h
+
+#include <Arduino.h>
+
+#define WIRE_BUFFER_SIZE 128
+#define WIRE_ADDRESSES 128
+
+// A device on the bus, seen from the wire.
+class I2cDevice {
+    public:
+	virtual ~I2cDevice()
+	{
+	}
+	// A write transfer of 'len' bytes. Returns false to NACK it.
+	virtual bool receive(const uint8_t *data, size_t len) = 0;
+	// The next byte of a read transfer.
+	virtual uint8_t send() = 0;
+};
+
+struct WireStats {
+	uint32_t writes;
+	uint32_t reads;
+	// Reads that followed a write without a STOP in between.
+	uint32_t repeatedStarts;
+};
+
+class TwoWire {
+	I2cDevice *devices[WIRE_ADDRESSES] = {};
+	uint8_t txAddress = 0;
+	uint8_t txBuf[WIRE_BUFFER_SIZE];
+	size_t txLen = 0;
+	uint8_t rxBuf[WIRE_BUFFER_SIZE];
+	size_t rxLen = 0;
+	size_t rxPos = 0;
+	bool held = false;
+
+	bool fail()
+	{
+		if (failures == 0)
+			return false;
+		failures--;
+		return true;
+	}
+
+    public:
+	uint32_t failures = 0;
+	WireStats stats = {};
+
+	void attach(uint8_t address, I2cDevice *device)
+	{
+		devices[address & (WIRE_ADDRESSES - 1)] = device;
+	}
+
+	void begin(int, int)
+	{
+	}
+
+	void setClock(uint32_t)
+	{
+	}
+
+	void setClockStretchLimit(uint32_t)
+	{
+	}
+
+	void beginTransmission(uint8_t address)
+	{
+		txAddress = address;
+		txLen = 0;
+	}
+
+	size_t write(uint8_t c)
+	{
+		if (txLen == sizeof(txBuf))
+			return 0;
+		txBuf[txLen++] = c;
+		return 1;
+	}
+
+	// 2: the address was not acknowledged, 3: the data was not.
+	uint8_t endTransmission(bool sendStop = true)
+	{
+		I2cDevice *device = devices[txAddress & (WIRE_ADDRESSES - 1)];
+
+		stats.writes++;
+		held = false;
+		if (!device || fail())
+			return 2;
+		if (!device->receive(txBuf, txLen))
+			return 3;
+		held = !sendStop;
+		return 0;
+	}
+
+	uint8_t requestFrom(uint8_t address, size_t size, bool = true)
+	{
+		I2cDevice *device = devices[address & (WIRE_ADDRESSES - 1)];
+
+		stats.reads++;
+		if (held)
+			stats.repeatedStarts++;
+		held = false;
+		rxLen = rxPos = 0;
+		if (!device || size > sizeof(rxBuf) || fail())
+			return 0;
+		while (rxLen < size)
+			rxBuf[rxLen++] = device->send();
+		return rxLen;
+	}
+
+	int available()
+	{
+		return rxLen - rxPos;
+	}
+
+	int read()
+	{
+		return rxPos < rxLen ? rxBuf[rxPos++] : -1;
+	}
+};
+
+inline TwoWire Wire;
+
+#endif // _WIRE_h
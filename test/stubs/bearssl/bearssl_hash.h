@@ -0,0 +1,108 @@
+/*
+ * bearssl_hash.h - host stand-in for BearSSL's SHA-256
+ *
+ * A plain implementation of FIPS 180-4 with BearSSL's names, for the code
+ * that hashes data as it streams in.
+ */
+
+#ifndef _BEARSSL_HASH_h
+#define _BEARSSL_HASH_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define br_sha256_SIZE 32
+
+typedef struct {
+	uint8_t buf[64];
+	uint64_t count;
+	uint32_t val[8];
+} br_sha256_context;
+
+static inline uint32_t br_sha256_ror(uint32_t x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+static inline void br_sha256_round(uint32_t val[8], const uint8_t block[64])
+{
+	static const uint32_t K[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+	};
+	uint32_t w[64], s[8];
+
+	for (int i = 0; i < 16; i++)
+		w[i] = (uint32_t)block[4 * i] << 24 | block[4 * i + 1] << 16 | block[4 * i + 2] << 8 | block[4 * i + 3];
+	for (int i = 16; i < 64; i++) {
+		uint32_t s0 = br_sha256_ror(w[i - 15], 7) ^ br_sha256_ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = br_sha256_ror(w[i - 2], 17) ^ br_sha256_ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	memcpy(s, val, sizeof(s));
+	for (int i = 0; i < 64; i++) {
+		uint32_t t1 = s[7] + (br_sha256_ror(s[4], 6) ^ br_sha256_ror(s[4], 11) ^ br_sha256_ror(s[4], 25)) +
+			      ((s[4] & s[5]) ^ (~s[4] & s[6])) + K[i] + w[i];
+		uint32_t t2 = (br_sha256_ror(s[0], 2) ^ br_sha256_ror(s[0], 13) ^ br_sha256_ror(s[0], 22)) +
+			      ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+		memmove(s + 1, s, 7 * sizeof(s[0]));
+		s[4] += t1;
+		s[0] = t1 + t2;
+	}
+	for (int i = 0; i < 8; i++)
+		val[i] += s[i];
+}
+
+static inline void br_sha256_init(br_sha256_context *ctx)
+{
+	static const uint32_t IV[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memcpy(ctx->val, IV, sizeof(IV));
+	ctx->count = 0;
+}
+
+static inline void br_sha256_update(br_sha256_context *ctx, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	while (len > 0) {
+		size_t used = ctx->count % 64;
+		size_t n = 64 - used < len ? 64 - used : len;
+		memcpy(ctx->buf + used, p, n);
+		ctx->count += n;
+		p += n;
+		len -= n;
+		if (ctx->count % 64 == 0)
+			br_sha256_round(ctx->val, ctx->buf);
+	}
+}
+
+static inline void br_sha256_out(const br_sha256_context *ctx, void *out)
+{
+	br_sha256_context c = *ctx;
+	uint8_t pad[72] = { 0x80 };
+	size_t padLen = (c.count % 64 < 56 ? 56 : 120) - c.count % 64;
+	uint64_t bits = c.count * 8;
+	uint8_t *o = (uint8_t *)out;
+
+	for (int i = 0; i < 8; i++)
+		pad[padLen + i] = bits >> (56 - 8 * i);
+	br_sha256_update(&c, pad, padLen + 8);
+	for (int i = 0; i < 8; i++) {
+		o[4 * i] = c.val[i] >> 24;
+		o[4 * i + 1] = c.val[i] >> 16;
+		o[4 * i + 2] = c.val[i] >> 8;
+		o[4 * i + 3] = c.val[i];
+	}
+}
+
+#endif // _BEARSSL_HASH_h
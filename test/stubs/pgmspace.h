@@ -0,0 +1,42 @@
+/*
+ * pgmspace.h - host stand-in for the ESP8266 core's flash access
+ *
+ * The host has no separate flash address space, so data marked PROGMEM is
+ * ordinary constant data and the _P functions are the plain C ones.
+ */
+
+#ifndef _PGMSPACE_h
+#define _PGMSPACE_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PGM_VOID_P const void *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_float(p) (*(const float *)(p))
+#define pgm_read_ptr(p) (*(const void *const *)(p))
+
+#define memcmp_P memcmp
+#define memcpy_P memcpy
+#define strcasecmp_P strcasecmp
+#define strchr_P strchr
+#define strcmp_P strcmp
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define strncasecmp_P strncasecmp
+#define strncmp_P strncmp
+#define strncpy_P strncpy
+#define strrchr_P strrchr
+#define printf_P printf
+#define snprintf_P snprintf
+#define sprintf_P sprintf
+#define vsnprintf_P vsnprintf
+
+#endif // _PGMSPACE_h
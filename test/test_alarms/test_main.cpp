@@ -0,0 +1,197 @@
+/*
+ * Tests of the AlarmScheduler, fast-forwarded a minute at a time through
+ * twenty years in zones with DST gaps and overlaps. Every firing is checked
+ * against the zone's offsets as AceTime reports them: it must be at the
+ * rule's local time, or at the end of the gap that skipped it, and at its
+ * first occurrence if it was repeated. Every rule must fire exactly once on
+ * each of its days.
+ */
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <alarms.h>
+#include <map>
+#include <unity.h>
+
+using namespace ace_time;
+
+#define FIRST_YEAR 2020
+#define YEARS 20
+#define SECONDS_PER_DAY 86400
+#define STEP 60
+
+static ExtendedZoneProcessorCache<1> zoneProcessorCache;
+static ExtendedZoneManager zoneManager(
+	zonedbx::kZoneAndLinkRegistrySize,
+	zonedbx::kZoneAndLinkRegistry,
+	zoneProcessorCache);
+
+// Local times in and around the gaps and overlaps of the zones below:
+// 01:00 to 02:00 repeats and 02:00 to 03:00 is skipped in New York, 01:00
+// to 02:00 does both in London, and Lord Howe moves by half an hour at
+// 02:00.
+static const AlarmRule RULES[] = {
+	{ 1, 30, ALARM_DAILY, ALARM_ACTION_ANTIPOISON },
+	{ 2, 0, ALARM_DAILY, ALARM_ACTION_NTP_SYNC },
+	{ 2, 30, ALARM_DAILY, ALARM_ACTION_ANTIPOISON },
+	{ 1, 0, ALARM_WEEKENDS, ALARM_ACTION_NTP_SYNC },
+	{ 1, 59, ALARM_SUNDAY, ALARM_ACTION_ANTIPOISON },
+	{ 3, 0, ALARM_WEEKDAYS, ALARM_ACTION_NTP_SYNC },
+	{ 0, 0, ALARM_DAILY, ALARM_ACTION_ANTIPOISON },
+	{ 12, 0, ALARM_MONDAY | ALARM_SUNDAY, ALARM_ACTION_NTP_SYNC },
+};
+static const uint8_t RULE_COUNT = sizeof(RULES) / sizeof(RULES[0]);
+
+static char message[128];
+
+static int32_t offsetAt(const TimeZone &tz, int64_t t)
+{
+	return ZonedDateTime::forUnixSeconds64(t, tz).timeOffset().toSeconds();
+}
+
+static int32_t floorDiv(int64_t a, int32_t b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/*
+ * Check that 'rule' firing at 't' is right, and store the local day, in
+ * days since 1970-01-01, it fired for into 'day'. Returns whether the local
+ * time was skipped by a gap.
+ */
+static bool checkFiring(const TimeZone &tz, const AlarmRule &rule, int64_t t, int32_t &day)
+{
+	int32_t offset = offsetAt(tz, t);
+	bool gap = false;
+
+	day = floorDiv(t + offset, SECONDS_PER_DAY);
+	int64_t target = (int64_t)day * SECONDS_PER_DAY + rule.hour * 3600 + rule.minute * 60;
+
+	snprintf(message, sizeof(message), "%02u:%02u fired at %lld", rule.hour, rule.minute, (long long)t);
+	if (t + offset != target) {
+		// The local time was skipped: 't' must be the end of a gap that
+		// covers it.
+		int32_t before = offsetAt(tz, t - 1);
+		TEST_ASSERT_TRUE_MESSAGE(offset > before, message);
+		TEST_ASSERT_TRUE_MESSAGE(t + before <= target && target < t + offset, message);
+		gap = true;
+	} else {
+		// The local time must not have occurred earlier, under an offset
+		// that applied a day before or after.
+		int32_t others[2] = { offsetAt(tz, t - SECONDS_PER_DAY), offsetAt(tz, t + SECONDS_PER_DAY) };
+		for (int32_t other : others) {
+			int64_t earlier = target - other;
+			TEST_ASSERT_FALSE_MESSAGE(earlier < t && offsetAt(tz, earlier) == other, message);
+		}
+	}
+	// 1970-01-01 was a Thursday, day 3 counting from Monday.
+	uint8_t weekday = (day % 7 + 7 + 3) % 7;
+	TEST_ASSERT_TRUE_MESSAGE(rule.days & (ALARM_MONDAY << weekday), message);
+	return gap;
+}
+
+static void fastForward(const char *zoneName)
+{
+	TimeZone tz = zoneManager.createForZoneName(zoneName);
+	AlarmScheduler scheduler;
+	std::map<int32_t, uint8_t> fired[RULE_COUNT];
+	uint32_t start = LocalDateTime::forComponents(FIRST_YEAR, 1, 1, 0, 0, 0).toUnixSeconds64();
+	uint32_t end = LocalDateTime::forComponents(FIRST_YEAR + YEARS, 1, 1, 0, 0, 0).toUnixSeconds64();
+	uint32_t gaps = 0;
+
+	TEST_ASSERT_FALSE_MESSAGE(tz.isError(), zoneName);
+	for (uint8_t r = 0; r < RULE_COUNT; r++)
+		TEST_ASSERT_TRUE(scheduler.add(RULES[r]));
+	scheduler.schedule(tz, start);
+
+	for (uint32_t now = start; now < end; now += STEP) {
+		uint32_t due[RULE_COUNT];
+		int8_t r;
+
+		for (uint8_t i = 0; i < RULE_COUNT; i++)
+			due[i] = scheduler.nextFiring(i);
+		while ((r = scheduler.poll(now)) >= 0) {
+			int32_t day;
+
+			// Due since the previous step, and moved on past now.
+			TEST_ASSERT_TRUE(due[r] > now - STEP && due[r] <= now);
+			TEST_ASSERT_TRUE(scheduler.nextFiring(r) > now);
+			if (checkFiring(tz, RULES[r], due[r], day))
+				gaps++;
+			fired[r][day]++;
+		}
+	}
+
+	// Every rule fired once on each of its days, and on no others.
+	int32_t firstDay = floorDiv((int64_t)start + offsetAt(tz, start), SECONDS_PER_DAY) + 1;
+	int32_t lastDay = floorDiv((int64_t)end + offsetAt(tz, end), SECONDS_PER_DAY) - 1;
+	for (uint8_t r = 0; r < RULE_COUNT; r++) {
+		for (int32_t day = firstDay; day < lastDay; day++) {
+			uint8_t weekday = (day % 7 + 7 + 3) % 7;
+			uint8_t expected = (RULES[r].days & (ALARM_MONDAY << weekday)) ? 1 : 0;
+			auto it = fired[r].find(day);
+			snprintf(message, sizeof(message), "%s: %02u:%02u on day %d", zoneName, RULES[r].hour, RULES[r].minute, day);
+			TEST_ASSERT_EQUAL_UINT8_MESSAGE(expected, it == fired[r].end() ? 0 : it->second, message);
+		}
+	}
+	printf("%s: %u firings moved to the end of a gap\n", zoneName, gaps);
+	TEST_ASSERT_TRUE(gaps > 0);
+}
+
+static void test_new_york()
+{
+	fastForward("America/New_York");
+}
+
+static void test_london()
+{
+	fastForward("Europe/London");
+}
+
+static void test_lord_howe()
+{
+	fastForward("Australia/Lord_Howe");
+}
+
+/*
+ * A clock that jumps forward fires each rule that came due once, however
+ * many of its occurrences were skipped, and then carries on from the new
+ * time.
+ */
+static void test_jump()
+{
+	TimeZone tz = zoneManager.createForZoneName("America/New_York");
+	AlarmScheduler scheduler;
+	uint32_t start = LocalDateTime::forComponents(2030, 3, 1, 0, 0, 0).toUnixSeconds64();
+	uint32_t now = start + 30 * SECONDS_PER_DAY;
+	uint8_t count[RULE_COUNT] = {};
+	int8_t r;
+
+	for (uint8_t i = 0; i < RULE_COUNT; i++)
+		scheduler.add(RULES[i]);
+	scheduler.schedule(tz, start);
+	while ((r = scheduler.poll(now)) >= 0) {
+		count[r]++;
+		TEST_ASSERT_EQUAL_UINT32(AlarmScheduler::nextAfter(RULES[r], tz, now), scheduler.nextFiring(r));
+	}
+	for (uint8_t i = 0; i < RULE_COUNT; i++)
+		TEST_ASSERT_EQUAL_UINT8(1, count[i]);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_new_york);
+	RUN_TEST(test_london);
+	RUN_TEST(test_lord_howe);
+	RUN_TEST(test_jump);
+	return UNITY_END();
+}
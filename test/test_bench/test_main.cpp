@@ -0,0 +1,189 @@
+/*
+ * Host benchmarks of the kernels that run on every pass of the main loop or
+ * every display frame, the same ones as the 'bench' command times on the
+ * clock. The host is much faster than the ESP8266, so only compare results
+ * with other host runs. The heap allocations are counted with the hooks in
+ * lib/alloccount, and none of the kernels may make any.
+ *
+ * Each result is printed as one line of key=value pairs, so that runs can be
+ * compared by scripts.
+ */
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <BQ32000RTC.h>
+#include <alloccount.h>
+#include <civiltime.h>
+#include <frame.h>
+#include <marquee.h>
+#include <slotmachine.h>
+#include <tztable.h>
+#include <unity.h>
+
+using namespace ace_time;
+
+static const time_t BENCH_EPOCH = 1700000000;
+
+static ExtendedZoneProcessorCache<1> zoneProcessorCache;
+static ExtendedZoneManager zoneManager(
+	zonedbx::kZoneAndLinkRegistrySize,
+	zonedbx::kZoneAndLinkRegistry,
+	zoneProcessorCache);
+static TimeZone zone;
+static TzTable table;
+
+// Consumes the results of the benchmarked kernels so that they are not
+// optimised away.
+static volatile uint32_t benchSink;
+
+/*
+ * Time 'iterations' calls of 'kernel', print the cost of one call and
+ * return the number of heap allocations made.
+ */
+static uint32_t benchKernel(const char *name, uint32_t iterations, void (*kernel)(uint32_t))
+{
+	uint32_t allocs = allocCount.allocs;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterations; i++) {
+		kernel(i);
+	}
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	allocs = allocCount.allocs - allocs;
+	printf("[Bench] kernel=%s iterations=%u ns_per_op=%.1f allocs_per_op=%.3f\n",
+	       name, iterations, (double)ns / iterations, (double)allocs / iterations);
+	return allocs;
+}
+
+static void test_frame_encode()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, benchKernel("frame_encode", 1000000, [](uint32_t i) {
+		uint8_t digits[NIXIE_TUBES] = { (uint8_t)(i % 10), (uint8_t)(i / 10 % 10), (uint8_t)(i / 100 % 10), (uint8_t)(i / 1000 % 10) };
+		uint8_t frame[NIXIE_FRAME_BYTES];
+		nixieEncodeFrame(digits, i & 0b11110, frame);
+		benchSink = frame[0] ^ frame[4];
+	}));
+}
+
+static void test_tz_offset_table()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, benchKernel("tz_offset_table", 1000000, [](uint32_t i) {
+		benchSink = table.find(BENCH_EPOCH + i * 61).offsetMinutes;
+	}));
+}
+
+static void test_tz_offset_acetime()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, benchKernel("tz_offset_acetime", 10000, [](uint32_t i) {
+		benchSink = ZonedDateTime::forUnixSeconds64(BENCH_EPOCH + i * 3607, zone).timeOffset().toSeconds();
+	}));
+}
+
+static void test_antipoison_spin()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, benchKernel("antipoison_spin", 100000, [](uint32_t i) {
+		uint8_t from[NIXIE_TUBES] = { 1, (uint8_t)(i % 10), 5, 9 };
+		uint8_t to[NIXIE_TUBES] = { (uint8_t)(i / 10 % 10), 3, 0, (uint8_t)(i % 7) };
+		uint8_t digits[NIXIE_TUBES];
+		SlotSpin spin(SLOT_DEFAULT_REEL, NIXIE_TUBES, from, to);
+		for (uint8_t f = 0; f <= spin.frames(); f++) {
+			spin.frame(f, digits);
+		}
+		benchSink = digits[0];
+	}));
+}
+
+static void test_marquee_step()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, benchKernel("marquee_step", 1000000, [](uint32_t i) {
+		static Marquee marquee;
+		uint8_t digits[NIXIE_TUBES], dots;
+		if (i == 0) {
+			marquee.begin("192.168.100.200 -12.5");
+		}
+		marquee.step();
+		marquee.frame(digits, dots);
+		benchSink = digits[0] ^ dots;
+	}));
+}
+
+static void test_civil_time()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, benchKernel("civil_time", 1000000, [](uint32_t i) {
+		// Every call starts a new minute, the worst case.
+		static CivilClock civil;
+		benchSink = civil.at(BENCH_EPOCH + i * 61).day;
+	}));
+}
+
+static void test_time_format()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, benchKernel("time_format", 10000, [](uint32_t i) {
+		ace_common::PrintStr<64> buf;
+		ZonedDateTime::forUnixSeconds64(BENCH_EPOCH + i * 607, zone).printTo(buf);
+		benchSink = buf.cstr()[0];
+	}));
+}
+
+static void test_iso8601_format()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, benchKernel("iso8601_format", 100000, [](uint32_t i) {
+		char line[ISO8601_MAX + 32];
+		time_t t = BENCH_EPOCH + i * 607;
+		formatIso8601(line, sizeof(line), t, i % 1000, table.find(t).offsetMinutes * 60, "America/New_York");
+		benchSink = line[0];
+	}));
+}
+
+/*
+ * formatIso8601() stands in for AceTime's printTo() in the log and status
+ * lines, so without the fractions it must write the same text up to the
+ * zone name, at every time the other kernels format.
+ */
+static void test_iso8601_matches_acetime()
+{
+	for (uint32_t i = 0; i < 100000; i++) {
+		char line[ISO8601_MAX + 32];
+		ace_common::PrintStr<64> expected;
+		time_t t = BENCH_EPOCH + i * 607;
+
+		ZonedDateTime::forUnixSeconds64(t, zone).printTo(expected);
+		formatIso8601(line, sizeof(line), t, -1, table.find(t).offsetMinutes * 60, "America/New_York");
+		*strchr(line, ' ') = '\0';
+		TEST_ASSERT_EQUAL_STRING(expected.cstr(), line);
+	}
+}
+
+static void test_bcd_convert()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, benchKernel("bcd_convert", 1000000, [](uint32_t i) {
+		benchSink = BQ32000RTC::bcd2bin(BQ32000RTC::bin2bcd(i % 100));
+	}));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+	zone = zoneManager.createForZoneName("America/New_York");
+	// The kernels look up times up to a few years after BENCH_EPOCH.
+	table.build(zone, 2023);
+
+	UNITY_BEGIN();
+	RUN_TEST(test_frame_encode);
+	RUN_TEST(test_tz_offset_table);
+	RUN_TEST(test_tz_offset_acetime);
+	RUN_TEST(test_antipoison_spin);
+	RUN_TEST(test_marquee_step);
+	RUN_TEST(test_civil_time);
+	RUN_TEST(test_time_format);
+	RUN_TEST(test_iso8601_format);
+	RUN_TEST(test_iso8601_matches_acetime);
+	RUN_TEST(test_bcd_convert);
+	return UNITY_END();
+}
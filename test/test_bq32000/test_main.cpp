@@ -0,0 +1,383 @@
+/*
+ * Tests of the BQ32000 driver against a model of the chip's registers on
+ * the host's I2C bus: the time and calendar registers with their flag
+ * bits, the keyed special function registers, and the calendar as the
+ * chip advances it, leap years and all. The bus transactions are counted,
+ * so that the bursts and shadow registers are checked too.
+ */
+
+#include <Arduino.h>
+#include <BQ32000RTC.h>
+#include <Wire.h>
+#include <unity.h>
+
+#define REGISTERS 0x23
+#define MINUTES 0x01
+#define CENT_HOURS 0x02
+#define DAY 0x03
+#define DATE 0x04
+#define MONTH 0x05
+#define YEARS 0x06
+// The oscillator fail flag in MINUTES, and the century bits in CENT_HOURS.
+#define OF 0x80
+#define CENT_EN 0x80
+#define CENT 0x40
+
+/*
+ * The chip as the datasheet describes it. A write sets the register
+ * pointer and then fills registers from there on, and a read carries on
+ * from the pointer. The key registers and SFR read back as zero, and SFR
+ * only takes a write that follows the two keys in the same transfer.
+ */
+class Bq32000Model : public I2cDevice {
+	uint8_t pointer = 0;
+
+	static uint8_t bcd(uint8_t v)
+	{
+		return v / 10 << 4 | v % 10;
+	}
+
+	static uint8_t bin(uint8_t v)
+	{
+		return (v >> 4) * 10 + (v & 0x0f);
+	}
+
+    public:
+	uint8_t regs[REGISTERS];
+	uint8_t sfr = 0;
+
+	// The state after the backup supply has been lost.
+	void powerOn()
+	{
+		memset(regs, 0, sizeof(regs));
+		regs[MINUTES] = OF;
+		regs[DAY] = 1;
+		regs[DATE] = 1;
+		regs[MONTH] = 1;
+		regs[BQ32000_CAL_CFG1] = 1 << BQ32000__OUT;
+		regs[BQ32000_CFG2] = 0x0a;
+		sfr = 0;
+		pointer = 0;
+	}
+
+	bool receive(const uint8_t *data, size_t len) override
+	{
+		bool keyed = false;
+
+		if (len == 0)
+			return true;
+		pointer = data[0];
+		for (size_t i = 1; i < len; i++, pointer++) {
+			if (pointer >= REGISTERS)
+				return false;
+			if (pointer == BQ32000_SFKEY1)
+				keyed = data[i] == BQ32000_SFKEY1_VAL;
+			else if (pointer == BQ32000_SFKEY2)
+				keyed = keyed && data[i] == BQ32000_SFKEY2_VAL;
+			else if (pointer == BQ32000_SFR && keyed)
+				sfr = data[i] & 0x01;
+			else if (pointer < BQ32000_SFKEY1)
+				regs[pointer] = data[i];
+		}
+		return true;
+	}
+
+	uint8_t send() override
+	{
+		uint8_t value = pointer < BQ32000_SFKEY1 ? regs[pointer] : 0;
+		pointer++;
+		return value;
+	}
+
+	// Advance the clock by a second, with the chip's leap years: the
+	// years divisible by four, counting from 2000.
+	void tick()
+	{
+		static const uint8_t DAYS[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		uint8_t s = bin(regs[0] & 0x7f), m = bin(regs[MINUTES] & 0x7f), h = bin(regs[CENT_HOURS] & 0x3f);
+		uint8_t date = bin(regs[DATE]), month = bin(regs[MONTH]), year = bin(regs[YEARS]);
+		uint8_t days = DAYS[month - 1] + (month == 2 && year % 4 == 0);
+
+		if (regs[0] & 0x80)
+			return;
+		if (++s == 60) {
+			s = 0;
+			m++;
+		}
+		if (m == 60) {
+			m = 0;
+			h++;
+		}
+		if (h == 24) {
+			h = 0;
+			date++;
+			regs[DAY] = regs[DAY] % 7 + 1;
+		}
+		if (date > days) {
+			date = 1;
+			month++;
+		}
+		if (month > 12) {
+			month = 1;
+			year = (year + 1) % 100;
+			if (year == 0 && (regs[CENT_HOURS] & CENT_EN))
+				regs[CENT_HOURS] ^= CENT;
+		}
+		regs[0] = bcd(s);
+		regs[MINUTES] = (regs[MINUTES] & OF) | bcd(m);
+		regs[CENT_HOURS] = (regs[CENT_HOURS] & (CENT_EN | CENT)) | bcd(h);
+		regs[DATE] = bcd(date);
+		regs[MONTH] = bcd(month);
+		regs[YEARS] = bcd(year);
+	}
+};
+
+static Bq32000Model chip;
+
+static time_t at(int year, int month, int day, int hour, int minute, int second)
+{
+	tmElements_t tm = {};
+
+	tm.Year = CalendarYrToTm(year);
+	tm.Month = month;
+	tm.Day = day;
+	tm.Hour = hour;
+	tm.Minute = minute;
+	tm.Second = second;
+	return makeTime(tm);
+}
+
+/*
+ * Times from 2000 to 2099 survive a set and a get, and are stored in BCD
+ * with the year counted from 2000, in one write of the seven registers.
+ */
+static void test_set_get()
+{
+	srand(1);
+	for (int i = 0; i < 10000; i++) {
+		time_t t = at(2000, 1, 1, 0, 0, 0) + (time_t)((uint64_t)rand() * 100 * 365 / RAND_MAX * 86400) +
+			   rand() % 86400;
+		tmElements_t tm;
+
+		breakTime(t, tm);
+		WireStats before = Wire.stats;
+		TEST_ASSERT_TRUE(RTC.set(t));
+		TEST_ASSERT_EQUAL_UINT32(before.writes + 1, Wire.stats.writes);
+		TEST_ASSERT_EQUAL_HEX8(BQ32000RTC::bin2bcd(tmYearToCalendar(tm.Year) % 100), chip.regs[YEARS]);
+		TEST_ASSERT_EQUAL_HEX8(BQ32000RTC::bin2bcd(tm.Month), chip.regs[MONTH]);
+		TEST_ASSERT_EQUAL_HEX8(BQ32000RTC::bin2bcd(tm.Minute), chip.regs[MINUTES]);
+		TEST_ASSERT_EQUAL_UINT8(tm.Wday, chip.regs[DAY]);
+		TEST_ASSERT_EQUAL_UINT32(t, RTC.get());
+	}
+	TEST_ASSERT_TRUE(RTC.chipPresent());
+}
+
+// The time is read with one transfer of the register pointer, and one read
+// of the seven registers after a repeated start.
+static void test_get_is_one_burst()
+{
+	RTC.set(at(2024, 6, 1, 12, 0, 0));
+	WireStats before = Wire.stats;
+	RTC.get();
+	TEST_ASSERT_EQUAL_UINT32(before.writes + 1, Wire.stats.writes);
+	TEST_ASSERT_EQUAL_UINT32(before.reads + 1, Wire.stats.reads);
+	TEST_ASSERT_EQUAL_UINT32(before.repeatedStarts + 1, Wire.stats.repeatedStarts);
+}
+
+/*
+ * The chip runs on by itself, through month and year ends and the leap
+ * days it adds, which must be those of the calendar.
+ */
+static void test_chip_calendar()
+{
+	static const time_t STARTS[] = {
+		at(2026, 2, 28, 23, 59, 0), at(2028, 2, 28, 23, 59, 0), at(2099, 12, 31, 23, 59, 0),
+		at(2030, 4, 30, 23, 59, 0), at(2031, 12, 31, 23, 59, 0),
+	};
+
+	for (time_t start : STARTS) {
+		TEST_ASSERT_TRUE(RTC.set(start));
+		for (int s = 1; s <= 120; s++) {
+			chip.tick();
+			if (start + s >= at(2100, 1, 1, 0, 0, 0))
+				break;
+			TEST_ASSERT_EQUAL_UINT32(start + s, RTC.get());
+		}
+	}
+}
+
+// The flags sharing the time registers are not part of the time.
+static void test_flag_bits()
+{
+	time_t t = at(2031, 7, 4, 21, 45, 30);
+
+	RTC.set(t);
+	chip.regs[CENT_HOURS] |= CENT_EN | CENT;
+	TEST_ASSERT_EQUAL_UINT32(t, RTC.get());
+	TEST_ASSERT_TRUE(RTC.isRunning());
+}
+
+/*
+ * Firmware before the century enable bit was set counted years from 1970.
+ * Its time is read as it meant it, and written back once with the year
+ * counted from 2000, while a year of the same digits written since is read
+ * as counted from 2000.
+ */
+static void test_year_migration()
+{
+	time_t t = at(2026, 3, 14, 15, 9, 26);
+
+	chip.regs[0] = 0x26;
+	chip.regs[MINUTES] = 0x09;
+	chip.regs[CENT_HOURS] = 0x15;
+	chip.regs[DAY] = 7;
+	chip.regs[DATE] = 0x14;
+	chip.regs[MONTH] = 0x03;
+	chip.regs[YEARS] = 0x56;
+	WireStats before = Wire.stats;
+	TEST_ASSERT_EQUAL_UINT32(t, RTC.get());
+	TEST_ASSERT_EQUAL_UINT32(before.writes + 2, Wire.stats.writes);
+	TEST_ASSERT_EQUAL_HEX8(0x26, chip.regs[YEARS]);
+	TEST_ASSERT_EQUAL_HEX8(CENT_EN | 0x15, chip.regs[CENT_HOURS]);
+
+	before = Wire.stats;
+	TEST_ASSERT_EQUAL_UINT32(t, RTC.get());
+	TEST_ASSERT_EQUAL_UINT32(before.writes + 1, Wire.stats.writes);
+
+	t = at(2056, 3, 14, 15, 9, 26);
+	RTC.set(t);
+	TEST_ASSERT_EQUAL_HEX8(0x56, chip.regs[YEARS]);
+	TEST_ASSERT_EQUAL_UINT32(t, RTC.get());
+
+	// An unset clock is left for the time sources to set.
+	chip.powerOn();
+	chip.regs[YEARS] = 0x56;
+	before = Wire.stats;
+	TEST_ASSERT_EQUAL_UINT32(0, RTC.get());
+	TEST_ASSERT_EQUAL_UINT32(before.writes + 1, Wire.stats.writes);
+	TEST_ASSERT_EQUAL_HEX8(0x56, chip.regs[YEARS]);
+}
+
+/*
+ * After the backup supply was lost the chip reports an oscillator failure,
+ * and its time is not used until it has been set again.
+ */
+static void test_oscillator_failure()
+{
+	tmElements_t tm;
+	time_t t = at(2027, 1, 2, 3, 4, 5);
+
+	chip.powerOn();
+	TEST_ASSERT_FALSE(RTC.read(tm));
+	TEST_ASSERT_EQUAL_UINT32(0, RTC.get());
+	TEST_ASSERT_TRUE(RTC.chipPresent());
+
+	RTC.set(t);
+	TEST_ASSERT_EQUAL_UINT32(t, RTC.get());
+
+	// The STOP bit.
+	chip.regs[0] |= 0x80;
+	TEST_ASSERT_FALSE(RTC.isRunning());
+	TEST_ASSERT_FALSE(RTC.read(tm));
+}
+
+/*
+ * The configuration is kept in shadow registers loaded with one read, so
+ * that changing it writes the chip without reading it back. The square
+ * wave frequency needs the two keys, and is only written when it changes,
+ * and so is the trickle charger.
+ */
+static void test_configuration()
+{
+	RTC.setCalibration(-5);
+	TEST_ASSERT_EQUAL_HEX8(1 << BQ32000__OUT | 1 << BQ32000__CAL_S | 5, chip.regs[BQ32000_CAL_CFG1]);
+
+	WireStats before = Wire.stats;
+	RTC.setIRQ(1);
+	TEST_ASSERT_EQUAL_UINT32(before.reads, Wire.stats.reads);
+	TEST_ASSERT_EQUAL_UINT8(BQ32000_FTF_1HZ, chip.sfr);
+	TEST_ASSERT_EQUAL_HEX8(1 << BQ32000__OUT | 1 << BQ32000__FT | 1 << BQ32000__CAL_S | 5,
+			       chip.regs[BQ32000_CAL_CFG1]);
+
+	before = Wire.stats;
+	RTC.setIRQ(1);
+	TEST_ASSERT_EQUAL_UINT32(before.writes + 1, Wire.stats.writes);
+	RTC.setIRQ(2);
+	TEST_ASSERT_EQUAL_UINT8(BQ32000_FTF_512HZ, chip.sfr);
+
+	RTC.setIRQ(0);
+	RTC.setIRQLevel(0);
+	RTC.setCalibration(31);
+	TEST_ASSERT_EQUAL_HEX8(31, chip.regs[BQ32000_CAL_CFG1]);
+
+	RTC.setCharger(2);
+	TEST_ASSERT_EQUAL_HEX8(1 << BQ32000__TCH2_BIT, chip.regs[BQ32000_TCH2]);
+	TEST_ASSERT_EQUAL_HEX8(BQ32000_CHARGE_ENABLE | 1 << BQ32000__TCFE, chip.regs[BQ32000_CFG2]);
+	before = Wire.stats;
+	RTC.setCharger(2);
+	TEST_ASSERT_EQUAL_UINT32(before.writes, Wire.stats.writes);
+	RTC.setCharger(1);
+	TEST_ASSERT_EQUAL_HEX8(BQ32000_CHARGE_ENABLE, chip.regs[BQ32000_CFG2]);
+	RTC.setCharger(0);
+	TEST_ASSERT_EQUAL_HEX8(0, chip.regs[BQ32000_TCH2]);
+
+	// A write without the keys leaves the frequency as it was.
+	BQ32000RTC::writeRegister(BQ32000_SFR, BQ32000_FTF_1HZ);
+	TEST_ASSERT_EQUAL_UINT8(BQ32000_FTF_512HZ, chip.sfr);
+	TEST_ASSERT_EQUAL_UINT8(0, BQ32000RTC::readRegister(BQ32000_SFR));
+}
+
+// A failed transfer is retried once, after freeing the bus.
+static void test_retry()
+{
+	time_t t = at(2025, 5, 5, 5, 5, 5);
+
+	RTC.set(t);
+	Wire.failures = 1;
+	TEST_ASSERT_EQUAL_UINT32(t, RTC.get());
+	TEST_ASSERT_TRUE(RTC.chipPresent());
+
+	Wire.failures = 2;
+	TEST_ASSERT_EQUAL_UINT32(0, RTC.get());
+	TEST_ASSERT_FALSE(RTC.chipPresent());
+	TEST_ASSERT_EQUAL_UINT32(0, Wire.failures);
+
+	Wire.failures = 2;
+	TEST_ASSERT_FALSE(RTC.set(t));
+	TEST_ASSERT_EQUAL_UINT32(t, RTC.get());
+}
+
+static void test_no_chip()
+{
+	Wire.attach(BQ32000_ADDRESS, NULL);
+	TEST_ASSERT_EQUAL_UINT32(0, RTC.get());
+	TEST_ASSERT_FALSE(RTC.set(at(2025, 1, 1, 0, 0, 0)));
+	TEST_ASSERT_FALSE(RTC.chipPresent());
+}
+
+void setUp()
+{
+	chip.powerOn();
+	Wire.attach(BQ32000_ADDRESS, &chip);
+	Wire.failures = 0;
+	RTC.begin(D3, D4);
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_set_get);
+	RUN_TEST(test_get_is_one_burst);
+	RUN_TEST(test_chip_calendar);
+	RUN_TEST(test_flag_bits);
+	RUN_TEST(test_year_migration);
+	RUN_TEST(test_oscillator_failure);
+	RUN_TEST(test_configuration);
+	RUN_TEST(test_retry);
+	RUN_TEST(test_no_chip);
+	return UNITY_END();
+}
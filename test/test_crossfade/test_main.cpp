@@ -0,0 +1,117 @@
+/*
+ * Tests of the crossfade schedule, tick by tick as the display timer
+ * interrupt runs it. The waveform of the timer driver's fade is recorded
+ * one PWM period per line, '#' for a tick showing the new frame and '.'
+ * for one showing the old, and checked period by period: the new frame
+ * leads each period, its share never falls, and it rises linearly from
+ * nothing to the whole period.
+ */
+
+#include <crossfade.h>
+#include <stdio.h>
+#include <unity.h>
+
+// Check the fade of 'length' ticks in periods of 'period' ticks, printing its
+// waveform if 'print' is set, and return the number of changes of frame.
+static uint32_t checkWaveform(uint16_t length, uint8_t period, bool print)
+{
+	char line[256];
+	uint16_t periods = (length + period - 1) / period;
+	uint8_t lastDuty = 0;
+	uint32_t changes = 0;
+	bool shown = false;
+
+	TEST_ASSERT_TRUE(period < sizeof(line));
+	for (uint16_t p = 0; p < periods; p++) {
+		uint8_t duty = 0;
+
+		for (uint8_t k = 0; k < period; k++) {
+			uint16_t tick = p * period + k;
+			bool showsNew = crossfadeShowsNew(tick, length, period);
+
+			if (tick > 0 && showsNew != shown)
+				changes++;
+			shown = showsNew;
+			line[k] = showsNew ? '#' : '.';
+			// The new frame leads the period, and the old one fills
+			// the rest of it.
+			if (showsNew && tick < length) {
+				TEST_ASSERT_EQUAL_UINT8(k, duty);
+				duty++;
+			}
+		}
+		line[period] = '\0';
+		if (print)
+			printf("[Fade] period=%3u %s\n", p, line);
+
+		// Linear from nothing to the whole period, within a tick. A last
+		// period cut short by the end of the fade is not measured.
+		if ((uint32_t)(p + 1) * period <= length) {
+			uint8_t expected = (uint32_t)p * period * period / length;
+			TEST_ASSERT_TRUE(duty >= lastDuty);
+			TEST_ASSERT_TRUE(duty + 1 >= expected && duty <= expected + 1);
+			lastDuty = duty;
+		}
+	}
+
+	// The fade starts on the old frame and ends on the new one, for good.
+	TEST_ASSERT_FALSE(crossfadeShowsNew(0, length, period));
+	for (uint32_t tick = length; tick < length + 3u * period && tick <= UINT16_MAX; tick++)
+		TEST_ASSERT_TRUE(crossfadeShowsNew(tick, length, period));
+	TEST_ASSERT_TRUE(crossfadeShowsNew(UINT16_MAX, length, period));
+	return changes;
+}
+
+/*
+ * The timer driver's fade. The tubes show the new frame for half of it in
+ * all, and the frame changes at most twice a period, so at most two 48-bit
+ * transfers are latched per period.
+ */
+static void test_timer_fade()
+{
+	uint32_t shown = 0;
+
+	uint32_t changes = checkWaveform(CROSSFADE_TICKS, CROSSFADE_PERIOD_TICKS, true);
+	for (uint16_t tick = 0; tick < CROSSFADE_TICKS; tick++)
+		shown += crossfadeShowsNew(tick, CROSSFADE_TICKS, CROSSFADE_PERIOD_TICKS);
+	printf("[Fade] %u ticks of %u us, %u showing the new frame, %u changes of frame\n", CROSSFADE_TICKS,
+	       DISPLAY_TICK_US, shown, changes);
+	TEST_ASSERT_UINT32_WITHIN(CROSSFADE_TICKS / 20, CROSSFADE_TICKS / 2, shown);
+	TEST_ASSERT_TRUE(changes <= 2 * CROSSFADE_TICKS / CROSSFADE_PERIOD_TICKS + 1);
+}
+
+// Fades that are not a whole number of periods, and periods that do not
+// divide the ticks evenly.
+static void test_other_lengths()
+{
+	checkWaveform(1000, 20, false);
+	checkWaveform(1999, 20, false);
+	checkWaveform(100, 7, false);
+	checkWaveform(30, 30, false);
+	checkWaveform(65280, 255, false);
+}
+
+// A fade shorter than a period still goes from the old to the new frame.
+static void test_short_fade()
+{
+	TEST_ASSERT_FALSE(crossfadeShowsNew(0, 5, 20));
+	for (uint16_t tick = 5; tick < 40; tick++)
+		TEST_ASSERT_TRUE(crossfadeShowsNew(tick, 5, 20));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_timer_fade);
+	RUN_TEST(test_other_lengths);
+	RUN_TEST(test_short_fade);
+	return UNITY_END();
+}
@@ -0,0 +1,235 @@
+/*
+ * Tests of the Marquee: text that fits, text that scrolls and wraps around,
+ * and the cost of a step, which must not grow with the length of the text.
+ */
+
+#include <chrono>
+#include <marquee.h>
+#include <string>
+#include <unity.h>
+
+// The tubes as a string, a digit or a space for a blank tube per cell, with
+// a '.' in front of a cell whose dot is lit.
+static std::string shown(const Marquee &m)
+{
+	std::string s;
+
+	for (uint8_t t = 0; t < MARQUEE_TUBES; t++) {
+		uint8_t c = m.cell(t);
+		if (c & MARQUEE_DOT)
+			s += '.';
+		c &= ~MARQUEE_DOT;
+		s += c == MARQUEE_BLANK ? ' ' : '0' + c;
+	}
+	return s;
+}
+
+// Check that 'm' shows 'expected' now and after each of the next steps.
+static void assertSteps(Marquee &m, const char *const expected[], size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (i > 0)
+			m.step();
+		TEST_ASSERT_EQUAL_STRING(expected[i], shown(m).c_str());
+	}
+}
+
+static void test_short_text()
+{
+	Marquee m;
+
+	m.begin("12");
+	TEST_ASSERT_FALSE(m.scrolling());
+	TEST_ASSERT_EQUAL_STRING("12  ", shown(m).c_str());
+	m.step();
+	TEST_ASSERT_EQUAL_STRING("12  ", shown(m).c_str());
+
+	m.begin("");
+	TEST_ASSERT_FALSE(m.scrolling());
+	TEST_ASSERT_EQUAL_STRING("    ", shown(m).c_str());
+}
+
+static void test_exact_width()
+{
+	Marquee m;
+
+	m.begin("1234");
+	TEST_ASSERT_FALSE(m.scrolling());
+	TEST_ASSERT_EQUAL_STRING("1234", shown(m).c_str());
+	m.step();
+	TEST_ASSERT_EQUAL_STRING("1234", shown(m).c_str());
+
+	// Separators take no cell of their own.
+	m.begin("12:34");
+	TEST_ASSERT_FALSE(m.scrolling());
+	TEST_ASSERT_EQUAL_STRING("12.34", shown(m).c_str());
+
+	// A minus sign does.
+	m.begin("-4.25");
+	TEST_ASSERT_FALSE(m.scrolling());
+	TEST_ASSERT_EQUAL_STRING(". 4.25", shown(m).c_str());
+}
+
+static void test_frame_dots()
+{
+	Marquee m;
+	uint8_t digits[MARQUEE_TUBES], dots;
+
+	m.begin("1.2.3.4");
+	m.frame(digits, dots);
+	TEST_ASSERT_EQUAL_UINT8(1, digits[0]);
+	TEST_ASSERT_EQUAL_UINT8(4, digits[3]);
+	TEST_ASSERT_EQUAL_HEX8(0b11100, dots);
+}
+
+static void test_long_text()
+{
+	static const char *const steps[] = {
+		"    ", "   1", "  12", " 123", "1234", "2345", "3456", "456 ", "56  ", "6   ",
+	};
+	Marquee m;
+
+	m.begin("123456");
+	TEST_ASSERT_TRUE(m.scrolling());
+	assertSteps(m, steps, sizeof(steps) / sizeof(steps[0]));
+}
+
+static void test_one_cell_too_long()
+{
+	static const char *const steps[] = {
+		"    ", "   1", "  12", " 123", "1234", "2345", "345 ", "45  ", "5   ", "    ", "   1",
+	};
+	Marquee m;
+
+	m.begin("12345");
+	TEST_ASSERT_TRUE(m.scrolling());
+	assertSteps(m, steps, sizeof(steps) / sizeof(steps[0]));
+}
+
+static void test_spaces()
+{
+	static const char *const steps[] = {
+		"    ", "    ", "   1", "  12", " 123", "123 ", "23  ", "3   ", "    ", "    ",
+	};
+	Marquee m;
+
+	m.begin(" 12 ");
+	TEST_ASSERT_FALSE(m.scrolling());
+	TEST_ASSERT_EQUAL_STRING(" 12 ", shown(m).c_str());
+
+	// Leading and trailing spaces scroll as blank tubes.
+	m.begin(" 123 ");
+	TEST_ASSERT_TRUE(m.scrolling());
+	assertSteps(m, steps, sizeof(steps) / sizeof(steps[0]));
+}
+
+/*
+ * After the last cell has scrolled out to the left the tubes are blank for
+ * one step, and then the text scrolls in again exactly as the first time.
+ */
+static void test_wrap_around()
+{
+	const char *text = "192.168.1.10";
+	// 9 cells, then 3 blank cells while the last scrolls to the left.
+	const size_t cycle = 9 + MARQUEE_TUBES;
+	std::string first[cycle];
+	Marquee m;
+
+	m.begin(text);
+	for (size_t i = 0; i < cycle; i++) {
+		first[i] = shown(m);
+		m.step();
+	}
+	TEST_ASSERT_EQUAL_STRING("    ", first[0].c_str());
+	TEST_ASSERT_EQUAL_STRING("192.1", first[4].c_str());
+	TEST_ASSERT_EQUAL_STRING("0   ", first[cycle - 1].c_str());
+	for (int round = 0; round < 3; round++) {
+		for (size_t i = 0; i < cycle; i++) {
+			TEST_ASSERT_EQUAL_STRING(first[i].c_str(), shown(m).c_str());
+			m.step();
+		}
+	}
+}
+
+/*
+ * With a scroll speed of 0, Nixie::writeNumber() shows long text from its
+ * start without moving it: the text is begun afresh and stepped until its
+ * first cells reach the leftmost tube.
+ */
+static void test_speed_zero()
+{
+	Marquee m;
+
+	for (int call = 0; call < 3; call++) {
+		m.begin("123456");
+		for (uint8_t t = 0; t < MARQUEE_TUBES; t++)
+			m.step();
+		TEST_ASSERT_EQUAL_STRING("1234", shown(m).c_str());
+	}
+
+	// Text that fits is not moved by the steps.
+	m.begin("12");
+	for (uint8_t t = 0; t < MARQUEE_TUBES; t++)
+		m.step();
+	TEST_ASSERT_EQUAL_STRING("12  ", shown(m).c_str());
+}
+
+// Fastest time in nanoseconds of 'steps' steps through 'text'.
+static double stepNanos(const char *text, uint32_t steps)
+{
+	double best = 0;
+
+	for (int run = 0; run < 3; run++) {
+		Marquee m;
+		m.begin(text);
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < steps; i++)
+			m.step();
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		if (run == 0 || ns < best)
+			best = ns;
+		TEST_ASSERT_TRUE(m.cell(0) <= (MARQUEE_BLANK | MARQUEE_DOT));
+	}
+	return best;
+}
+
+/*
+ * A step reads at most one more cell of the text, so stepping all the way
+ * through a text of a million cells costs about the same per step as
+ * stepping round and round a short one. Were a step to look at the whole
+ * text, or at all of it up to the window, this would take many minutes.
+ */
+static void test_step_constant_time()
+{
+	const uint32_t cells = 1000000;
+	std::string text(cells, '5');
+
+	double shortText = stepNanos("123456", cells + MARQUEE_TUBES);
+	double longText = stepNanos(text.c_str(), cells + MARQUEE_TUBES);
+	printf("short text %.1f ns per step, long text %.1f ns per step\n",
+	       shortText / (cells + MARQUEE_TUBES), longText / (cells + MARQUEE_TUBES));
+	TEST_ASSERT_TRUE(longText < 5 * shortText + 1e6);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_short_text);
+	RUN_TEST(test_exact_width);
+	RUN_TEST(test_frame_dots);
+	RUN_TEST(test_long_text);
+	RUN_TEST(test_one_cell_too_long);
+	RUN_TEST(test_spaces);
+	RUN_TEST(test_wrap_around);
+	RUN_TEST(test_speed_zero);
+	RUN_TEST(test_step_constant_time);
+	return UNITY_END();
+}
@@ -0,0 +1,266 @@
+/*
+ * Tests of the OTA updater against a real HTTP server, Python's
+ * http.server on the loopback interface, serving images from a temporary
+ * directory. The Updater and WiFiClient are the host stand-ins in
+ * test/stubs, so a successful update leaves the image in memory, where it
+ * must match the file byte for byte.
+ */
+
+#include <Arduino.h>
+#include <Updater.h>
+#include <arpa/inet.h>
+#include <log.h>
+#include <netinet/in.h>
+#include <ota.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unity.h>
+#include <vector>
+
+// Larger than a chunk, and not a multiple of one, so that the held back last
+// chunk is short.
+#define IMAGE_SIZE (300 * 1024 + 123)
+// Longest a download from the loopback server may take.
+#define DOWNLOAD_MS 10000
+
+static char dir[] = "/tmp/ota_test_XXXXXX";
+static uint16_t port;
+static pid_t server = -1;
+static bool served;
+static std::vector<uint8_t> image;
+static char imageSha[2 * OTA_SHA256_SIZE + 1];
+static char url[128];
+
+static void sha256Hex(const uint8_t *data, size_t len, char *hex)
+{
+	br_sha256_context ctx;
+	uint8_t digest[OTA_SHA256_SIZE];
+
+	br_sha256_init(&ctx);
+	br_sha256_update(&ctx, data, len);
+	br_sha256_out(&ctx, digest);
+	for (uint8_t i = 0; i < OTA_SHA256_SIZE; i++)
+		sprintf(hex + 2 * i, "%02x", digest[i]);
+}
+
+static bool writeFile(const char *name, const uint8_t *data, size_t len)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(data, 1, len, f) == len;
+	return fclose(f) == 0 && ok;
+}
+
+// A port that nothing listens on right now.
+static uint16_t freePort()
+{
+	struct sockaddr_in addr = {};
+	socklen_t addrLen = sizeof(addr);
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+	getsockname(sock, (struct sockaddr *)&addr, &addrLen);
+	close(sock);
+	return ntohs(addr.sin_port);
+}
+
+static bool serverUp()
+{
+	struct sockaddr_in addr = {};
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	bool up = connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+	close(sock);
+	return up;
+}
+
+/*
+ * Serve the temporary directory with http.server in a child process, and
+ * wait for it to accept connections.
+ */
+static bool startServer()
+{
+	char portArg[8];
+
+	if (system("command -v python3 >/dev/null 2>&1") != 0)
+		return false;
+	port = freePort();
+	snprintf(portArg, sizeof(portArg), "%u", port);
+	server = fork();
+	if (server == 0) {
+		freopen("/dev/null", "w", stdout);
+		freopen("/dev/null", "w", stderr);
+		execlp("python3", "python3", "-m", "http.server", portArg, "--bind", "127.0.0.1", "--directory", dir,
+		       (char *)NULL);
+		_exit(127);
+	}
+	for (int i = 0; i < 100 && server > 0; i++) {
+		if (serverUp())
+			return true;
+		if (waitpid(server, NULL, WNOHANG) == server)
+			server = -1;
+		delay(50);
+	}
+	return false;
+}
+
+static void stopServer()
+{
+	if (server > 0) {
+		kill(server, SIGTERM);
+		waitpid(server, NULL, 0);
+		server = -1;
+	}
+}
+
+// Poll 'ota' as the main loop does until it stops, and return its state.
+static OtaUpdater::State run(OtaUpdater &ota)
+{
+	uint32_t start = millis();
+
+	while (ota.active() && millis() - start < DOWNLOAD_MS) {
+		ota.poll();
+		Log.drain();
+	}
+	Log.flush();
+	return ota.getState();
+}
+
+static const char *imageUrl(const char *name)
+{
+	if (!served)
+		TEST_IGNORE_MESSAGE("python3 -m http.server could not be started");
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/%s", port, name);
+	return url;
+}
+
+// The stand-in SHA-256 is checked against the FIPS 180-2 examples.
+static void test_sha256()
+{
+	const char *abc = "abc";
+	const char *two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	char hex[2 * OTA_SHA256_SIZE + 1];
+
+	sha256Hex((const uint8_t *)abc, strlen(abc), hex);
+	TEST_ASSERT_EQUAL_STRING("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", hex);
+	sha256Hex((const uint8_t *)two, strlen(two), hex);
+	TEST_ASSERT_EQUAL_STRING("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", hex);
+}
+
+static void test_update()
+{
+	OtaUpdater ota;
+
+	TEST_ASSERT_TRUE(ota.begin(imageUrl("firmware.bin"), imageSha));
+	TEST_ASSERT_TRUE(ota.active());
+	TEST_ASSERT_EQUAL(OtaUpdater::DONE, run(ota));
+	TEST_ASSERT_TRUE(Update.isFinished());
+	TEST_ASSERT_EQUAL_UINT32(image.size(), Update.written().size());
+	TEST_ASSERT_EQUAL_MEMORY(image.data(), Update.written().data(), image.size());
+}
+
+// An image that does not hash to the expected value is never completed.
+static void test_sha_mismatch()
+{
+	OtaUpdater ota;
+	char wrong[sizeof(imageSha)];
+
+	strcpy(wrong, imageSha);
+	wrong[0] = wrong[0] == '0' ? '1' : '0';
+	TEST_ASSERT_TRUE(ota.begin(imageUrl("firmware.bin"), wrong));
+	TEST_ASSERT_EQUAL(OtaUpdater::FAILED, run(ota));
+	TEST_ASSERT_FALSE(Update.isFinished());
+	TEST_ASSERT_FALSE(Update.isRunning());
+	TEST_ASSERT_EQUAL_UINT32(0, Update.written().size());
+}
+
+static void test_not_found()
+{
+	OtaUpdater ota;
+
+	TEST_ASSERT_TRUE(ota.begin(imageUrl("missing.bin"), imageSha));
+	TEST_ASSERT_EQUAL(OtaUpdater::FAILED, run(ota));
+	TEST_ASSERT_FALSE(Update.isRunning());
+}
+
+static void test_too_large()
+{
+	OtaUpdater ota;
+
+	TEST_ASSERT_TRUE(ota.begin(imageUrl("large.bin"), imageSha));
+	TEST_ASSERT_EQUAL(OtaUpdater::FAILED, run(ota));
+	TEST_ASSERT_EQUAL_UINT8(UPDATE_ERROR_SPACE, Update.getError());
+}
+
+// Bad arguments are refused before anything is sent.
+static void test_bad_arguments()
+{
+	OtaUpdater ota;
+
+	TEST_ASSERT_FALSE(ota.begin("http://127.0.0.1/firmware.bin", "0123"));
+	TEST_ASSERT_FALSE(ota.begin("http://127.0.0.1/firmware.bin", "zz"));
+	TEST_ASSERT_FALSE(ota.begin("https://127.0.0.1/firmware.bin", imageSha));
+	TEST_ASSERT_FALSE(ota.begin("http://127.0.0.1:0/firmware.bin", imageSha));
+	TEST_ASSERT_FALSE(ota.begin("http://127.0.0.1:99999/firmware.bin", imageSha));
+	TEST_ASSERT_EQUAL(OtaUpdater::IDLE, ota.getState());
+}
+
+static void test_connection_refused()
+{
+	OtaUpdater ota;
+
+	imageUrl("firmware.bin");
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/firmware.bin", freePort());
+	TEST_ASSERT_FALSE(ota.begin(url, imageSha));
+	TEST_ASSERT_EQUAL(OtaUpdater::FAILED, ota.getState());
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<uint8_t> large(UPDATER_FREE_SPACE + 1);
+
+	srand(1);
+	image.resize(IMAGE_SIZE);
+	for (uint8_t &b : image)
+		b = rand();
+	sha256Hex(image.data(), image.size(), imageSha);
+	served = mkdtemp(dir) && writeFile("firmware.bin", image.data(), image.size()) &&
+		      writeFile("large.bin", large.data(), large.size()) && startServer();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_sha256);
+	RUN_TEST(test_bad_arguments);
+	RUN_TEST(test_update);
+	RUN_TEST(test_sha_mismatch);
+	RUN_TEST(test_not_found);
+	RUN_TEST(test_too_large);
+	RUN_TEST(test_connection_refused);
+	int failures = UNITY_END();
+
+	stopServer();
+	system((std::string("rm -rf ") + dir).c_str());
+	return failures;
+}
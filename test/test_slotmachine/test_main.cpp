@@ -0,0 +1,276 @@
+/*
+ * Tests of SlotSpin against the hand-unrolled slot-machine sequence that
+ * Nixie::write() used before it, transcribed below as legacySpin(). Where
+ * the old code did what it meant to, the frames must be the same. Where it
+ * did not, the differences are intended, and each has a test of its own:
+ *
+ * - Each tube spun from its neighbour's previous digit, as the start
+ *   indices of tubes 1 and 2, and of 3 and 4, were swapped.
+ * - Frame 0, showing the digits already lit, was written again.
+ * - The frame on which a tube stopped was dropped, and so were the checks
+ *   of the tubes after it in that frame. A tube due to stop on the same
+ *   frame then overshot its target and never found it.
+ * - All ten frames were always written, and the last ones with the
+ *   animation's dots rather than the caller's.
+ *
+ * SlotSpin writes frames 1 to frames() - 1, then the target digits.
+ */
+
+#include <slotmachine.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+#define TUBES 4
+#define CASES 100000
+
+struct LegacyFrame {
+	uint8_t j;
+	uint8_t digits[TUBES];
+};
+
+/*
+ * The old animation, as it was in Nixie::write(), writing into 'frames'
+ * instead of to the tubes. The digits were shown left to right as H1, H0,
+ * M1, M0.
+ */
+static std::vector<LegacyFrame> legacySpin(const uint8_t old[TUBES], const uint8_t to[TUBES])
+{
+	static const uint8_t orderedDigits[10] = { 1, 6, 2, 7, 5, 0, 4, 9, 8, 3 };
+	uint8_t oldDigit1 = old[0], oldDigit2 = old[1], oldDigit3 = old[2], oldDigit4 = old[3];
+	uint8_t digit1 = to[0], digit2 = to[1], digit3 = to[2], digit4 = to[3];
+	std::vector<LegacyFrame> frames;
+	uint8_t H1 = 0, H0 = 0, M1 = 0, M0 = 0;
+	bool foundH1 = false, foundH0 = false, foundM1 = false, foundM0 = false;
+	uint8_t indexH1 = 0, indexH0 = 0, indexM1 = 0, indexM0 = 0;
+
+	for (uint8_t i = 0; i < 10; i++)
+		if (orderedDigits[i] == oldDigit4)
+			indexM1 = i;
+	for (uint8_t i = 0; i < 10; i++)
+		if (orderedDigits[i] == oldDigit3)
+			indexM0 = i;
+	for (uint8_t i = 0; i < 10; i++)
+		if (orderedDigits[i] == oldDigit2)
+			indexH1 = i;
+	for (uint8_t i = 0; i < 10; i++)
+		if (orderedDigits[i] == oldDigit1)
+			indexH0 = i;
+
+	for (uint8_t j = 0; j < 10; j++) {
+		if (!foundM0) {
+			M0 = orderedDigits[(j + indexM0) % 10];
+			if (M0 == digit4) {
+				foundM0 = true;
+				continue;
+			}
+		}
+		if (!foundM1) {
+			M1 = orderedDigits[(j + indexM1) % 10];
+			if (M1 == digit3) {
+				foundM1 = true;
+				continue;
+			}
+		}
+		if (!foundH0) {
+			H0 = orderedDigits[(j + indexH0) % 10];
+			if (H0 == digit2) {
+				foundH0 = true;
+				continue;
+			}
+		}
+		if (!foundH1) {
+			H1 = orderedDigits[(j + indexH1) % 10];
+			if (H1 == digit1) {
+				foundH1 = true;
+				continue;
+			}
+		}
+		frames.push_back({ j, { H1, H0, M1, M0 } });
+	}
+	return frames;
+}
+
+// The digits the old code needed in order to spin each tube from its own
+// digit: its neighbour's.
+static void swapNeighbours(const uint8_t from[TUBES], uint8_t swapped[TUBES])
+{
+	swapped[0] = from[1];
+	swapped[1] = from[0];
+	swapped[2] = from[3];
+	swapped[3] = from[2];
+}
+
+static void randomDigits(uint8_t digits[TUBES])
+{
+	for (uint8_t t = 0; t < TUBES; t++)
+		digits[t] = rand() % SLOT_POSITIONS;
+}
+
+// The frame on which each tube stops, or 0 for a tube that does not move.
+static void stops(const uint8_t from[TUBES], const uint8_t to[TUBES], uint8_t stop[TUBES])
+{
+	for (uint8_t t = 0; t < TUBES; t++)
+		stop[t] = (SLOT_DEFAULT_REEL.positionOf(to[t]) - SLOT_DEFAULT_REEL.positionOf(from[t]) + SLOT_POSITIONS) %
+			  SLOT_POSITIONS;
+}
+
+static bool distinct(const uint8_t stop[TUBES])
+{
+	for (uint8_t a = 0; a < TUBES; a++)
+		for (uint8_t b = a + 1; b < TUBES; b++)
+			if (stop[a] == stop[b])
+				return false;
+	return true;
+}
+
+/*
+ * With the start digits put right and no two tubes stopping on the same
+ * frame, every frame the old code wrote is SlotSpin's frame of the same
+ * number, and the ones it left out are those on which a tube stopped.
+ */
+static void test_same_path()
+{
+	uint32_t compared = 0;
+
+	srand(1);
+	for (uint32_t c = 0; c < CASES; c++) {
+		uint8_t from[TUBES], to[TUBES], swapped[TUBES], stop[TUBES], digits[TUBES];
+
+		randomDigits(from);
+		randomDigits(to);
+		stops(from, to, stop);
+		if (!distinct(stop))
+			continue;
+		swapNeighbours(from, swapped);
+		SlotSpin spin(SLOT_DEFAULT_REEL, TUBES, from, to);
+		std::vector<LegacyFrame> frames = legacySpin(swapped, to);
+
+		TEST_ASSERT_EQUAL_UINT32(10 - TUBES, frames.size());
+		for (const LegacyFrame &frame : frames) {
+			for (uint8_t t = 0; t < TUBES; t++)
+				TEST_ASSERT_NOT_EQUAL(stop[t], frame.j);
+			spin.frame(frame.j < spin.frames() ? frame.j : spin.frames(), digits);
+			TEST_ASSERT_EQUAL_UINT8_ARRAY(digits, frame.digits, TUBES);
+		}
+		compared++;
+	}
+	printf("%u of %u spins compared frame by frame\n", compared, CASES);
+	TEST_ASSERT_TRUE(compared > CASES / 10);
+}
+
+/*
+ * Unswapped, the old code spun tubes that were already showing their
+ * target: here every tube, where SlotSpin has nothing to do.
+ */
+static void test_own_start_digit()
+{
+	const uint8_t from[TUBES] = { 1, 2, 3, 4 };
+	std::vector<LegacyFrame> frames = legacySpin(from, from);
+	SlotSpin spin(SLOT_DEFAULT_REEL, TUBES, from, from);
+	uint8_t digits[TUBES];
+
+	TEST_ASSERT_EQUAL_UINT8(0, spin.frames());
+	spin.frame(0, digits);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(from, digits, TUBES);
+	TEST_ASSERT_TRUE(frames.size() > 0);
+	TEST_ASSERT_EQUAL_UINT8(2, frames[0].digits[0]);
+	TEST_ASSERT_EQUAL_UINT8(1, frames[0].digits[1]);
+}
+
+/*
+ * The old code's first frame showed the digits already lit; SlotSpin's
+ * frame 0 is the same, and the display does not write it again.
+ */
+static void test_first_frame()
+{
+	const uint8_t from[TUBES] = { 1, 2, 3, 4 }, to[TUBES] = { 5, 6, 7, 8 };
+	uint8_t swapped[TUBES], digits[TUBES];
+
+	swapNeighbours(from, swapped);
+	std::vector<LegacyFrame> frames = legacySpin(swapped, to);
+	SlotSpin spin(SLOT_DEFAULT_REEL, TUBES, from, to);
+
+	TEST_ASSERT_EQUAL_UINT8(0, frames[0].j);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(from, frames[0].digits, TUBES);
+	spin.frame(0, digits);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(from, digits, TUBES);
+}
+
+/*
+ * Two tubes due to stop on the same frame: the old code found the first,
+ * skipped the check of the second, and the second then spun past its
+ * target for the rest of the animation. SlotSpin stops both.
+ */
+static void test_same_stop_frame()
+{
+	uint32_t same = 0, wrong = 0;
+
+	srand(2);
+	for (uint32_t c = 0; c < CASES; c++) {
+		uint8_t from[TUBES], to[TUBES], swapped[TUBES], stop[TUBES], digits[TUBES];
+
+		randomDigits(from);
+		randomDigits(to);
+		stops(from, to, stop);
+		if (distinct(stop))
+			continue;
+		same++;
+		swapNeighbours(from, swapped);
+		std::vector<LegacyFrame> frames = legacySpin(swapped, to);
+		SlotSpin spin(SLOT_DEFAULT_REEL, TUBES, from, to);
+
+		spin.frame(spin.frames(), digits);
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(to, digits, TUBES);
+		if (frames.empty() || memcmp(frames.back().digits, to, TUBES) != 0)
+			wrong++;
+	}
+	printf("%u of %u spins had tubes stopping together, the old code left %u on the wrong digits\n", same, CASES,
+	       wrong);
+	// The second tube needed ten more frames to come round again.
+	TEST_ASSERT_EQUAL_UINT32(same, wrong);
+
+	// Tubes 3 and 4 both stop on frame 3, and the old code left tube 3
+	// spinning.
+	const uint8_t from[TUBES] = { 1, 1, 1, 1 }, to[TUBES] = { 1, 1, 7, 7 };
+	std::vector<LegacyFrame> frames = legacySpin(from, to);
+	TEST_ASSERT_NOT_EQUAL(7, frames.back().digits[2]);
+	TEST_ASSERT_EQUAL_UINT8(7, frames.back().digits[3]);
+}
+
+/*
+ * The old code always took ten frames, and ended on the animation's dots.
+ * SlotSpin takes as many as the longest spin, and the display ends it with
+ * the target digits and the caller's dots.
+ */
+static void test_length()
+{
+	const uint8_t from[TUBES] = { 1, 1, 1, 1 }, to[TUBES] = { 6, 2, 7, 5 };
+	std::vector<LegacyFrame> frames = legacySpin(from, to);
+	SlotSpin spin(SLOT_DEFAULT_REEL, TUBES, from, to);
+
+	// The tubes stop on frames 1 to 4.
+	TEST_ASSERT_EQUAL_UINT8(4, spin.frames());
+	TEST_ASSERT_EQUAL_UINT8(9, frames.back().j);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(to, frames.back().digits, TUBES);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_same_path);
+	RUN_TEST(test_own_start_digit);
+	RUN_TEST(test_first_frame);
+	RUN_TEST(test_same_stop_frame);
+	RUN_TEST(test_length);
+	return UNITY_END();
+}
@@ -0,0 +1,283 @@
+/*
+ * Tests of the SNTP response encoding: field by field, and end to end as a
+ * server on the loopback interface queried by an NTP client. The server
+ * answers from the host's clock, so a client must find it in step.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sntppacket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+
+// The reference ID the server reports, "GPS".
+#define TEST_REF_ID 0x47505300
+#define TEST_STRATUM 2
+
+static uint64_t hostMicros()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// A 64-bit NTP timestamp as Unix time in microseconds.
+static uint64_t getTimestamp(const uint8_t *p)
+{
+	return (uint64_t)(get32(p) - SNTP_UNIX_OFFSET) * 1000000 + (((uint64_t)get32(p + 4) * 1000000) >> 32);
+}
+
+static SntpStatus syncedStatus()
+{
+	SntpStatus status;
+
+	status.leap = SNTP_LEAP_NONE;
+	status.stratum = TEST_STRATUM;
+	status.refId = TEST_REF_ID;
+	status.refTimeMicros = hostMicros() - 10000000;
+	status.rootDelayMicros = 1500;
+	status.rootDispersionMicros = 20000;
+	return status;
+}
+
+static void request(uint8_t pkt[SNTP_PACKET_SIZE], uint8_t version, uint64_t txMicros)
+{
+	memset(pkt, 0, SNTP_PACKET_SIZE);
+	pkt[0] = version << 3 | SNTP_MODE_CLIENT;
+	pkt[2] = 6;
+	sntpPutTimestamp(pkt + 40, txMicros);
+}
+
+static void test_fields()
+{
+	uint8_t pkt[SNTP_PACKET_SIZE], sent[8];
+	SntpStatus status = syncedStatus();
+	uint64_t rx = 1700000000123456ULL, tx = 1700000000123789ULL;
+
+	request(pkt, 4, 1699999999987654ULL);
+	memcpy(sent, pkt + 40, 8);
+	TEST_ASSERT_TRUE(sntpBuildResponse(pkt, sizeof(pkt), status, rx, tx));
+
+	TEST_ASSERT_EQUAL_HEX8(SNTP_LEAP_NONE << 6 | 4 << 3 | SNTP_MODE_SERVER, pkt[0]);
+	TEST_ASSERT_EQUAL_UINT8(TEST_STRATUM, pkt[1]);
+	// The poll interval is echoed.
+	TEST_ASSERT_EQUAL_UINT8(6, pkt[2]);
+	TEST_ASSERT_EQUAL_INT8(SNTP_PRECISION, (int8_t)pkt[3]);
+	// 1.5 ms and 20 ms in 16.16 seconds.
+	TEST_ASSERT_EQUAL_UINT32(98, get32(pkt + 4));
+	TEST_ASSERT_EQUAL_UINT32(1310, get32(pkt + 8));
+	TEST_ASSERT_EQUAL_HEX32(TEST_REF_ID, get32(pkt + 12));
+	TEST_ASSERT_UINT64_WITHIN(1, status.refTimeMicros, getTimestamp(pkt + 16));
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(sent, pkt + 24, 8);
+	// 0.123456 s is 0x1f9acffa in 32-bit fractions, rounded down.
+	TEST_ASSERT_EQUAL_HEX32(1700000000 + SNTP_UNIX_OFFSET, get32(pkt + 32));
+	TEST_ASSERT_EQUAL_HEX32(0x1f9acffa, get32(pkt + 36));
+	TEST_ASSERT_UINT64_WITHIN(1, rx, getTimestamp(pkt + 32));
+	TEST_ASSERT_UINT64_WITHIN(1, tx, getTimestamp(pkt + 40));
+}
+
+static void test_unsynced()
+{
+	uint8_t pkt[SNTP_PACKET_SIZE];
+	SntpStatus status;
+
+	request(pkt, 3, 1700000000000000ULL);
+	TEST_ASSERT_TRUE(sntpBuildResponse(pkt, sizeof(pkt), status, 1700000000000000ULL, 1700000000000000ULL));
+	TEST_ASSERT_EQUAL_HEX8(SNTP_LEAP_ALARM << 6 | 3 << 3 | SNTP_MODE_SERVER, pkt[0]);
+	TEST_ASSERT_EQUAL_UINT8(SNTP_STRATUM_UNSYNCED, pkt[1]);
+	// No reference time.
+	TEST_ASSERT_EQUAL_UINT32(0, get32(pkt + 16));
+	TEST_ASSERT_EQUAL_UINT32(0, get32(pkt + 20));
+}
+
+static void test_rejects()
+{
+	uint8_t pkt[SNTP_PACKET_SIZE], copy[SNTP_PACKET_SIZE];
+	SntpStatus status = syncedStatus();
+
+	// Too short.
+	request(pkt, 4, 1);
+	TEST_ASSERT_FALSE(sntpBuildResponse(pkt, SNTP_PACKET_SIZE - 1, status, 1, 1));
+	// Symmetric, server and broadcast mode packets.
+	for (uint8_t mode = 1; mode <= 5; mode++) {
+		if (mode == SNTP_MODE_CLIENT)
+			continue;
+		request(pkt, 4, 1);
+		pkt[0] = 4 << 3 | mode;
+		memcpy(copy, pkt, sizeof(pkt));
+		TEST_ASSERT_FALSE(sntpBuildResponse(pkt, sizeof(pkt), status, 1, 1));
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(copy, pkt, sizeof(pkt));
+	}
+	// Versions 0 and 5 to 7.
+	for (uint8_t version = 0; version <= 7; version++) {
+		if (version >= 1 && version <= 4)
+			continue;
+		request(pkt, version, 1);
+		TEST_ASSERT_FALSE(sntpBuildResponse(pkt, sizeof(pkt), status, 1, 1));
+	}
+}
+
+/*
+ * A server on the loopback interface that answers requests from the host's
+ * clock until the socket is shut down.
+ */
+struct LoopbackServer {
+	int sock = -1;
+	uint16_t port = 0;
+	uint32_t answered = 0;
+	std::thread thread;
+
+	~LoopbackServer()
+	{
+		stop();
+	}
+
+	bool start(uint16_t wanted)
+	{
+		struct sockaddr_in addr = {};
+		socklen_t addrLen = sizeof(addr);
+
+		sock = socket(AF_INET, SOCK_DGRAM, 0);
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(wanted);
+		if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+			stop();
+			return false;
+		}
+		getsockname(sock, (struct sockaddr *)&addr, &addrLen);
+		port = ntohs(addr.sin_port);
+		thread = std::thread([this]() { serve(); });
+		return true;
+	}
+
+	void serve()
+	{
+		uint8_t pkt[512];
+		struct sockaddr_in from;
+		socklen_t fromLen = sizeof(from);
+		ssize_t len;
+
+		while ((len = recvfrom(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&from, &fromLen)) > 0) {
+			uint64_t rx = hostMicros();
+			if (sntpBuildResponse(pkt, len, syncedStatus(), rx, hostMicros())) {
+				sendto(sock, pkt, SNTP_PACKET_SIZE, 0, (struct sockaddr *)&from, fromLen);
+				answered++;
+			}
+			fromLen = sizeof(from);
+		}
+	}
+
+	void stop()
+	{
+		if (sock >= 0) {
+			shutdown(sock, SHUT_RDWR);
+			if (thread.joinable())
+				thread.join();
+			close(sock);
+			sock = -1;
+		}
+	}
+};
+
+/*
+ * Query the server the way an SNTP client does, and check that it finds
+ * the server's clock, which is the host's own, within a millisecond.
+ */
+static void test_loopback_client()
+{
+	LoopbackServer server;
+	struct sockaddr_in addr = {};
+	struct timeval timeout = { 1, 0 };
+	uint8_t pkt[SNTP_PACKET_SIZE], sent[8];
+
+	TEST_ASSERT_TRUE(server.start(0));
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(server.port);
+
+	for (int i = 0; i < 4; i++) {
+		uint64_t t1 = hostMicros();
+		request(pkt, 4, t1);
+		memcpy(sent, pkt + 40, 8);
+		TEST_ASSERT_EQUAL(sizeof(pkt), sendto(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&addr, sizeof(addr)));
+		TEST_ASSERT_EQUAL(SNTP_PACKET_SIZE, recv(sock, pkt, sizeof(pkt), 0));
+		uint64_t t4 = hostMicros();
+
+		TEST_ASSERT_EQUAL_UINT8(SNTP_MODE_SERVER, pkt[0] & 0x07);
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(sent, pkt + 24, 8);
+		int64_t t2 = getTimestamp(pkt + 32), t3 = getTimestamp(pkt + 40);
+		int64_t offset = ((t2 - (int64_t)t1) + (t3 - (int64_t)t4)) / 2;
+		int64_t delay = ((int64_t)t4 - (int64_t)t1) - (t3 - t2);
+		TEST_ASSERT_TRUE(t3 >= t2);
+		TEST_ASSERT_TRUE(delay >= -1 && delay < 100000);
+		TEST_ASSERT_INT32_WITHIN(1000, 0, offset);
+	}
+	close(sock);
+	server.stop();
+	TEST_ASSERT_EQUAL_UINT32(4, server.answered);
+}
+
+/*
+ * Query the server with ntpdate, which always sends to port 123. Binding
+ * it needs root, or net.ipv4.ip_unprivileged_port_start lowered to 123 as
+ * the CI build does.
+ */
+static void test_ntpdate()
+{
+	LoopbackServer server;
+	char line[256];
+	int stratum = -1;
+	double offset = 1e9, delay;
+
+	if (system("command -v ntpdate >/dev/null 2>&1") != 0)
+		TEST_IGNORE_MESSAGE("ntpdate is not installed");
+	if (!server.start(123))
+		TEST_IGNORE_MESSAGE("cannot bind 127.0.0.1:123");
+
+	FILE *out = popen("ntpdate -q -u 127.0.0.1 2>&1", "r");
+	TEST_ASSERT_NOT_NULL(out);
+	while (fgets(line, sizeof(line), out)) {
+		printf("ntpdate: %s", line);
+		sscanf(line, "server 127.0.0.1, stratum %d, offset %lf, delay %lf", &stratum, &offset, &delay);
+	}
+	pclose(out);
+	server.stop();
+
+	TEST_ASSERT_EQUAL_INT(TEST_STRATUM, stratum);
+	TEST_ASSERT_TRUE(offset > -0.001 && offset < 0.001);
+	TEST_ASSERT_TRUE(server.answered > 0);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_fields);
+	RUN_TEST(test_unsynced);
+	RUN_TEST(test_rejects);
+	RUN_TEST(test_loopback_client);
+	RUN_TEST(test_ntpdate);
+	return UNITY_END();
+}
@@ -0,0 +1,125 @@
+/*
+ * Tests of TzTable against AceTime itself: for every zone in the registry,
+ * tables covering 2000 to 2100 must give the same UTC offset and
+ * abbreviation as AceTime at every transition, the second before it, and
+ * at spot checks in between.
+ */
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <tztable.h>
+#include <unity.h>
+
+using namespace ace_time;
+
+#define FIRST_YEAR 2000
+#define LAST_YEAR 2100
+// Spot checks per table, besides the transitions.
+#define SAMPLES 500
+
+// Links are left out, as they share their target's ZoneInfo.
+static ExtendedZoneProcessorCache<1> zoneProcessorCache;
+static ExtendedZoneManager zoneManager(
+	zonedbx::kZoneRegistrySize,
+	zonedbx::kZoneRegistry,
+	zoneProcessorCache);
+
+static char zoneName[64];
+static char message[128];
+
+static const char *where(uint32_t utc)
+{
+	snprintf(message, sizeof(message), "%s at %u", zoneName, utc);
+	return message;
+}
+
+static void assertSame(const TimeZone &tz, const TzTransition &entry, uint32_t utc)
+{
+	ZonedExtra extra = ZonedExtra::forUnixSeconds64(utc, tz);
+
+	TEST_ASSERT_FALSE_MESSAGE(extra.isError(), where(utc));
+	TEST_ASSERT_EQUAL_INT16_MESSAGE(extra.timeOffset().toMinutes(), entry.offsetMinutes, where(utc));
+	TEST_ASSERT_EQUAL_STRING_MESSAGE(extra.abbrev(), entry.abbrev, where(utc));
+}
+
+/*
+ * Check one table entry by entry, and at random times within its window.
+ * Entries are only written when the offset or abbreviation changes, so
+ * the second before each one must still match the one before it.
+ */
+static void checkTable(const TimeZone &tz, const TzTable &table, uint32_t from, uint32_t until)
+{
+	TEST_ASSERT_TRUE_MESSAGE(table.count > 0, where(from));
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(from, table.entries[0].utc, where(from));
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(until, table.until, where(from));
+	TEST_ASSERT_TRUE_MESSAGE(table.covers(from) && table.covers(until - 1) && !table.covers(until), where(from));
+
+	for (uint8_t i = 0; i < table.count; i++) {
+		const TzTransition &entry = table.entries[i];
+		TEST_ASSERT_EQUAL_PTR(&entry, &table.find(entry.utc));
+		assertSame(tz, entry, entry.utc);
+		if (i > 0) {
+			TEST_ASSERT_TRUE_MESSAGE(entry.utc > table.entries[i - 1].utc, where(entry.utc));
+			TEST_ASSERT_EQUAL_PTR(&table.entries[i - 1], &table.find(entry.utc - 1));
+			assertSame(tz, table.entries[i - 1], entry.utc - 1);
+		}
+	}
+
+	for (int i = 0; i < SAMPLES; i++) {
+		uint32_t utc = from + (uint32_t)(((uint64_t)rand() << 16 ^ rand()) % (until - from));
+		assertSame(tz, table.find(utc), utc);
+	}
+}
+
+static void test_registry()
+{
+	uint16_t zones = zoneManager.zoneRegistrySize();
+	uint32_t tables = 0, transitions = 0, overflows = 0;
+
+	srand(1);
+	for (uint16_t z = 0; z < zones; z++) {
+		TimeZone tz = zoneManager.createForZoneIndex(z);
+		ace_common::PrintStr<sizeof(zoneName)> name;
+
+		TEST_ASSERT_FALSE(tz.isError());
+		tz.printTo(name);
+		strlcpy(zoneName, name.cstr(), sizeof(zoneName));
+
+		for (int16_t year = FIRST_YEAR; year < LAST_YEAR; year += TZ_TABLE_YEARS) {
+			TzTable table;
+			uint32_t from = LocalDateTime::forComponents(year, 1, 1, 0, 0, 0).toUnixSeconds64();
+			uint32_t until = LocalDateTime::forComponents(year + TZ_TABLE_YEARS, 1, 1, 0, 0, 0).toUnixSeconds64();
+
+			table.clear();
+			if (!table.build(tz, year)) {
+				// The clock falls back to AceTime for these.
+				printf("%s changes offset too often to tabulate from %d\n", zoneName, year);
+				TEST_ASSERT_EQUAL_UINT8(0, table.count);
+				TEST_ASSERT_FALSE(table.covers(from));
+				overflows++;
+				continue;
+			}
+			TEST_ASSERT_TRUE(table.matches(tz.getZoneId(), year));
+			checkTable(tz, table, from, until);
+			tables++;
+			transitions += table.count - 1;
+		}
+	}
+	printf("%u zones, %u tables with %u transitions, %u tables too full\n", zones, tables, transitions, overflows);
+	TEST_ASSERT_TRUE(tables > 0);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_registry);
+	return UNITY_END();
+}